@@ -0,0 +1,21 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+/**
+ * Count of the heap allocations (malloc family, hence operator new and cv::Mat buffers) made by the process.
+ * Only linked into the benchmark, where it checks that the per-frame path of sign_detect does not allocate.
+ */
+namespace AllocationCounter {
+    /**
+     * @return true when allocations are counted (glibc only)
+     */
+    bool isAvailable();
+
+    /**
+     * @return the number of allocations since the start of the process, or -1 when they are not counted
+     */
+    long getCount();
+}
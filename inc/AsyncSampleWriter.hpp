@@ -0,0 +1,77 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <cv.hpp>
+#include "BlockingQueue.hpp"
+#include "CaptureLogWriter.hpp"
+
+/**
+ * Write captured samples (cropped image as .png and backprojection as .yml) on a background thread,
+ * so that saving never stalls the capture loop.
+ * When the queue is full the sample is dropped and counted instead of blocking the caller.
+ * With a capture log directory, samples are appended to the log (see CaptureLogFormat.hpp) instead of
+ * being written as one .png and one .yml file each.
+ */
+class AsyncSampleWriter {
+public:
+    struct Sample {
+        std::string imagePath;
+        cv::Mat image;
+        std::string dataPath;
+        cv::Mat data;
+        int letter;
+        int64_t timestamp;
+    };
+
+    /**
+     * @param capacity Number of samples waiting to be written before new ones are dropped.
+     * @param captureLogDir Capture log directory, empty to write separate .png and .yml files.
+     */
+    AsyncSampleWriter(size_t capacity, std::string captureLogDir = "");
+
+    ~AsyncSampleWriter();
+
+    void start();
+
+    /**
+     * Write the samples still queued then stop the writer thread.
+     */
+    void stop();
+
+    /**
+     * Queue a sample for writing, never blocks. The matrices must not be modified by the caller afterwards.
+     *
+     * @return false if the sample has been dropped (queue full or writer stopped)
+     */
+    bool submit(Sample sample);
+
+    long getNbOfSubmitted() const;
+
+    long getNbOfWritten() const;
+
+    long getNbOfDropped() const;
+
+    long getNbOfFailed() const;
+
+    void logStats() const;
+
+private:
+    BlockingQueue<Sample> queue;
+    std::thread writer;
+    std::unique_ptr<CaptureLogWriter> captureLog;
+
+    std::atomic<long> nbOfSubmitted;
+    std::atomic<long> nbOfWritten;
+    std::atomic<long> nbOfDropped;
+    std::atomic<long> nbOfFailed;
+    std::atomic<long> writeNS;
+
+    void run();
+};
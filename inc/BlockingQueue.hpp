@@ -0,0 +1,106 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/**
+ * Bounded multi-producer / multi-consumer FIFO queue.
+ * Producers block while the queue is full, consumers block while it is empty.
+ * Once closed, pushes are refused and pops drain the remaining items then fail.
+ */
+template<typename T>
+class BlockingQueue {
+public:
+    BlockingQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+    /**
+     * Wait for a free slot then add the item.
+     *
+     * @return false if the queue has been closed (the item is dropped)
+     */
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * Add the item only if there is a free slot, never blocks.
+     *
+     * @return false if the queue is full or closed (the item is dropped)
+     */
+    bool tryPush(T item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed || items.size() >= capacity) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * Wait for an item and remove it from the queue.
+     *
+     * @return false if the queue is closed and empty
+     */
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * Refuse any new item and wake up every waiting thread.
+     */
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+    /**
+     * Drop the remaining items and reopen the queue.
+     */
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        items.clear();
+        closed = false;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+    size_t getCapacity() const {
+        return capacity;
+    }
+
+private:
+    const size_t capacity;
+    std::deque<T> items;
+    bool closed = false;
+
+    mutable std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+};
@@ -0,0 +1,53 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Append-only capture log, written by sign_detect.exe and compacted into a packed data set by capture_compact.exe.
+ *
+ * A log is a directory of segment files (capture_<timestamp>.slcl), each one made of:
+ *  - SegmentHeader
+ *  - Records, each one a RecordHeader followed by payloadSize bytes of payload:
+ *    RecordInfo, dataRows * dataCols elements of type dataType, then imageSize bytes of encoded (.png) image
+ *
+ * Every record is written with a single append and checked with a CRC-32 of its payload: after a crash,
+ * a reader keeps every complete record of a segment and ignores its torn tail.
+ * A writer never appends to an existing segment, it always starts a new one.
+ */
+namespace CaptureLog {
+    const char MAGIC[4] = {'S', 'L', 'C', 'L'};
+    const uint32_t VERSION = 1;
+    const uint32_t RECORD_MAGIC = 0x31434552; // "REC1"
+    const char *const SEGMENT_EXT = ".slcl";
+    const char *const SEGMENT_PREFIX = "capture_";
+
+    struct SegmentHeader {
+        char magic[4];
+        uint32_t version;
+    };
+
+    struct RecordHeader {
+        uint32_t magic;
+        uint32_t payloadSize;
+        uint32_t crc; // CRC-32 of the payload
+    };
+
+    struct RecordInfo {
+        int32_t letter;
+        int32_t dataType; // OpenCV type of the data (e.g. CV_8UC1)
+        int32_t dataRows;
+        int32_t dataCols;
+        int64_t timestamp;
+        uint32_t imageSize; // 0 when the cropped image is not stored
+        uint32_t reserved;
+    };
+
+    inline bool hasMagic(const SegmentHeader &header) {
+        return std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0;
+    }
+}
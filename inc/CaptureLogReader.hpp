@@ -0,0 +1,53 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <cv.hpp>
+
+/**
+ * Read the records of a capture log (see CaptureLogFormat.hpp).
+ */
+class CaptureLogReader {
+public:
+    struct Record {
+        int letter;
+        int64_t timestamp;
+        cv::Mat data;
+        std::vector<uchar> encodedImage;
+    };
+
+    CaptureLogReader(std::string segmentPath);
+
+    /**
+     * List the segments of a log directory, oldest first.
+     */
+    static std::vector<std::string> listSegments(const std::string &directory);
+
+    /**
+     * Call the callback for each valid record of the segment, in order.
+     * Reading stops at the first torn or corrupted record (see isTruncated).
+     *
+     * @return success code (error if the segment can not be opened or has an invalid header)
+     */
+    int foreachRecord(const std::function<void(const Record &)> &callback);
+
+    /**
+     * @return true if the last read stopped before the end of the segment (torn or corrupted record)
+     */
+    bool isTruncated() const;
+
+    /**
+     * @return number of valid records found by the last read
+     */
+    int getNbOfRecords() const;
+
+private:
+    std::string segmentPath;
+    bool truncated;
+    int nbOfRecords;
+};
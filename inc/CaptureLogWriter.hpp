@@ -0,0 +1,56 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cv.hpp>
+
+/**
+ * Append captured samples to a capture log directory (see CaptureLogFormat.hpp).
+ * Not thread safe: use a single writer thread (e.g. AsyncSampleWriter).
+ */
+class CaptureLogWriter {
+public:
+    /**
+     * @param directory Directory of the log, created if needed.
+     * @param maxSegmentSize A new segment is started once the current one reaches this size (bytes).
+     */
+    CaptureLogWriter(std::string directory, size_t maxSegmentSize = DEFAULT_MAX_SEGMENT_SIZE);
+
+    ~CaptureLogWriter();
+
+    CaptureLogWriter(const CaptureLogWriter &) = delete;
+
+    CaptureLogWriter &operator=(const CaptureLogWriter &) = delete;
+
+    /**
+     * Append one sample to the current segment (starting a new one if needed).
+     *
+     * @param letter Letter of the sample (e.g. 'a').
+     * @param timestamp Capture time.
+     * @param data Sample data (e.g. the small backprojection), any type.
+     * @param encodedImage Encoded cropped image, may be empty.
+     * @return success code
+     */
+    int append(int letter, int64_t timestamp, const cv::Mat &data,
+               const std::vector<uchar> &encodedImage = std::vector<uchar>());
+
+    /**
+     * Flush the current segment to the disk and close it.
+     */
+    void close();
+
+    static const size_t DEFAULT_MAX_SEGMENT_SIZE = 64 * 1024 * 1024;
+
+private:
+    std::string directory;
+    size_t maxSegmentSize;
+    int fd;
+    size_t segmentSize;
+    std::vector<char> buffer;
+
+    int openSegment();
+};
@@ -0,0 +1,66 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Record of a directory conversion: source file -> output file, with the source size and modification time
+ * and the conversion parameters. Stored as a text file next to the output directory (<output>.manifest).
+ */
+class ConversionManifest {
+public:
+    struct Entry {
+        std::string output;
+        int64_t size = 0;
+        int64_t mtimeSec = 0;
+        int64_t mtimeNSec = 0;
+    };
+
+    /**
+     * @param filePath Path of the manifest file.
+     * @param parameters Conversion parameters; a manifest written with other parameters is ignored.
+     */
+    ConversionManifest(std::string filePath, std::string parameters);
+
+    /**
+     * Load the manifest. A missing manifest or one written with other parameters gives an empty manifest.
+     *
+     * @return success code (error only if the file exists but is corrupted)
+     */
+    int load();
+
+    /**
+     * Write the manifest (temporary file then rename, an interrupted run keeps the previous manifest).
+     *
+     * @return success code
+     */
+    int save() const;
+
+    /**
+     * @return true if the source is recorded with the same size and modification time
+     */
+    bool isUpToDate(const std::string &source, const Entry &current) const;
+
+    void set(const std::string &source, const Entry &entry);
+
+    void remove(const std::string &source);
+
+    const std::unordered_map<std::string, Entry> &getEntries() const;
+
+    const std::string &getFilePath() const;
+
+    /**
+     * @return manifest path associated to an output directory (<directory>.manifest)
+     */
+    static std::string pathFor(std::string directory);
+
+private:
+    std::string filePath;
+    std::string parameters;
+    std::unordered_map<std::string, Entry> entries;
+};
@@ -0,0 +1,48 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * CRC-32 (IEEE 802.3 polynomial), used to detect torn or corrupted records.
+ */
+class Crc32 {
+public:
+    Crc32 &add(const void *data, size_t size) {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++) {
+            value = table()[(value ^ bytes[i]) & 0xFF] ^ (value >> 8);
+        }
+        return *this;
+    }
+
+    uint32_t get() const {
+        return value ^ 0xFFFFFFFFu;
+    }
+
+private:
+    uint32_t value = 0xFFFFFFFFu;
+
+    static const uint32_t *table() {
+        static const Table instance;
+        return instance.entries;
+    }
+
+    struct Table {
+        uint32_t entries[256];
+
+        Table() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                entries[i] = c;
+            }
+        }
+    };
+};
@@ -0,0 +1,104 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cv.hpp>
+#include "BlockingQueue.hpp"
+#include "DataBinFormat.hpp"
+#include "MappedFile.hpp"
+#include "ParallelFor.hpp"
+
+/**
+ * Stream shuffled mini-batches of a data set from disk, for data sets that do not fit in memory.
+ * A producer thread reads the next batches ahead in a bounded queue: at most (prefetch + 2) batches
+ * are in memory at any time, whatever the size of the data set.
+ */
+class DataBatchStream {
+public:
+    /**
+     * @param source Directory of .yml data files (e.g. dataDir/name_type), or a packed data set file.
+     * @param batchSize Number of samples per batch.
+     * @param prefetch Number of batches read ahead.
+     * @param nbThreads Number of threads parsing the .yml files of a batch (0 means one per hardware thread).
+     */
+    DataBatchStream(std::string source, int batchSize, int prefetch = 4, int nbThreads = 0);
+
+    ~DataBatchStream();
+
+    DataBatchStream(const DataBatchStream &) = delete;
+
+    DataBatchStream &operator=(const DataBatchStream &) = delete;
+
+    /**
+     * List the samples of the source and read the size of a sample. No sample data is kept in memory.
+     *
+     * @return success code
+     */
+    int open();
+
+    /**
+     * Start reading batches of a new pass over the data set, in a shuffled order that only depends on the epoch.
+     * Any batch of the previous epoch not consumed yet is dropped.
+     *
+     * @param epoch Index of the pass over the data set.
+     */
+    void startEpoch(int epoch);
+
+    /**
+     * Wait for the next batch of the current epoch.
+     *
+     * @param data One sample per row (32 bits float).
+     * @param responses One integer label per row.
+     * @return false when the epoch is over
+     */
+    bool nextBatch(cv::Mat &data, cv::Mat &responses);
+
+    /**
+     * Stop the producer thread.
+     */
+    void stop();
+
+    int getSampleSize() const;
+
+    int getNbOfSamples() const;
+
+    int getBatchSize() const;
+
+    const std::string &getSource() const;
+
+private:
+    struct Batch {
+        cv::Mat data;
+        cv::Mat responses;
+    };
+
+    std::string source;
+    int batchSize;
+    int nbThreads;
+
+    // .yml directory source
+    std::vector<std::string> pathList;
+    std::unique_ptr<WorkerPool> pool; // Parses the files of every batch
+
+    // Packed data set source
+    std::shared_ptr<MappedFile> packedFile;
+    DataBin::Header packedHeader;
+
+    int nbOfSamples = 0;
+    int sampleSize = 0;
+
+    BlockingQueue<Batch> queue;
+    std::thread producer;
+    std::atomic<bool> stopping;
+
+    void produce(std::vector<int> order);
+
+    void readBatch(const std::vector<int> &order, size_t begin, size_t end, Batch &batch);
+};
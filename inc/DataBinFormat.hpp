@@ -0,0 +1,128 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <opencv2/core/mat.hpp>
+
+/**
+ * Packed binary data set file (.sldb), produced by data_pack.exe and loaded by aggregateDataFrom.
+ *
+ * Layout (little endian):
+ *  - Header
+ *  - Label table: nbLabels entries of {int32 label, uint32 count, uint32 nameLength, name bytes}
+ *  - Responses: rows * int32, aligned on ALIGNMENT bytes
+ *  - Data: rows * rowBytes(dtype, cols) bytes, contiguous, aligned on ALIGNMENT bytes
+ *
+ * Data is stored as 32 bits floats, as 8 bits unsigned integers (e.g. backprojections) or with 1 bit per value
+ * (thresholded backprojections, 0 or 255), and converted to floats only when it is used for training.
+ * Responses and data blocks can be used in place once the file is memory-mapped.
+ */
+namespace DataBin {
+    const char MAGIC[4] = {'S', 'L', 'D', 'B'};
+    const uint32_t VERSION = 3;
+    const uint64_t ALIGNMENT = 64;
+
+    // Header::dtype: an OpenCV depth (CV_32F, CV_8U) or DTYPE_BIT
+    const uint32_t DTYPE_BIT = 0x100; // 1 bit per value (0 or 255), each row padded to a whole byte
+    const uint32_t DTYPE_AUTO = 0x200; // Writer only: smallest storage that keeps the values unchanged
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t dtype; // Storage of the data block (CV_32F, CV_8U or DTYPE_BIT)
+        uint32_t rows;
+        uint32_t cols;
+        uint32_t nbLabels;
+        uint64_t labelTableOffset;
+        uint64_t responsesOffset;
+        uint64_t dataOffset;
+        uint64_t fileSize;
+        uint64_t sourceFingerprint; // Fingerprint of the source directory when used as a cache, 0 otherwise
+        uint64_t nbOfSkippedFiles; // Source files that could not be loaded when used as a cache, 0 otherwise
+    };
+
+    inline uint64_t align(uint64_t offset) {
+        return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    inline bool hasMagic(const Header &header) {
+        return std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0;
+    }
+
+    inline bool isSupportedDtype(uint32_t dtype) {
+        return dtype == CV_32F || dtype == CV_8U || dtype == DTYPE_BIT;
+    }
+
+    /**
+     * @return size in bytes of one stored row
+     */
+    inline uint64_t rowBytes(uint32_t dtype, uint32_t cols) {
+        if (dtype == DTYPE_BIT) {
+            return (cols + 7) / 8;
+        } else if (dtype == CV_8U) {
+            return cols;
+        }
+        return (uint64_t) cols * sizeof(float);
+    }
+
+    /**
+     * @param size Size of the file (or mapping) the header was read from
+     * @return true if the storage is supported and the responses and data blocks lie within the file
+     */
+    inline bool isConsistent(const Header &header, uint64_t size) {
+        return isSupportedDtype(header.dtype) && header.fileSize <= size
+               && header.labelTableOffset <= header.responsesOffset
+               && header.responsesOffset + (uint64_t) header.rows * sizeof(int32_t) <= header.fileSize
+               && header.dataOffset + (uint64_t) header.rows * rowBytes(header.dtype, header.cols) <= header.fileSize;
+    }
+
+    /**
+     * Convert one stored row to floats.
+     */
+    inline void unpackRow(const unsigned char *row, uint32_t dtype, uint32_t cols, float *output) {
+        if (dtype == DTYPE_BIT) {
+            for (uint32_t c = 0; c < cols; c++) {
+                output[c] = (row[c >> 3] >> (c & 7)) & 1 ? 255.f : 0.f;
+            }
+        } else if (dtype == CV_8U) {
+            for (uint32_t c = 0; c < cols; c++) {
+                output[c] = row[c];
+            }
+        } else {
+            std::memcpy(output, row, cols * sizeof(float));
+        }
+    }
+
+    inline std::string dtypeName(uint32_t dtype) {
+        switch (dtype) {
+            case CV_32F:
+                return "float";
+            case CV_8U:
+                return "uint8";
+            case DTYPE_BIT:
+                return "bit";
+            case DTYPE_AUTO:
+                return "auto";
+            default:
+                return "unknown";
+        }
+    }
+
+    /**
+     * @return false if the name is not one of auto, float, uint8 or bit
+     */
+    inline bool parseDtype(const std::string &name, uint32_t &dtype) {
+        for (uint32_t candidate : {DTYPE_AUTO, (uint32_t) CV_32F, (uint32_t) CV_8U, DTYPE_BIT}) {
+            if (dtypeName(candidate) == name) {
+                dtype = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+}
@@ -0,0 +1,73 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <cv.hpp>
+#include "DataBinFormat.hpp"
+#include "LabelMap.hpp"
+#include "MappedFile.hpp"
+
+class DataBinReader {
+public:
+    DataBinReader(std::string filePath);
+
+    /**
+     * @param filePath Path to check
+     * @return true if the given path is a regular file starting with a packed data set header
+     */
+    static bool isDataBinFile(const std::string &filePath);
+
+    /**
+     * Read only the header of a packed data set (no mapping).
+     *
+     * @param filePath Path to the packed data set
+     * @param header Read header
+     * @return success code (error if the file is missing, not a packed data set or of another version)
+     */
+    static int readHeader(const std::string &filePath, DataBin::Header &header);
+
+    /**
+     * Map the packed data set in memory. Matrices point directly into the mapping: there is no parsing
+     * and no copy, the mapping is released with the last matrix referencing it.
+     * Data stored as uint8 or bits is converted to a new float matrix.
+     *
+     * @param dataOutput One sample per row (CV_32F).
+     * @param responsesOutput One integer label per row (rows x 1, CV_32S).
+     * @return success code
+     */
+    int read(cv::Mat &dataOutput, cv::Mat &responsesOutput);
+
+    /**
+     * Same as read, but the data is returned as stored, without conversion: CV_32F or CV_8U rows of cols values,
+     * or CV_8U rows of DataBin::rowBytes(DTYPE_BIT, cols) bytes (see getHeader for the storage).
+     */
+    int readStored(cv::Mat &dataOutput, cv::Mat &responsesOutput);
+
+    /**
+     * @return header read from the file (valid after a successful read)
+     */
+    const DataBin::Header &getHeader() const;
+
+    /**
+     * @return label names read from the label table (valid after a successful read)
+     */
+    const LabelMap &getLabelMap() const;
+
+    /**
+     * @return number of samples per label read from the label table (valid after a successful read)
+     */
+    const std::map<int, int> &getLabelCounts() const;
+
+private:
+    std::string filePath;
+    DataBin::Header header;
+    LabelMap labelMap;
+    std::map<int, int> labelCounts;
+
+    int readLabelTable(const MappedFile &file, const DataBin::Header &header);
+};
@@ -0,0 +1,39 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <string>
+#include <cv.hpp>
+#include "DataBinFormat.hpp"
+#include "LabelMap.hpp"
+
+class DataBinWriter {
+public:
+    DataBinWriter(std::string filePath);
+
+    /**
+     * Write a whole data set in a packed binary file (see DataBinFormat.hpp).
+     * The file is written next to its final location then renamed, so a reader never sees a partial file.
+     *
+     * @param data One sample per row.
+     * @param responses One integer label per sample.
+     * @param labelMap Names of the labels, stored in the label table.
+     * @param sourceFingerprint Fingerprint of the data source, used to validate data set caches.
+     * @param dtype Storage of the data: CV_32F, CV_8U (values rounded and saturated), DataBin::DTYPE_BIT
+     * (values >= 128 stored as 255, others as 0) or DataBin::DTYPE_AUTO (smallest lossless one).
+     * @param nbOfSkippedFiles Files of the data source that could not be loaded, reported again by cache reads.
+     * @return success code
+     */
+    int write(const cv::Mat &data, const cv::Mat &responses, LabelMap labelMap = LabelMap(),
+              uint64_t sourceFingerprint = 0, uint32_t dtype = DataBin::DTYPE_AUTO, uint64_t nbOfSkippedFiles = 0);
+
+    /**
+     * @return the smallest storage that keeps every value of the data unchanged (DTYPE_BIT, CV_8U or CV_32F)
+     */
+    static uint32_t smallestDtype(const cv::Mat &data);
+
+private:
+    std::string filePath;
+};
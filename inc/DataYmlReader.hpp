@@ -16,11 +16,13 @@ public:
      *
      * @param dataOutput Read data from file. Must be an array.
      * @param labelOutput Read label from file. Must be the an integer.
-     * @return true if reading succeed, false otherwise.
+     * @return true if reading succeed, false otherwise (including a file OpenCV fails to parse).
      */
     int read(cv::Mat &dataOutput, int &labelOutput);
 
 private:
     std::string filePath;
+
+    int readOrThrow(cv::Mat &dataOutput, int &labelOutput);
 };
 
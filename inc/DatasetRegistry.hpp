@@ -0,0 +1,98 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <opencv2/core/mat.hpp>
+
+/**
+ * Thread-safe set of training data sets shared by several jobs.
+ * A data set is loaded by the first job acquiring it, shared read-only with the next ones, and evicted once
+ * every expected use has been released. The memory budget is not enforced here: the caller only runs at once
+ * the jobs of data sets fitting in it (see fits), the registry reports what is actually resident.
+ */
+class DatasetRegistry {
+public:
+    struct Dataset {
+        cv::Mat data;
+        cv::Mat responses;
+
+        size_t bytes() const;
+    };
+
+    /**
+     * @param maxBytes Memory budget for the resident data sets (0: no limit)
+     * @param nbThreads Number of threads used to load a data set (see aggregateDataFrom)
+     * @param useCache Load the data sets through their packed cache (see aggregateDataFrom)
+     */
+    DatasetRegistry(size_t maxBytes, int nbThreads = 0, bool useCache = false);
+
+    /**
+     * @return estimated memory taken by a data set once loaded
+     */
+    static size_t estimateBytes(int nbOfSamples, int sampleSize);
+
+    /**
+     * @param nativeTraining true if the model is trained by MLPTrainer, false if by OpenCV ANN_MLP
+     * @return estimated memory allocated by one job training on a data set (see MLPModel::learnFrom), on top of
+     * the shared data set: every running job holds its own copy
+     */
+    static size_t estimateTrainingBytes(int nbOfSamples, int sampleSize, bool nativeTraining);
+
+    /**
+     * @return true if data sets of that total estimated size can be resident at the same time
+     */
+    bool fits(size_t bytes) const;
+
+    /**
+     * Declare that nbOfUses more jobs will acquire then release the data set.
+     */
+    void expect(const std::string &directory, int nbOfUses);
+
+    /**
+     * Load the data set if it is not resident yet (other jobs acquiring it meanwhile wait for it).
+     *
+     * @return the data set, or nullptr if it could not be loaded
+     */
+    std::shared_ptr<const Dataset> acquire(const std::string &directory);
+
+    /**
+     * One expected use of the data set is done: after the last one, the registry drops it (its memory is
+     * freed when the jobs still holding it release their pointer).
+     */
+    void release(const std::string &directory);
+
+    size_t getMaxBytes() const;
+
+    size_t getResidentBytes() const;
+
+    /**
+     * @return highest resident size since the registry was created
+     */
+    size_t getPeakBytes() const;
+
+private:
+    struct Entry {
+        int pendingUses = 0;
+        bool loading = false;
+        bool failed = false;
+        std::shared_ptr<const Dataset> dataset;
+    };
+
+    const size_t maxBytes;
+    const int nbThreads;
+    const bool useCache;
+
+    mutable std::mutex mutex;
+    std::condition_variable loaded;
+    std::map<std::string, Entry> entries;
+    size_t residentBytes;
+    size_t peakBytes;
+};
@@ -4,16 +4,77 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <functional>
+#include <vector>
 
 class DirectoryReader {
 public:
+    struct Entry {
+        std::string path;
+        std::string name;
+        int64_t size = 0;
+        int64_t mtimeSec = 0;
+        int64_t mtimeNSec = 0;
+    };
+
     DirectoryReader(std::string directory);
 
+    /**
+     * Only keep files ending with one of these extensions (e.g. ".png"). Empty (default): keep every file.
+     */
+    DirectoryReader &setExtensions(std::vector<std::string> extensions);
+
+    /**
+     * Also list the files of the subdirectories. Disabled by default.
+     */
+    DirectoryReader &setRecursive(bool recursive);
+
+    /**
+     * Fill the size and modification time of the listed entries (one stat per file). Disabled by default.
+     */
+    DirectoryReader &setWithStat(bool withStat);
+
+    /**
+     * List the regular files of the directory, sorted by path. The list is kept and reused by the next calls
+     * of foreachFile and foreachFileParallel (call list again to refresh it).
+     *
+     * @return success code (error if the directory can not be opened)
+     */
+    int list();
+
+    /**
+     * @return files found by the last list
+     */
+    const std::vector<Entry> &getFiles() const;
+
+    /**
+     * Call the callback with the path and the name of each file, sorted by path.
+     *
+     * @return success code
+     */
     int foreachFile(const std::function<void(std::string, std::string)> &callback);
 
+    /**
+     * Call the callback for each file from a pool of workers (in any order, the callback must be thread safe).
+     *
+     * @param nbThreads Number of workers, 0 for one per hardware thread.
+     * @param callback Called with the file and the index of the worker.
+     * @return success code
+     */
+    int foreachFileParallel(int nbThreads, const std::function<void(const Entry &, int)> &callback);
+
 private:
     std::string directory;
-};
+    std::vector<std::string> extensions;
+    bool recursive;
+    bool withStat;
+
+    bool listed;
+    std::vector<Entry> files;
 
+    bool hasExtension(const std::string &fileName) const;
+
+    int listDirectory(const std::string &path, bool isRoot);
+};
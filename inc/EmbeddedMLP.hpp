@@ -0,0 +1,70 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include "TanhApprox.hpp"
+
+/**
+ * Building blocks of the forward pass of a model compiled into the program (see model_codegen.exe).
+ * The layer sizes are template parameters: every loop has a constant trip count and is unrolled and
+ * vectorized by the compiler, with no dispatch at runtime.
+ */
+namespace EmbeddedMLP {
+    /**
+     * output = tanh(bias + input * weights), weights holding one row of Out values per input.
+     */
+    template<int In, int Out>
+    inline void layer(const float *input, const float (&weights)[In * Out], const float (&bias)[Out],
+                      float (&output)[Out]) {
+        // Two independent sums (even and odd inputs) halve the dependency chain of the accumulations
+        float even[Out], odd[Out];
+        for (int o = 0; o < Out; o++) {
+            even[o] = bias[o];
+            odd[o] = 0;
+        }
+        int i = 0;
+        for (; i + 1 < In; i += 2) {
+            const float x0 = input[i], x1 = input[i + 1];
+            for (int o = 0; o < Out; o++) {
+                even[o] += x0 * weights[i * Out + o];
+                odd[o] += x1 * weights[(i + 1) * Out + o];
+            }
+        }
+        for (; i < In; i++) {
+            for (int o = 0; o < Out; o++) {
+                even[o] += input[i] * weights[i * Out + o];
+            }
+        }
+        for (int o = 0; o < Out; o++) {
+            output[o] = tanhApprox(even[o] + odd[o]);
+        }
+    }
+
+    /**
+     * Scale the last activation with the (scale, shift) pairs and pick the largest output.
+     *
+     * @param scores If not null, receives the Out outputs of the network.
+     * @return A pair: <0> predicted label (index of the largest output), <1> its output value
+     */
+    template<int Out>
+    inline std::pair<int, float> output(const float (&last)[Out], const float (&scale)[2 * Out], float *scores) {
+        float values[Out];
+        for (int o = 0; o < Out; o++) {
+            values[o] = last[o] * scale[2 * o] + scale[2 * o + 1];
+        }
+        int best = 0;
+        for (int o = 1; o < Out; o++) {
+            if (values[o] > values[best]) {
+                best = o;
+            }
+        }
+        if (scores != nullptr) {
+            std::copy(values, values + Out, scores);
+        }
+        return {best, values[best]};
+    }
+}
@@ -0,0 +1,55 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cv.hpp>
+
+/**
+ * Description of a feature extracted from a grayscale hand image.
+ * String form: "<type>=hog:<size>:<block>:<stride>:<cell>" or "<type>=resize:<size>",
+ * where <type> names the data set type (dataDir/name_<type>, as in MultiConfig).
+ */
+class FeatureSpec {
+public:
+    enum Kind {
+        HOG = 0,   // HOG description of the image resized to size x size
+        RESIZE = 1 // Raw pixels of the image resized to size x size (area interpolation, as the hand input), flattened
+    };
+
+    std::string type;
+    Kind kind = HOG;
+    int size = 0;
+    int blockSize = 0;
+    int blockStrideSize = 0;
+    int cellSize = 0;
+
+    /**
+     * @param spec String form of the feature (see class description)
+     * @param feature Parsed feature
+     * @return success code
+     */
+    static int parse(const std::string &spec, FeatureSpec &feature);
+
+    /**
+     * @return a HOG descriptor configured for this feature (HOG kind only)
+     */
+    cv::HOGDescriptor createDescriptor() const;
+
+    /**
+     * Compute the feature of an image.
+     *
+     * @param gray Grayscale image, any size.
+     * @param descriptor Descriptor created by createDescriptor (HOG kind only, may be shared by calls of one thread).
+     * @param resized Scratch image, reused between calls.
+     * @param description Computed feature (HOG kind).
+     * @param pixels Computed feature, 1 x (size * size) 8 bits (RESIZE kind).
+     */
+    void compute(const cv::Mat &gray, const cv::HOGDescriptor &descriptor, cv::Mat &resized,
+                 std::vector<float> &description, cv::Mat &pixels) const;
+
+    std::string toString() const;
+};
@@ -0,0 +1,73 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <vector>
+#include <opencv2/core/mat.hpp>
+
+/**
+ * Workspace converting the tracked hand of a backprojection into the model input: square crop, area resize to
+ * size x size and scaling of the values, in a single pass written into a row owned by the workspace.
+ *
+ * Once the workspace is large enough for the frames (see reserve), a conversion performs no heap allocation.
+ * Not thread safe: use one workspace per thread.
+ */
+class HandInput {
+public:
+    /**
+     * @param size Side of the resized image (the model input has size * size values).
+     * @param scale Factor applied to the backprojection values (e.g. 1 / 255 for values in [0, 1]).
+     */
+    HandInput(int size, float scale);
+
+    /**
+     * Allocate the tables needed for any region of a frame of the given size.
+     */
+    void reserve(const cv::Size &frameSize);
+
+    /**
+     * @param backproj Backprojection (8 bits, one channel).
+     * @param handRect Bounding rectangle of the hand, made square (largest side, clipped to the image).
+     * @return the input row (1 x size * size, 32 bits float), overwritten by the next call. Same values as
+     * cv::resize with cv::INTER_AREA then the scaling, except for regions smaller than size x size: each
+     * destination pixel still averages the source area it covers (it blends the two source pixels it straddles,
+     * or takes the one it lies in), where OpenCV interpolates linearly between source pixel centers
+     */
+    const cv::Mat &convert(const cv::Mat &backproj, const cv::Rect &handRect);
+
+    /**
+     * @return the square region converted for the given hand rectangle
+     */
+    static cv::Rect squareRoi(const cv::Rect &handRect, const cv::Size &imageSize);
+
+    int getSize() const;
+
+private:
+    /**
+     * Source pixels averaged by each destination pixel along one axis: destination d uses the entries
+     * [begin[d], begin[d + 1]) of (index, weight).
+     */
+    struct AxisTable {
+        std::vector<int> begin;
+        std::vector<int> index;
+        std::vector<float> weight;
+        int builtLength = -1;
+        float builtScale = 0;
+
+        void reserve(int size, int srcLength);
+
+        /**
+         * @param scale Factor applied to every weight.
+         */
+        void build(int size, int srcLength, float scale);
+    };
+
+    int size;
+    float scale;
+    cv::Mat row;
+    std::vector<float> rowSums; // one source row averaged along x
+    AxisTable xTable;
+    AxisTable yTable;
+};
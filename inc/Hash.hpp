@@ -0,0 +1,44 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Incremental 64 bits FNV-1a hash, used to fingerprint files and configurations (not cryptographic).
+ */
+class Hash {
+public:
+    Hash &add(const void *data, size_t size) {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++) {
+            value ^= bytes[i];
+            value *= PRIME;
+        }
+        return *this;
+    }
+
+    Hash &add(const std::string &str) {
+        add(str.data(), str.size());
+        // Separator, so that ("ab", "c") and ("a", "bc") differ
+        return add<uint8_t>(0);
+    }
+
+    template<typename T>
+    Hash &add(const T &pod) {
+        return add(&pod, sizeof(pod));
+    }
+
+    uint64_t get() const {
+        return value;
+    }
+
+private:
+    static const uint64_t OFFSET = 14695981039346656037ULL;
+    static const uint64_t PRIME = 1099511628211ULL;
+
+    uint64_t value = OFFSET;
+};
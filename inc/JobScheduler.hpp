@@ -0,0 +1,89 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Fixed-size worker pool running a set of independent jobs of known estimated cost.
+ * Jobs are dealt largest cost first to one deque per worker: a worker runs its own jobs from the largest,
+ * and once its deque is empty steals the smallest job of the earliest group left in the deques of the other workers.
+ * Jobs can be grouped (e.g. by the data they read): groups run one after the other, in the order of their first
+ * job submission, so that the workers share the same group most of the time.
+ */
+class JobScheduler {
+public:
+    /**
+     * @param worker Id of the worker running the job, in [0, getNbOfWorkers())
+     */
+    typedef std::function<void(int worker)> Job;
+
+    /**
+     * @param nbThreads Number of hardware threads shared by the jobs (0 or less means every hardware thread)
+     */
+    JobScheduler(int nbThreads = 0);
+
+    /**
+     * Add a job to the next run.
+     *
+     * @param cost Estimated cost of the job, only used to order the jobs
+     * @param group Group of the job
+     */
+    void submit(double cost, Job job, int group = 0);
+
+    /**
+     * Size the pool (one worker per thread, at most one per job), then run every submitted job.
+     * Returns once all of them are done, the scheduler can then be reused.
+     */
+    void run();
+
+    /**
+     * @return number of workers used by the last run (or the next one, if called before run)
+     */
+    int getNbOfWorkers() const;
+
+    /**
+     * @return number of threads each job may use itself (e.g. with cv::setNumThreads), so that the running
+     * jobs together do not use more than the scheduler threads
+     */
+    int getThreadBudget() const;
+
+    /**
+     * @return number of jobs run by another worker than the one they were dealt to, during the last run
+     */
+    size_t getNbOfSteals() const;
+
+private:
+    struct Entry {
+        size_t groupRank;
+        double cost;
+        Job job;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Entry> jobs;
+    };
+
+    const int nbThreads;
+    int lastNbOfWorkers;
+    std::vector<Entry> pending;
+    std::map<int, size_t> groupRanks;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::atomic<size_t> nbOfSteals;
+
+    bool popOwn(int worker, Entry &entry);
+
+    bool steal(int worker, Entry &entry);
+
+    void work(int worker);
+};
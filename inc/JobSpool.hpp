@@ -0,0 +1,163 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Training job queue shared by several processes through a directory (possibly on a network file system).
+ * Every job is one file moving between state directories with atomic renames:
+ *   queued/<id>.yml -> claimed/<id>@<worker>.yml -> done/<id>.yml or failed/<id>.yml
+ * A worker keeps its claim alive by touching the claimed file. Claims not touched for longer than the lease
+ * are moved back to queued/ by anyone polling the spool, so the jobs of a dead worker are run again.
+ * The submitter closes the spool once every job is queued: workers wait for more jobs until then.
+ */
+class JobSpool {
+public:
+    struct Job {
+        std::string id;
+        std::string name;
+        std::string type;
+        std::string topology;
+        std::string source; // data set to train on: packed data set (mapped by workers) or .yml directory
+        std::string modelPath;
+        int batchSize = 0;
+        int prefetch = 0;
+        int epochs = 0;
+        std::string optimizer; // empty: OpenCV training
+        double learningRate = 0;
+        int miniBatch = 0;
+
+        std::string claimPath; // set by claim
+    };
+
+    struct Result {
+        std::string id;
+        bool success = false;
+        std::string modelPath;
+        double trainSeconds = 0;
+        std::string worker;
+    };
+
+    /**
+     * Keep a claim alive while it exists: touch the claimed file from a background thread.
+     */
+    class Lease {
+    public:
+        Lease(const Job &job, int leaseMS);
+
+        ~Lease();
+
+        /**
+         * @return false if the claimed file disappeared (the lease expired and the job was queued again)
+         */
+        bool isHeld() const;
+
+    private:
+        const std::string claimPath;
+        const int intervalMS;
+
+        mutable std::mutex mutex;
+        std::condition_variable stopped;
+        bool stopping;
+        bool held;
+        std::thread toucher;
+    };
+
+    JobSpool(std::string directory);
+
+    /**
+     * Create the state directories.
+     *
+     * @return success code
+     */
+    int create();
+
+    /**
+     * Queue a job, unless a job with the same id is already queued or claimed. A result left by an earlier run of
+     * the job (done/ or failed/) is removed: only the result of this submission is read.
+     *
+     * @return success code
+     */
+    int submit(const Job &job);
+
+    /**
+     * Open the spool before submitting jobs, close it once every job is submitted.
+     *
+     * @return success code
+     */
+    int setClosed(bool closed);
+
+    /**
+     * @return true if no more job will be submitted
+     */
+    bool isClosed() const;
+
+    /**
+     * Take the first queued job (several workers can race for it, only one rename succeeds).
+     *
+     * @return true if a job was claimed
+     */
+    bool claim(Job &job);
+
+    /**
+     * Write the result of a claimed job (done/ or failed/) and release the claim.
+     *
+     * @return success code
+     */
+    int publish(const Job &job, const Result &result);
+
+    /**
+     * Queue again the claimed jobs whose lease expired.
+     *
+     * @return number of queued jobs
+     */
+    int requeueExpired(int leaseMS);
+
+    /**
+     * @param state "queued", "claimed", "done" or "failed"
+     * @return ids of the jobs in that state
+     */
+    std::vector<std::string> list(const std::string &state) const;
+
+    /**
+     * @return result of a done or failed job
+     */
+    int readResult(const std::string &id, Result &result) const;
+
+    const std::string &getDirectory() const;
+
+    /**
+     * @return id of this process, unique across the hosts sharing the spool (<host>.<pid>)
+     */
+    static std::string workerId();
+
+    static const std::string QUEUED;
+    static const std::string CLAIMED;
+    static const std::string DONE;
+    static const std::string FAILED;
+
+private:
+    std::string directory;
+
+    std::string pathFor(const std::string &state, const std::string &fileName) const;
+
+    std::string closedPath() const;
+
+    /**
+     * @return modification time of the file in nanoseconds, or -1 if it does not exist
+     */
+    static long long modifiedNS(const std::string &path);
+
+    /**
+     * @return current time of the file system holding the spool (can differ from the clock of this host)
+     */
+    long long spoolTimeNS() const;
+};
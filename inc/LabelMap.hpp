@@ -11,7 +11,11 @@ class LabelMap {
 public:
     void put(int key, std::string value);
 
-    std::string get(int key);
+    std::string get(int key) const;
+
+    bool has(int key) const;
+
+    bool empty() const;
 
     void clear();
 
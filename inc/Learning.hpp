@@ -5,15 +5,66 @@
 #pragma once
 
 #include <string>
+#include "DataBinFormat.hpp"
 #include "MLPModel.hpp"
 
 int trainMLPModel(cv::Mat &data, cv::Mat &responses,
                   MLPModel &model, const bool noTest = true, std::string testDir = "");
 
+/**
+ * @param useCache Load the training data through its packed cache (see aggregateDataFrom).
+ */
 int trainMLPModel(const std::string dataDir, const std::string testDir,
-                  MLPModel &model, const bool noTest);
+                  MLPModel &model, const bool noTest, const bool useCache = false);
 
-int aggregateDataFrom(std::string directory, cv::Mat &matData, cv::Mat &matResponses);
+/**
+ * Train the model by mini-batches streamed from disk (the training set is never fully loaded in memory).
+ *
+ * @param dataDir Directory of .yml data files, or a packed data set file.
+ * @param batchSize Number of samples per batch.
+ * @param prefetch Number of batches read ahead.
+ * @param nbOfEpochs Number of passes over the training set.
+ */
+int trainMLPModelStreaming(const std::string dataDir, const std::string testDir,
+                           MLPModel &model, const bool noTest,
+                           const int batchSize, const int prefetch, const int nbOfEpochs);
+
+/**
+ * Load a whole data set.
+ *
+ * Packed data stored as uint8 or bits is converted to a whole float matrix here: the smaller storage saves disk
+ * space and streamed training memory (DataBatchStream converts one batch at a time), but in memory training
+ * still takes 4 bytes per value.
+ *
+ * @param directory Directory of .yml data files, or a packed data set file (see data_pack.exe) which is memory-mapped.
+ * @param matData One sample per row (32 bits float).
+ * @param matResponses One integer label per row.
+ * @param nbThreads Number of threads parsing .yml files (0 means one per hardware thread, 1 is the serial loader).
+ * The shuffled sample order does not depend on this value.
+ * @param useCache Reuse (or create) a packed cache of a .yml directory, stored next to it (see cachePathFor).
+ * The cache is only used while the names, sizes and modification times of the directory files are unchanged.
+ * Off by default: the directory parent must be writable.
+ * @param cacheDtype Storage of the cache (see DataBinWriter::write), a cache stored otherwise is rebuilt. With CV_32F,
+ * the data is mapped from the cache, also right after writing it: processes loading the same cache share its pages.
+ * @return success code
+ */
+int aggregateDataFrom(std::string directory, cv::Mat &matData, cv::Mat &matResponses, int nbThreads = 0,
+                      bool useCache = false, uint32_t cacheDtype = DataBin::DTYPE_AUTO);
+
+/**
+ * @param directory Directory of .yml data files
+ * @return the path of the packed cache of the given directory (e.g. "letters_data.cache.sldb")
+ */
+std::string cachePathFor(std::string directory);
+
+/**
+ * Fingerprint a data set from the names, sizes and modification times of its files, without reading them.
+ *
+ * @param directory Directory of .yml data files, or a packed data set file
+ * @param fingerprint Changes whenever a file of the data set is added, removed or rewritten
+ * @return success code (error if the data set can not be listed)
+ */
+int fingerprintData(std::string directory, uint64_t &fingerprint);
 
 int executeTestModel(std::string modelPath, std::string testDir, LabelMap &labelMap);
 
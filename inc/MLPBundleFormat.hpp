@@ -0,0 +1,69 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Binary model bundle (.mlpb): a trained ANN_MLP with what is needed to use it, written by
+ * MLPModel::exportModelTo (or model_convert.exe from an OpenCV model) and read by MLPModel::learnFrom
+ * and MLPInference::load.
+ *
+ * Layout (little endian):
+ *  - Header
+ *  - Layer sizes: nbLayerSizes * int32
+ *  - Feature: featureLength bytes, FeatureSpec string form (empty if unknown)
+ *  - Label table: nbLabels entries of {int32 label, uint32 nameLength, name bytes}
+ *  - Scales, aligned on ALIGNMENT bytes: input scale (2 * input size doubles), output scale and inverse output
+ *    scale (2 * output size doubles each), as (scale, shift) pairs
+ *  - Weights of each layer, each aligned on ALIGNMENT bytes: (inSize + 1) x outSize doubles, one row per input,
+ *    the bias in the last row
+ *
+ * Values are stored as the doubles of cv::ml::ANN_MLP, so that a bundle gives back exactly the same network.
+ * Scales and weights can be used in place once the file is memory-mapped.
+ */
+namespace MLPBundle {
+    const char MAGIC[4] = {'S', 'L', 'M', 'B'};
+    const uint32_t VERSION = 1;
+    const uint64_t ALIGNMENT = 64;
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t activation; // cv::ml::ANN_MLP::ActivationFunctions
+        uint32_t nbLayerSizes;
+        double activationParam1;
+        double activationParam2;
+        double minVal; // Output range of the network, as stored by ANN_MLP
+        double maxVal;
+        double minVal1;
+        double maxVal1;
+        double featureScale; // Factor applied to the feature values before the network
+        uint32_t featureLength;
+        uint32_t nbLabels;
+        uint64_t layerSizesOffset;
+        uint64_t featureOffset;
+        uint64_t labelTableOffset;
+        uint64_t scalesOffset;
+        uint64_t weightsOffset;
+        uint64_t fileSize;
+    };
+
+    inline uint64_t align(uint64_t offset) {
+        return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    inline bool hasMagic(const Header &header) {
+        return std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0;
+    }
+
+    /**
+     * @return size in bytes of the weights of a layer, padded to the alignment of the next one
+     */
+    inline uint64_t layerBytes(uint32_t inSize, uint32_t outSize) {
+        return align(((uint64_t) inSize + 1) * outSize * sizeof(double));
+    }
+}
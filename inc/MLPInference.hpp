@@ -0,0 +1,190 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+
+class ModelBundle;
+
+/**
+ * Forward pass of a trained OpenCV ANN_MLP (SIGMOID_SYM activation), without OpenCV.
+ *
+ * Weights are read from the model saved by MLPModel::exportModelTo and stored as floats in aligned buffers,
+ * one row per input and one (padded) column per neuron. The input scaling and the activation parameters
+ * are folded into the weights at load time. The layers are computed with AVX2/FMA or SSE kernels chosen at
+ * runtime from the CPU features, with a rational approximation of tanh.
+ *
+ * The model can also be quantized to 8 bits integers (weights and activations, see quantize), saved and loaded
+ * back in this form.
+ *
+ * Not thread safe (internal buffers): use one instance per thread.
+ */
+class MLPInference {
+public:
+    enum Isa {
+        SCALAR = 0,
+        SSE = 1,
+        AVX2 = 2
+    };
+
+    MLPInference();
+
+    /**
+     * Load a model saved by OpenCV (cv::ml::ANN_MLP::save), a model bundle (see ModelBundle), or a quantized
+     * model saved by saveQuantized.
+     *
+     * @param xmlFileName Path to the model file.
+     * @return success code (error if the file can not be read or the activation function is not supported)
+     */
+    int load(const std::string xmlFileName);
+
+    /**
+     * Load the network of a model bundle.
+     */
+    int load(const ModelBundle &bundle);
+
+    bool isLoaded() const;
+
+    /**
+     * Quantize the loaded model: weights are stored as 8 bits integers with one scale per neuron, layer inputs
+     * are rounded to 8 bits integers before each layer (the activations between layers are bounded by tanh,
+     * the scale of the model input is calibrated). The scale of each neuron is chosen to minimize the error
+     * of its weights, weighted by the mean square value of the matching input on the calibration data.
+     * Every following prediction uses the quantized model.
+     *
+     * @param calibrationData Samples representative of the model inputs (N x inputSize, CV_32F).
+     * @return success code (error if no float model is loaded)
+     */
+    int quantize(const cv::Mat &calibrationData);
+
+    bool isQuantized() const;
+
+    /**
+     * Save the quantized model (.yml or .xml), to be loaded back with load.
+     *
+     * @return success code
+     */
+    int saveQuantized(const std::string fileName) const;
+
+    /**
+     * @return memory used by the weights of the model, in bytes
+     */
+    size_t getWeightsSize() const;
+
+    /**
+     * Force the instruction set used by the kernels (limited to what the CPU supports).
+     */
+    void setIsa(Isa isa);
+
+    Isa getIsa() const;
+
+    /**
+     * @return best instruction set supported by the CPU
+     */
+    static Isa detectIsa();
+
+    static std::string isaName(Isa isa);
+
+    int getInputSize() const;
+
+    int getOutputSize() const;
+
+    /**
+     * @return number of layers of the float model (0 if only a quantized model is loaded)
+     */
+    int getNbOfLayers() const;
+
+    /**
+     * Folded parameters of a layer of the float model (see load): its output is tanh(bias + input * weights).
+     *
+     * @param index Layer index, from 0 to getNbOfLayers() - 1.
+     * @param weights Receives inSize x outSize values, one row per input.
+     * @param bias Receives outSize values.
+     */
+    void getLayer(int index, std::vector<float> &weights, std::vector<float> &bias) const;
+
+    /**
+     * @return getOutputSize() pairs of (scale, shift) applied to the last activation
+     */
+    const std::vector<float> &getOutputScale() const;
+
+    /**
+     * Predict the result of one sample.
+     *
+     * @param input getInputSize() values.
+     * @param scores If not null, receives the getOutputSize() outputs of the network.
+     * @return A pair: <0> predicted label (index of the largest output), <1> its output value
+     */
+    std::pair<int, float> predict(const float *input, float *scores = nullptr);
+
+    /**
+     * @param input One sample (1 x inputSize, CV_32F).
+     */
+    std::pair<int, float> predict(const cv::Mat &input);
+
+    /**
+     * Same as MLPModel::predictBatch.
+     */
+    void predictBatch(const cv::Mat &input, cv::Mat &labels, cv::Mat &confidences, cv::Mat *scores = nullptr);
+
+private:
+    struct AlignedFree {
+        template<typename T>
+        void operator()(T *p) const {
+            free(p);
+        }
+    };
+
+    typedef std::unique_ptr<float[], AlignedFree> AlignedFloats;
+    typedef std::unique_ptr<int8_t[], AlignedFree> AlignedBytes;
+    typedef std::unique_ptr<int16_t[], AlignedFree> AlignedShorts;
+
+    struct Layer {
+        int inSize;
+        int outSize;
+        int outPadded; // outSize rounded up to a multiple of 8
+        AlignedFloats weights; // inSize rows of outPadded values
+        AlignedFloats bias; // outPadded values
+    };
+
+    struct QuantizedLayer {
+        int inSize;
+        int outSize;
+        int inPadded; // inSize rounded up to a multiple of 16
+        int outPadded; // outSize rounded up to a multiple of 4
+        float inputScale; // input = inputScale * integer input
+        AlignedBytes weights; // outPadded rows of inPadded values
+        std::vector<float> weightScales; // weight = weightScale * integer weight, one per neuron
+        std::vector<float> outputScales; // inputScale * weightScale, outPadded values
+        std::vector<float> bias; // outPadded values
+    };
+
+    std::vector<Layer> layers;
+    std::vector<QuantizedLayer> quantizedLayers;
+    std::vector<float> outputScale; // outSize pairs of (scale, shift) applied to the last activation
+    AlignedFloats buffers[2];
+    AlignedShorts quantizedInput; // input of the current quantized layer, widened to 16 bits
+    Isa isa;
+
+    static const std::string QUANTIZED_NODE;
+
+    template<typename T>
+    static std::unique_ptr<T[], AlignedFree> allocate(size_t count);
+
+    int loadQuantized(const cv::FileNode &root);
+
+    void allocateBuffers();
+
+    void runLayer(const Layer &layer, const float *input, float *output) const;
+
+    void runQuantizedLayer(const QuantizedLayer &layer, const float *input, float *output);
+
+    void forward(const float *input, float *output);
+};
@@ -6,8 +6,13 @@
 
 #include <opencv2/core/mat.hpp>
 #include <ml.h>
+#include "constant.h"
 #include "StatPredict.hpp"
 #include "LabelMap.hpp"
+#include "DataBatchStream.hpp"
+#include "MLPTrainer.hpp"
+
+class ModelBundle;
 
 class MLPModel {
 
@@ -55,6 +60,15 @@ public:
      */
     void setMethodEpsilon(double epsilon);
 
+    /**
+     * Train with the native mini-batch trainer (see MLPTrainer) instead of cv::ml::ANN_MLP::train.
+     * The trained model is the same kind of ANN_MLP network, exported and loaded as any other.
+     *
+     * @param params Optimizer, learning rate, mini-batch size and number of epochs (the streamed training takes
+     * its number of epochs as argument instead).
+     */
+    void setOptimizer(const MLPTrainer::Params &params);
+
     /**
      *
      * @param labelMap
@@ -63,6 +77,22 @@ public:
 
     const LabelMap &getLabelMap() const;
 
+    /**
+     * Describe the input of the model, stored in the model bundles it is exported to.
+     *
+     * The scale follows the convention of model_convert: it is the factor sign_detect applies to the raw feature
+     * values (0..255) before the network, so 1/255 for a network trained on the backprojections saved by
+     * sign_detect, which is also the scaling sign_detect applies to the .xml form of the same network.
+     *
+     * @param feature FeatureSpec string form of the feature the model takes (empty if unknown).
+     * @param featureScale Factor applied to the raw feature values before the model.
+     */
+    void setFeature(const std::string &feature, double featureScale = Default::HAND_INPUT_SCALE);
+
+    const std::string &getFeature() const;
+
+    double getFeatureScale() const;
+
     /**
      * Export the training data distribution to the specified json file.
      * If the model is already trained, exportation is made when the method is called.
@@ -78,11 +108,19 @@ public:
     /**
      * Teach the model from an existing classifier.
      *
-     * @param classifier_file_name Path to the classifier file.
+     * @param classifier_file_name Path to the classifier file: saved by OpenCV, or a model bundle (the label map
+     * and the feature of the bundle replace the ones of this model).
      * @return true if reading succeed, false otherwise.
      */
     int learnFrom(const std::string classifier_file_name);
 
+    /**
+     * Teach the model from the network of a model bundle, with its label map and feature.
+     *
+     * @return success code
+     */
+    int learnFrom(const ModelBundle &bundle);
+
     /**
      * Teach the model from a data set.
      *
@@ -92,6 +130,16 @@ public:
      */
     int learnFrom(const cv::Mat &trainingData, const cv::Mat &trainingResponses);
 
+    /**
+     * Teach the model from a data set streamed by mini-batches, without loading it in memory.
+     * The first batch initializes the network, every other batch updates its weights.
+     *
+     * @param stream Opened stream over the training data set.
+     * @param nbOfEpochs Number of passes over the whole data set.
+     * @return success code
+     */
+    int learnFrom(DataBatchStream &stream, const int nbOfEpochs);
+
     /**
      * Use the current model to predict a result using the given data.
      *
@@ -100,6 +148,18 @@ public:
      */
     std::pair<int, float> predict(cv::Mat &input);
 
+    /**
+     * Use the current model to predict the results of a whole set of samples at once.
+     * Outputs are reallocated only if their size or type differ, so they can be reused from one call to the next.
+     * Like predict, safe to call from several threads sharing the model (the scratch buffers are per thread).
+     *
+     * @param input Data to use for prediction, one sample per row (N x inputSize, CV_32F)
+     * @param labels Predicted label of each sample (N x 1, CV_32S)
+     * @param confidences Output of the network for the predicted label of each sample (N x 1, CV_32F)
+     * @param scores If not null, full output of the network (N x outputSize, CV_32F)
+     */
+    void predictBatch(const cv::Mat &input, cv::Mat &labels, cv::Mat &confidences, cv::Mat *scores = nullptr);
+
     /**
      * Test the given data set on the current model.
      *
@@ -110,10 +170,24 @@ public:
      */
     std::pair<double, std::map<int, StatPredict *>> testOn(const cv::Mat &testData, const cv::Mat &testResponses);
 
+    /**
+     * Build the test result of already computed predictions (see testOn and predictBatch).
+     *
+     * @param testResponses Expected label of each sample.
+     * @param predictions Predicted label of each sample.
+     * @param trusts Output of the network for the predicted label of each sample.
+     * @param outputs Full output of the network for each sample.
+     * @return Same as testOn
+     */
+    static std::pair<double, std::map<int, StatPredict *>>
+    collectStats(const cv::Mat &testResponses, const cv::Mat &predictions, const cv::Mat &trusts,
+                 const cv::Mat &outputs);
+
     /**
      * Export the current model to a file.
      *
-     * @param xmlFileName Path to the file where to export the data model as xml.
+     * @param xmlFileName Path to the file where to export the data model as xml, or as a model bundle (see
+     * ModelBundle) if it ends with Default::MODEL_BUNDLE_EXT.
      * @return success code
      */
     int exportModelTo(const std::string xmlFileName);
@@ -123,6 +197,16 @@ public:
      */
     std::string getTopologyStr();
 
+    int getInputSize() const;
+
+    int getOutputSize() const;
+
+    /**
+     * @return number of weights (bias included) of this topology for the given input and output sizes,
+     * usable as an estimate of the training cost per sample
+     */
+    long estimateNbOfWeights(int nbInputs, int nbOutputClasses) const;
+
     /**
      * Return the string representation of the given label
      * @param label Label used in this model
@@ -137,6 +221,9 @@ private:
 
     cv::Ptr<cv::ml::ANN_MLP> model;
 
+    std::string feature;
+    double featureScale = Default::HAND_INPUT_SCALE;
+
     std::map<int, int> classesCountMap;
     std::string jsonDistribFilePath;
     LabelMap labelMap;
@@ -145,6 +232,34 @@ private:
     double methodEpsilon = 0.001;
     int maxIter = 128;
 
+    bool nativeTraining = false;
+    MLPTrainer::Params trainerParams;
+
     inline cv::TermCriteria TC(int iters, double eps);
+
+    void formatResponses(const cv::Mat &responses, const int nbOutputClasses, cv::Mat &formattedResponses);
+
+    void countClasses(const cv::Mat &responses);
+
+    void logTrainingComposition();
+
+    /**
+     * @return input size, hidden layer sizes, then output size
+     */
+    std::vector<int> layerSizesFor(const int nbInputs, const int nbOutputClasses) const;
+
+    void createModel(const int nbInputs, const int nbOutputClasses);
+
+    /**
+     * Load the network trained by the native trainer into the ANN_MLP model.
+     */
+    int loadTrainedNetwork(const MLPTrainer &trainer);
+
+    /**
+     * Update the topology from the layer sizes of the loaded network.
+     */
+    void readLayerSizes();
+
+    int toBundle(ModelBundle &bundle) const;
 };
 
@@ -0,0 +1,132 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+#include "constant.h"
+
+class ModelBundle;
+
+/**
+ * Mini-batch trainer for the networks of cv::ml::ANN_MLP (SIGMOID_SYM activation, same input and output scaling),
+ * minimizing the same squared error as ANN_MLP BACKPROP with SGD, momentum or Adam.
+ *
+ * Forward and backward passes are matrix products (cv::gemm) on fixed-size shards of each mini-batch, run in
+ * parallel with cv::parallel_for_ (so the thread count is the one set by cv::setNumThreads). The shard gradients
+ * are summed in shard order: for a given seed, the trained weights do not depend on the number of threads.
+ */
+class MLPTrainer {
+public:
+    enum Optimizer {
+        SGD, MOMENTUM, ADAM
+    };
+
+    struct Params {
+        Optimizer optimizer = ADAM;
+        double learningRate = Default::TRAINER_LEARNING_RATE;
+        double momentum = 0.9; // MOMENTUM
+        double beta1 = 0.9; // ADAM
+        double beta2 = 0.999; // ADAM
+        double epsilon = 1e-8; // ADAM
+        int batchSize = Default::TRAINER_BATCH_SIZE;
+        int nbOfEpochs = Default::NB_OF_EPOCHS;
+        unsigned int seed = 0; // Initial weights and sample order
+    };
+
+    struct Stats {
+        double loss = 0; // Mean squared error per sample
+        int nbOfSamples = 0;
+        int nbOfSuccesses = 0; // Samples whose label is the highest output
+    };
+
+    /**
+     * @param name "sgd", "momentum" or "adam"
+     * @return success code (error if the name is unknown)
+     */
+    static int parseOptimizer(const std::string &name, Optimizer &optimizer);
+
+    static std::string optimizerName(Optimizer optimizer);
+
+    /**
+     * @param layerSizes Input size, hidden layer sizes, then output size
+     */
+    MLPTrainer(const std::vector<int> &layerSizes, const Params &params);
+
+    /**
+     * Compute the input and output scaling from the data (as ANN_MLP does on its first training), and draw the
+     * initial weights.
+     *
+     * @param data One sample per row (32 bits float)
+     * @param responses One label per row, the index of the output expected to be the highest
+     */
+    void initialize(const cv::Mat &data, const cv::Mat &responses);
+
+    /**
+     * One pass over the data, in a random order drawn from the seed and the epoch.
+     */
+    Stats trainEpoch(const cv::Mat &data, const cv::Mat &responses, int epoch);
+
+    /**
+     * One pass over the data, in the order of the rows (e.g. a streamed batch, already shuffled).
+     */
+    Stats trainOn(const cv::Mat &data, const cv::Mat &responses);
+
+    /**
+     * Write the trained network, in the form saved by ANN_MLP (the metadata of the bundle is left as is).
+     */
+    void toBundle(ModelBundle &bundle) const;
+
+    const Params &getParams() const;
+
+private:
+    // Rows of a mini-batch handled by one task: fixed, so that the reduction order does not depend on threads
+    static const int SHARD_SIZE = 32;
+
+    // Activation of ANN_MLP SIGMOID_SYM: f(s) = beta * tanh(alpha / 2 * s), with the default parameters
+    static constexpr double ALPHA = 2. / 3;
+    static constexpr double BETA = 1.7159;
+
+    // Targets range of ANN_MLP SIGMOID_SYM
+    static constexpr double MAX_VAL = 0.95;
+    static constexpr double MAX_VAL1 = 0.98;
+
+    struct Shard {
+        std::vector<cv::Mat> activations; // Input (scaled) then output of each layer, SHARD_SIZE rows each
+        std::vector<cv::Mat> deltas; // Error gradient at the output of each layer, before activation
+        std::vector<cv::Mat> gradients; // Same shape as the weights
+        Stats stats;
+    };
+
+    const std::vector<int> layerSizes;
+    const Params params;
+
+    std::vector<double> inputScale; // (scale, shift) per input
+    std::vector<double> outputScale; // (scale, shift) per output: network output to response
+    std::vector<double> invOutputScale; // (scale, shift) per output: response to network target
+
+    std::vector<cv::Mat> weights; // One (inSize + 1) x outSize CV_32F matrix per layer, the bias in the last row
+    std::vector<cv::Mat> velocities; // MOMENTUM, or ADAM first moments
+    std::vector<cv::Mat> squares; // ADAM second moments
+    long nbOfSteps = 0;
+
+    std::vector<Shard> shards;
+
+    /**
+     * Mini-batch gradient step on the given rows.
+     */
+    void step(const cv::Mat &data, const cv::Mat &responses, const std::vector<int> &order, size_t begin,
+              size_t end, Stats &stats);
+
+    /**
+     * Forward and backward pass of the given rows of the data, gradients summed over them in the shard.
+     */
+    void computeShard(Shard &shard, const cv::Mat &data, const cv::Mat &responses, const int *rows, int count);
+
+    void applyGradients(const std::vector<cv::Mat> &gradients, int batchSize);
+
+    Shard &shardAt(size_t index);
+};
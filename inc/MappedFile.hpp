@@ -0,0 +1,57 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <opencv2/core/mat.hpp>
+
+class MappedFile {
+public:
+    MappedFile(std::string filePath);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /**
+     * Map the whole file in memory (private copy-on-write mapping, the file is never modified).
+     *
+     * @param prefetch Ask the kernel to read the whole file ahead. Disable it for random accesses to a small part
+     * of a large file.
+     * @return success code
+     */
+    int open(bool prefetch = true);
+
+    void close();
+
+    bool isOpened() const;
+
+    const unsigned char *data() const;
+
+    size_t size() const;
+
+    const std::string &getFilePath() const;
+
+    /**
+     * Create a matrix header pointing directly into the mapped memory (no copy).
+     * The returned matrix keeps the mapping alive until it (and all its copies) are released.
+     *
+     * @param file Mapped file holding the data.
+     * @param offset Offset in bytes of the first element in the file.
+     * @param rows Number of rows of the matrix.
+     * @param cols Number of columns of the matrix.
+     * @param type OpenCV type of the elements (e.g. CV_32FC1).
+     * @return a matrix sharing the mapped memory
+     */
+    static cv::Mat wrap(const std::shared_ptr<MappedFile> &file, size_t offset, int rows, int cols, int type);
+
+private:
+    std::string filePath;
+    unsigned char *mapped;
+    size_t mappedSize;
+};
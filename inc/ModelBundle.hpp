@@ -0,0 +1,93 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cv.hpp>
+#include <ml.h>
+#include "LabelMap.hpp"
+#include "MappedFile.hpp"
+#include "MLPBundleFormat.hpp"
+
+/**
+ * A trained ANN_MLP network with its metadata: the feature it takes as input, the scaling of the feature values
+ * and the names of its labels. Read from and written to a binary bundle (see MLPBundleFormat.hpp), or read from
+ * the node of a model saved by OpenCV.
+ */
+class ModelBundle {
+public:
+    // Network, as stored by cv::ml::ANN_MLP
+    std::vector<int> layerSizes;
+    int activation = cv::ml::ANN_MLP::SIGMOID_SYM;
+    double activationParam1 = 0;
+    double activationParam2 = 0;
+    double minVal = 0;
+    double maxVal = 0;
+    double minVal1 = 0;
+    double maxVal1 = 0;
+    cv::Mat inputScale; // 1 x (2 * input size), CV_64F
+    cv::Mat outputScale; // 1 x (2 * output size), CV_64F
+    cv::Mat invOutputScale; // 1 x (2 * output size), CV_64F
+    std::vector<cv::Mat> weights; // One (inSize + 1) x outSize CV_64F matrix per layer, the bias in the last row
+
+    // Metadata
+    std::string feature; // FeatureSpec string form, empty if unknown
+    double featureScale = 1;
+    LabelMap labelMap;
+
+    /**
+     * @return true if the given path is a regular file starting with a model bundle header
+     */
+    static bool isBundleFile(const std::string &filePath);
+
+    /**
+     * Map a bundle in memory: the scales and weights point directly into the mapping (no parsing, no copy).
+     *
+     * @return success code
+     */
+    int load(const std::string &filePath);
+
+    /**
+     * Write the bundle. The file is written next to its final location then renamed, so a reader (e.g. the model
+     * reload of sign_detect) never sees a partial file.
+     *
+     * @return success code
+     */
+    int save(const std::string &filePath) const;
+
+    /**
+     * Read the network from the node of a model saved by OpenCV (cv::ml::ANN_MLP::save), metadata is left as is.
+     *
+     * @return success code (error if the node is not a valid ANN_MLP)
+     */
+    int readNetwork(const cv::FileNode &node);
+
+    /**
+     * Write the network as cv::ml::ANN_MLP::save does, to be read back by cv::ml::ANN_MLP::read.
+     */
+    void writeNetwork(cv::FileStorage &fs) const;
+
+    int getInputSize() const;
+
+    int getOutputSize() const;
+
+    static std::string activationName(int activation);
+
+private:
+    // Keeps the mapped scales and weights valid
+    std::shared_ptr<MappedFile> file;
+
+    /**
+     * @return true if the scales and weights match the layer sizes
+     */
+    bool isConsistent() const;
+
+    /**
+     * @return size in bytes of the input, output and inverse output scales
+     */
+    uint64_t scalesBytes() const;
+};
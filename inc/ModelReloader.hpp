@@ -0,0 +1,167 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "log.h"
+
+/**
+ * Watch a model file and load it again on a background thread each time it changes (polling of its size and
+ * modification time, a change is loaded once the file stays the same for a whole poll period).
+ *
+ * The frame loop picks the new model up with update, which only reads an atomic counter when nothing changed:
+ * loading never stalls the caller. If the new file fails to load, the current model is kept.
+ */
+template<typename Model>
+class ModelReloader {
+public:
+    /**
+     * @return the loaded model, or nullptr if the file could not be loaded
+     */
+    typedef std::function<std::shared_ptr<Model>(const std::string &)> Loader;
+
+    /**
+     * @param path Model file to watch.
+     * @param loader Function loading the file (called from the background thread).
+     * @param pollMS Delay between two checks of the file.
+     */
+    ModelReloader(std::string path, Loader loader, int pollMS)
+            : path(path), loader(loader), pollMS(pollMS > 0 ? pollMS : 1), generation(0), nbOfReloads(0),
+              nbOfFailures(0), stopping(false) {}
+
+    ~ModelReloader() {
+        stop();
+    }
+
+    /**
+     * Start watching: the file as it is now is considered as already loaded.
+     */
+    void start() {
+        stop();
+        stopping = false;
+        watcher = std::thread(&ModelReloader::watch, this, fileStamp(path));
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        if (watcher.joinable()) {
+            watcher.join();
+        }
+    }
+
+    /**
+     * Called between two frames: replace the given model with the last loaded one, if any.
+     * The replaced model is released by the background thread.
+     *
+     * @return true if the model has been replaced
+     */
+    bool update(std::shared_ptr<Model> &model) {
+        long current = generation.load(std::memory_order_acquire);
+        if (current == seenGeneration) {
+            return false;
+        }
+        seenGeneration = current;
+
+        std::shared_ptr<Model> loaded = std::atomic_load(&latest);
+        if (!loaded || loaded == model) {
+            return false;
+        }
+        std::atomic_store(&retired, model);
+        model = loaded;
+        return true;
+    }
+
+    long getNbOfReloads() const {
+        return nbOfReloads;
+    }
+
+    long getNbOfFailures() const {
+        return nbOfFailures;
+    }
+
+private:
+    struct FileStamp {
+        long long size = -1;
+        long long modifiedNS = -1;
+
+        bool operator==(const FileStamp &other) const {
+            return size == other.size && modifiedNS == other.modifiedNS;
+        }
+
+        bool operator!=(const FileStamp &other) const {
+            return !(*this == other);
+        }
+    };
+
+    const std::string path;
+    const Loader loader;
+    const int pollMS;
+
+    // Written by the watcher thread, read by update
+    std::shared_ptr<Model> latest;
+    std::atomic<long> generation;
+    // Only used by the thread calling update
+    long seenGeneration = 0;
+    // Model replaced by update, released by the watcher thread
+    std::shared_ptr<Model> retired;
+
+    std::atomic<long> nbOfReloads;
+    std::atomic<long> nbOfFailures;
+
+    std::thread watcher;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping;
+
+    static FileStamp fileStamp(const std::string &filePath) {
+        FileStamp stamp;
+        struct stat st;
+        if (stat(filePath.c_str(), &st) == 0) {
+            stamp.size = (long long) st.st_size;
+            stamp.modifiedNS = (long long) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        }
+        return stamp;
+    }
+
+    void watch(FileStamp loadedStamp) {
+        FileStamp previous = loadedStamp;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wakeUp.wait_for(lock, std::chrono::milliseconds(pollMS), [this] { return stopping; })) {
+            lock.unlock();
+            std::atomic_store(&retired, std::shared_ptr<Model>());
+
+            FileStamp stamp = fileStamp(path);
+            // Only load a file that is not being written anymore
+            if (stamp.size >= 0 && stamp != loadedStamp && stamp == previous) {
+                loadedStamp = stamp;
+                std::shared_ptr<Model> model = loader(path);
+                if (model) {
+                    std::atomic_store(&latest, model);
+                    generation.fetch_add(1, std::memory_order_release);
+                    nbOfReloads++;
+                    LOG_I("Model reloaded: " << path);
+                } else {
+                    nbOfFailures++;
+                    LOG_E("ERROR: Could not reload " << path << ", keeping the current model");
+                }
+            }
+            previous = stamp;
+
+            lock.lock();
+        }
+    }
+};
@@ -6,6 +6,7 @@
 
 #include <string>
 #include <vector>
+#include "constant.h"
 
 class MultiConfig {
 public:
@@ -28,5 +29,24 @@ public:
     std::vector<std::string> names;
     std::vector<std::string> types;
     std::vector<std::string> topologies;
+
+    // Optional: train by mini-batches streamed from disk when batchSize > 0
+    int batchSize;
+    int prefetch;
+    int epochs;
+
+    // Optional: number of threads shared by the training jobs (0: every hardware thread)
+    int threads;
+
+    // Optional: memory budget of the data sets loaded at the same time and of their training copies (0: no limit)
+    int maxMemoryMB;
+
+    // Optional: load the .yml data sets through a packed cache written next to them (see aggregateDataFrom)
+    bool cache;
+
+    // Optional: train with the native trainer and this optimizer (see MLPTrainer), empty for the OpenCV training
+    std::string optimizer;
+    double learningRate;
+    int miniBatch;
 };
 
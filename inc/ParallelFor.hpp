@@ -0,0 +1,79 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @param nbThreads Requested number of threads (0 or less means one per hardware thread)
+ * @return the number of threads to actually use (at least 1)
+ */
+int resolveThreadCount(int nbThreads);
+
+/**
+ * Pool of worker threads kept alive between parallel loops, for callers that run many short loops
+ * (e.g. one per mini-batch). Not thread safe: one loop runs at a time.
+ */
+class WorkerPool {
+public:
+    /**
+     * @param nbThreads Number of threads of a loop, the calling thread included (see resolveThreadCount).
+     */
+    explicit WorkerPool(int nbThreads);
+
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    /**
+     * Call the given function for every index in [0, count), on the pool threads and the calling thread.
+     * Indexes are handed out dynamically, so slow items do not stall a whole worker share.
+     * An exception thrown for an index does not stop the other indexes: once every index has been processed,
+     * the first exception caught is rethrown.
+     *
+     * @param fn Function called with (index, worker id in [0, nbThreads)).
+     */
+    void run(size_t count, const std::function<void(size_t, int)> &fn);
+
+    int getNbOfThreads() const;
+
+private:
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+    bool stopping = false;
+    long generation = 0; // Incremented by each loop
+    int nbOfRunning = 0; // Pool threads still working on the current loop
+
+    const std::function<void(size_t, int)> *fn = nullptr;
+    size_t count = 0;
+    std::atomic<size_t> next;
+    std::exception_ptr error;
+
+    void loop(int worker);
+
+    void work(int worker);
+};
+
+/**
+ * Call the given function for every index in [0, count) using a pool of worker threads created for this call
+ * (see WorkerPool::run). Returns once every index has been processed.
+ *
+ * @param count Number of indexes to process.
+ * @param nbThreads Number of worker threads (see resolveThreadCount).
+ * @param fn Function called with (index, worker id in [0, nbThreads)).
+ */
+void parallelFor(size_t count, int nbThreads, const std::function<void(size_t, int)> &fn);
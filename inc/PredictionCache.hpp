@@ -0,0 +1,108 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/**
+ * Memoization of the predictions of a model for binary-like inputs (e.g. the thresholded hand backprojection):
+ * each input value is thresholded to one bit, and the resulting key (up to 256 values) is looked up in a
+ * fixed-size hash table before running the model.
+ *
+ * Inputs with the same key share their prediction, the cache is only exact for inputs that are already binary.
+ * Lookups and insertions are lock-free (each slot is a seqlock): a slot being written is a miss, and an insertion
+ * racing with another one on the same slot is dropped.
+ */
+class PredictionCache {
+public:
+    static const int KEY_WORDS = 4;
+    static const int MAX_INPUT_SIZE = KEY_WORDS * 64;
+
+    struct Key {
+        uint64_t words[KEY_WORDS];
+    };
+
+    /**
+     * @param capacity Number of slots, rounded up to a power of two.
+     * @param threshold Input values above it are set bits of the key.
+     */
+    PredictionCache(size_t capacity, float threshold = 0.5f);
+
+    /**
+     * @return false if the input is too large to be cached (more than MAX_INPUT_SIZE values)
+     */
+    bool makeKey(const float *input, int size, Key &key) const;
+
+    /**
+     * @return true and the cached prediction if the key is in the cache
+     */
+    bool find(const Key &key, std::pair<int, float> &prediction) const;
+
+    void insert(const Key &key, const std::pair<int, float> &prediction);
+
+    /**
+     * Return the cached prediction of the input, or compute it with predictFn() and cache it.
+     */
+    template<typename PredictFn>
+    std::pair<int, float> predict(const float *input, int size, PredictFn predictFn) {
+        Key key;
+        if (!makeKey(input, size, key)) {
+            return predictFn();
+        }
+        std::pair<int, float> prediction;
+        if (find(key, prediction)) {
+            nbOfHits.fetch_add(1, std::memory_order_relaxed);
+            return prediction;
+        }
+        nbOfMisses.fetch_add(1, std::memory_order_relaxed);
+        prediction = predictFn();
+        insert(key, prediction);
+        return prediction;
+    }
+
+    /**
+     * Forget every cached prediction (e.g. when the model changes), counters are kept. An insertion running at
+     * the same time may survive it.
+     */
+    void clear();
+
+    size_t getCapacity() const;
+
+    long getNbOfHits() const;
+
+    long getNbOfMisses() const;
+
+    void logStats() const;
+
+private:
+    // Slots probed for a key, starting at its hash
+    static const int NB_OF_PROBES = 4;
+    static const uint64_t EMPTY_VALUE = ~(uint64_t) 0;
+
+    struct Slot {
+        // Even when stable, odd while being written, only grows
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint64_t> key[KEY_WORDS];
+        // Label in the low 32 bits, confidence (float bits) in the high ones, EMPTY_VALUE when empty
+        std::atomic<uint64_t> value;
+    };
+
+    const size_t capacity;
+    const float threshold;
+    std::unique_ptr<Slot[]> slots;
+
+    std::atomic<long> nbOfHits;
+    std::atomic<long> nbOfMisses;
+
+    static uint64_t hash(const Key &key);
+
+    /**
+     * Write a slot, unless another thread is writing it.
+     */
+    static void write(Slot &slot, const uint64_t *key, uint64_t value);
+};
@@ -0,0 +1,36 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <algorithm>
+
+/*
+ * tanh(x) ~= p(x) / q(x) on [-CLAMP, CLAMP], odd polynomial of degree 13 over even polynomial of degree 6
+ * (maximum error close to the float precision), +/-1 outside.
+ * Branch free: loops over this function are vectorized by the compiler.
+ */
+namespace TanhApprox {
+    constexpr float CLAMP = 7.90531110763549805f;
+    constexpr float A1 = 4.89352455891786e-03f;
+    constexpr float A3 = 6.37261928875436e-04f;
+    constexpr float A5 = 1.48572235717979e-05f;
+    constexpr float A7 = 5.12229709037114e-08f;
+    constexpr float A9 = -8.60467152213735e-11f;
+    constexpr float A11 = 2.00018790482477e-13f;
+    constexpr float A13 = -2.76076847742355e-16f;
+    constexpr float B0 = 4.89352518554385e-03f;
+    constexpr float B2 = 2.26843463243900e-03f;
+    constexpr float B4 = 1.18534705686654e-04f;
+    constexpr float B6 = 1.19825839466702e-06f;
+}
+
+inline float tanhApprox(float x) {
+    using namespace TanhApprox;
+    x = std::min(CLAMP, std::max(-CLAMP, x));
+    float x2 = x * x;
+    float p = ((((((A13 * x2 + A11) * x2 + A9) * x2 + A7) * x2 + A5) * x2 + A3) * x2 + A1) * x;
+    float q = ((B6 * x2 + B4) * x2 + B2) * x2 + B0;
+    return p / q;
+}
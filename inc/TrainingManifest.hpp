@@ -0,0 +1,74 @@
+//
+// @author Loris Friedel
+//
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Record of the models trained by multi_learning: job hash -> model path, training time and checksum of the
+ * model file. Stored as a text file in the model directory, rewritten after every finished job so that an
+ * interrupted run can skip them when restarted.
+ * Thread-safe.
+ */
+class TrainingManifest {
+public:
+    struct Entry {
+        std::string modelPath;
+        double trainSeconds = 0;
+        uint32_t checksum = 0;
+    };
+
+    /**
+     * @param filePath Path of the manifest file.
+     */
+    TrainingManifest(std::string filePath);
+
+    /**
+     * Load the manifest. A missing manifest gives an empty manifest.
+     *
+     * @return success code (error only if the file exists but is corrupted)
+     */
+    int load();
+
+    /**
+     * @return true if the job is recorded and its model file is still the one written by that job
+     */
+    bool isDone(uint64_t jobHash) const;
+
+    /**
+     * Record a finished job (the checksum of its model file is computed here) and write the manifest.
+     *
+     * @return success code
+     */
+    int record(uint64_t jobHash, const std::string &modelPath, double trainSeconds);
+
+    size_t size() const;
+
+    /**
+     * Remove the temporary files left in a directory by an interrupted export (<file>.tmp.<pid>...).
+     * A file is only removed once its writer is gone: its pid is not a process of this host, and it was not
+     * modified for minAgeMS (writers on other hosts sharing the directory).
+     *
+     * @param minAgeMS Age under which a temporary file may still be written
+     * @return number of removed files
+     */
+    static int removePartialOutputs(const std::string &directory, int minAgeMS);
+
+    /**
+     * @return CRC-32 of the file content, or error if it can not be read
+     */
+    static int checksum(const std::string &filePath, uint32_t &crc);
+
+private:
+    const std::string filePath;
+
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, Entry> entries;
+
+    int save() const;
+};
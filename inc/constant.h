@@ -22,6 +22,16 @@ namespace Default {
 
     const std::string KEY_MAP = "map";
 
+    const std::string MODEL_BUNDLE_EXT = ".mlpb";
+    const std::string QUANTIZED_MODEL_SUFFIX = "_int8.yml"; // Default name of the models written by quantize_model
+
+    const std::string DATA_YML_EXT = ".yml";
+    const std::string DATA_BIN_EXT = ".sldb";
+    const std::string DATA_CACHE_EXT = ".cache" + DATA_BIN_EXT;
+    const std::string MANIFEST_EXT = ".manifest";
+    const std::string TMP_FILE_INFIX = ".tmp."; // <file>.tmp.<pid>: written then renamed to <file>
+    const std::string TRAINING_MANIFEST_NAME = "multi_learning" + MANIFEST_EXT;
+
     const std::string KEY_LETTER = "letter";
     const std::string KEY_MAT = "mat";
 
@@ -29,8 +39,31 @@ namespace Default {
     const int NB_OF_NEURON = 128;
     const std::string TOPOLOGY = "32 32";
 
+    const int BATCH_SIZE = 0; // 0: whole data set in memory
+    const int PREFETCH_BATCHES = 4;
+    const int NB_OF_EPOCHS = 16;
+    const int TRAINER_BATCH_SIZE = 64; // native trainer (see MLPTrainer): samples per gradient step
+    const double TRAINER_LEARNING_RATE = 0.001;
+
+    const int SAVE_BURST_SIZE = 1;
+    const int SAVE_QUEUE_SIZE = 32;
+
+    const int SPOOL_LEASE_MS = 120000; // multi_learning: a claimed job not renewed for this long is queued again
+    const int SPOOL_POLL_MS = 2000; // multi_learning: delay between two checks of the spool directory
+    const int SPOOL_MAX_MISSES = 5; // multi_learning: polls after which a job neither pending nor readable has failed
+
+    const int MODEL_RELOAD_MS = 1000; // sign_detect: delay between two checks of the model file
+
+    const int HAND_INPUT_SIZE = 16; // sign_detect hand input: backprojection resized to 16 x 16
+    const double HAND_INPUT_SCALE = 1.0 / 255; // sign_detect hand input: values scaled to [0, 1] for models without metadata
+
     const int HOG_IMG_SIZE = 256;
     const int HOG_BLOCK_SIZE = 32;
     const int HOG_BLOCK_STRIDE_SIZE = 16;
     const int HOG_CELL_SIZE = 8;
+
+    const std::string FEATURE_HOG = "HOG=hog:256:32:16:8";
+    const std::string FEATURE_HOG_SMALL = "HOG_small=hog:48:32:16:8";
+    const std::string FEATURE_BACKPROJ = "backproj=resize:16"; // Backprojections saved by sign_detect
+    const std::string FEATURE_GRAY = "gray=resize:16"; // Grayscale pixels of the images compiled by dataset_compile
 }
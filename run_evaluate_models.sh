@@ -0,0 +1,9 @@
+#!/bin/sh
+
+BIN_PATH=./build/bin
+
+if [ ! -f $BIN_PATH/evaluate_models.exe ]; then
+    ./build.sh
+fi
+
+$BIN_PATH/evaluate_models.exe "$@"
@@ -0,0 +1,9 @@
+#!/bin/sh
+
+BIN_PATH=./build/bin
+
+if [ ! -f $BIN_PATH/quantize_model.exe ]; then
+    ./build.sh
+fi
+
+$BIN_PATH/quantize_model.exe "$@"
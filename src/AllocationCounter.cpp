@@ -0,0 +1,82 @@
+//
+// @author Loris Friedel
+//
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include "../inc/AllocationCounter.hpp"
+
+#ifdef __GLIBC__
+
+// The allocation functions of glibc are replaced by counting ones that forward to its implementation
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+}
+
+namespace {
+    std::atomic<long> allocationCount(0);
+}
+
+extern "C" {
+void *malloc(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void *result = __libc_memalign(alignment, size);
+    if (result == nullptr) {
+        return ENOMEM;
+    }
+    *ptr = result;
+    return 0;
+}
+}
+
+bool AllocationCounter::isAvailable() {
+    return true;
+}
+
+long AllocationCounter::getCount() {
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool AllocationCounter::isAvailable() {
+    return false;
+}
+
+long AllocationCounter::getCount() {
+    return -1;
+}
+
+#endif
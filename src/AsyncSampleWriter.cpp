@@ -0,0 +1,101 @@
+//
+// @author Loris Friedel
+//
+
+#include "../inc/AsyncSampleWriter.hpp"
+#include "../inc/DataYmlWriter.hpp"
+#include "../inc/Timer.hpp"
+#include "../inc/code.h"
+#include "../inc/log.h"
+
+AsyncSampleWriter::AsyncSampleWriter(size_t capacity, std::string captureLogDir)
+        : queue(capacity), nbOfSubmitted(0), nbOfWritten(0), nbOfDropped(0), nbOfFailed(0), writeNS(0) {
+    if (!captureLogDir.empty()) {
+        captureLog.reset(new CaptureLogWriter(captureLogDir));
+    }
+}
+
+AsyncSampleWriter::~AsyncSampleWriter() {
+    stop();
+}
+
+void AsyncSampleWriter::start() {
+    stop();
+    queue.reset();
+    writer = std::thread(&AsyncSampleWriter::run, this);
+}
+
+void AsyncSampleWriter::stop() {
+    queue.close();
+    if (writer.joinable()) {
+        writer.join();
+    }
+    if (captureLog) {
+        captureLog->close();
+    }
+}
+
+bool AsyncSampleWriter::submit(Sample sample) {
+    nbOfSubmitted++;
+    if (!queue.tryPush(std::move(sample))) {
+        nbOfDropped++;
+        return false;
+    }
+    return true;
+}
+
+void AsyncSampleWriter::run() {
+    Timer timer;
+    Sample sample;
+    while (queue.pop(sample)) {
+        timer.start();
+        bool written;
+        if (captureLog) {
+            std::vector<uchar> encodedImage;
+            if (!sample.image.empty()) {
+                cv::imencode(".png", sample.image, encodedImage);
+            }
+            written = captureLog->append(sample.letter, sample.timestamp, sample.data, encodedImage) == Code::SUCCESS;
+        } else {
+            written = cv::imwrite(sample.imagePath, sample.image);
+            if (!written) {
+                LOG_E("ERROR: Could not write image " << sample.imagePath);
+            }
+
+            DataYmlWriter dataWriter(sample.dataPath);
+            written = dataWriter.writeLetter(sample.data, sample.letter) && written;
+        }
+        timer.stop();
+
+        writeNS += (long) timer.getDurationNS();
+        if (written) {
+            nbOfWritten++;
+        } else {
+            nbOfFailed++;
+        }
+    }
+}
+
+long AsyncSampleWriter::getNbOfSubmitted() const {
+    return nbOfSubmitted;
+}
+
+long AsyncSampleWriter::getNbOfWritten() const {
+    return nbOfWritten;
+}
+
+long AsyncSampleWriter::getNbOfDropped() const {
+    return nbOfDropped;
+}
+
+long AsyncSampleWriter::getNbOfFailed() const {
+    return nbOfFailed;
+}
+
+void AsyncSampleWriter::logStats() const {
+    long processed = nbOfWritten + nbOfFailed;
+    double averageMS = processed > 0 ? writeNS / 1e6 / processed : 0;
+    LOG_I("Saved samples: " << nbOfWritten << " written, " << nbOfDropped << " dropped (queue full), "
+                            << nbOfFailed << " failed, out of " << nbOfSubmitted << " ("
+                            << averageMS << " ms per write)");
+}
@@ -0,0 +1,99 @@
+//
+// @author Loris Friedel
+//
+
+#include <cstring>
+#include <fstream>
+#include "../inc/CaptureLogReader.hpp"
+#include "../inc/CaptureLogFormat.hpp"
+#include "../inc/Crc32.hpp"
+#include "../inc/DirectoryReader.hpp"
+#include "../inc/code.h"
+#include "../inc/log.h"
+
+CaptureLogReader::CaptureLogReader(std::string segmentPath)
+        : segmentPath(segmentPath), truncated(false), nbOfRecords(0) {}
+
+std::vector<std::string> CaptureLogReader::listSegments(const std::string &directory) {
+    const std::string prefix = CaptureLog::SEGMENT_PREFIX;
+    const std::string ext = CaptureLog::SEGMENT_EXT;
+
+    // Listed sorted by path, segment names start with their creation time
+    std::vector<std::string> pathList;
+    DirectoryReader dirReader(directory);
+    dirReader.setExtensions({ext});
+    dirReader.foreachFile([&](std::string filePath, std::string fileName) {
+        if (fileName.compare(0, prefix.size(), prefix) == 0) {
+            pathList.push_back(filePath);
+        }
+    });
+    return pathList;
+}
+
+int CaptureLogReader::foreachRecord(const std::function<void(const Record &)> &callback) {
+    truncated = false;
+    nbOfRecords = 0;
+
+    std::ifstream in(segmentPath, std::ifstream::binary);
+    CaptureLog::SegmentHeader segmentHeader;
+    if (!in.read(reinterpret_cast<char *>(&segmentHeader), sizeof(segmentHeader))
+        || !CaptureLog::hasMagic(segmentHeader) || segmentHeader.version != CaptureLog::VERSION) {
+        LOG_E("ERROR: Not a capture segment (or unsupported version): " << segmentPath);
+        return Code::ERROR;
+    }
+
+    std::vector<char> payload;
+    CaptureLog::RecordHeader header;
+    while (in.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+        if (header.magic != CaptureLog::RECORD_MAGIC || header.payloadSize < sizeof(CaptureLog::RecordInfo)) {
+            truncated = true;
+            break;
+        }
+
+        payload.resize(header.payloadSize);
+        if (!in.read(payload.data(), header.payloadSize)
+            || Crc32().add(payload.data(), payload.size()).get() != header.crc) {
+            truncated = true;
+            break;
+        }
+
+        CaptureLog::RecordInfo info;
+        std::memcpy(&info, payload.data(), sizeof(info));
+        cv::Mat data;
+        size_t dataSize = 0;
+        if (info.dataRows > 0 && info.dataCols > 0) {
+            data.create(info.dataRows, info.dataCols, info.dataType);
+            dataSize = data.total() * data.elemSize();
+        }
+        if (sizeof(info) + dataSize + info.imageSize != header.payloadSize) {
+            truncated = true;
+            break;
+        }
+
+        Record record;
+        record.letter = info.letter;
+        record.timestamp = info.timestamp;
+        if (dataSize > 0) {
+            std::memcpy(data.data, payload.data() + sizeof(info), dataSize);
+        }
+        record.data = data;
+        record.encodedImage.assign(payload.begin() + sizeof(info) + dataSize, payload.end());
+
+        nbOfRecords++;
+        callback(record);
+    }
+
+    // A partial record header at the end of the segment is a torn write too
+    if (!truncated && in.gcount() != 0) {
+        truncated = true;
+    }
+    return Code::SUCCESS;
+}
+
+bool CaptureLogReader::isTruncated() const {
+    return truncated;
+}
+
+int CaptureLogReader::getNbOfRecords() const {
+    return nbOfRecords;
+}
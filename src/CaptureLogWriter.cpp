@@ -0,0 +1,121 @@
+//
+// @author Loris Friedel
+//
+
+#include <chrono>
+#include <fcntl.h>
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../inc/CaptureLogWriter.hpp"
+#include "../inc/CaptureLogFormat.hpp"
+#include "../inc/Crc32.hpp"
+#include "../inc/code.h"
+#include "../inc/log.h"
+
+namespace {
+    /**
+     * Write the whole buffer, retrying on partial writes.
+     */
+    bool writeFully(int fd, const char *data, size_t size) {
+        while (size > 0) {
+            ssize_t written = ::write(fd, data, size);
+            if (written <= 0) {
+                return false;
+            }
+            data += written;
+            size -= (size_t) written;
+        }
+        return true;
+    }
+}
+
+CaptureLogWriter::CaptureLogWriter(std::string directory, size_t maxSegmentSize)
+        : directory(directory), maxSegmentSize(maxSegmentSize), fd(-1), segmentSize(0) {}
+
+CaptureLogWriter::~CaptureLogWriter() {
+    close();
+}
+
+int CaptureLogWriter::openSegment() {
+    close();
+
+    std::stringstream cmdMkdir;
+    cmdMkdir << "mkdir -p " << directory;
+    system(cmdMkdir.str().c_str());
+
+    // Time first so that segments sort in capture order
+    std::stringstream segmentPath;
+    segmentPath << directory << "/" << CaptureLog::SEGMENT_PREFIX
+                << std::chrono::system_clock::now().time_since_epoch().count() << "_" << getpid()
+                << CaptureLog::SEGMENT_EXT;
+
+    fd = ::open(segmentPath.str().c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0644);
+    if (fd < 0) {
+        LOG_E("ERROR: Could not create capture segment " << segmentPath.str());
+        return Code::ERROR;
+    }
+
+    CaptureLog::SegmentHeader header;
+    std::memcpy(header.magic, CaptureLog::MAGIC, sizeof(CaptureLog::MAGIC));
+    header.version = CaptureLog::VERSION;
+    if (!writeFully(fd, reinterpret_cast<const char *>(&header), sizeof(header))) {
+        LOG_E("ERROR: Could not write capture segment " << segmentPath.str());
+        close();
+        return Code::ERROR;
+    }
+    segmentSize = sizeof(header);
+    return Code::SUCCESS;
+}
+
+int CaptureLogWriter::append(int letter, int64_t timestamp, const cv::Mat &data,
+                             const std::vector<uchar> &encodedImage) {
+    if ((fd < 0 || segmentSize >= maxSegmentSize) && openSegment() != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+
+    cv::Mat continuousData = data.isContinuous() ? data : data.clone();
+    size_t dataSize = continuousData.total() * continuousData.elemSize();
+
+    CaptureLog::RecordInfo info;
+    info.letter = letter;
+    info.dataType = continuousData.type();
+    info.dataRows = continuousData.rows;
+    info.dataCols = continuousData.cols;
+    info.timestamp = timestamp;
+    info.imageSize = (uint32_t) encodedImage.size();
+    info.reserved = 0;
+
+    CaptureLog::RecordHeader header;
+    header.magic = CaptureLog::RECORD_MAGIC;
+    header.payloadSize = (uint32_t) (sizeof(info) + dataSize + encodedImage.size());
+
+    // Whole record in one buffer: a single append per record
+    buffer.resize(sizeof(header) + header.payloadSize);
+    char *payload = buffer.data() + sizeof(header);
+    std::memcpy(payload, &info, sizeof(info));
+    std::memcpy(payload + sizeof(info), continuousData.data, dataSize);
+    if (!encodedImage.empty()) {
+        std::memcpy(payload + sizeof(info) + dataSize, encodedImage.data(), encodedImage.size());
+    }
+    header.crc = Crc32().add(payload, header.payloadSize).get();
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    if (!writeFully(fd, buffer.data(), buffer.size())) {
+        LOG_E("ERROR: Could not append to capture log " << directory);
+        // The segment may end with a torn record now: never append after it
+        close();
+        return Code::ERROR;
+    }
+    segmentSize += buffer.size();
+    return Code::SUCCESS;
+}
+
+void CaptureLogWriter::close() {
+    if (fd >= 0) {
+        fdatasync(fd);
+        ::close(fd);
+        fd = -1;
+        segmentSize = 0;
+    }
+}
@@ -0,0 +1,110 @@
+//
+// @author Loris Friedel
+//
+
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include "../inc/ConversionManifest.hpp"
+#include "../inc/constant.h"
+#include "../inc/code.h"
+#include "../inc/log.h"
+
+static const std::string MANIFEST_HEADER = "img_convert manifest v1";
+
+ConversionManifest::ConversionManifest(std::string filePath, std::string parameters)
+        : filePath(filePath), parameters(parameters) {}
+
+int ConversionManifest::load() {
+    entries.clear();
+
+    std::ifstream in(filePath);
+    if (!in) {
+        return Code::SUCCESS; // No previous conversion
+    }
+
+    std::string header, storedParameters;
+    if (!getline(in, header) || header != MANIFEST_HEADER || !getline(in, storedParameters)) {
+        LOG_E("ERROR: Invalid manifest " << filePath);
+        return Code::ERROR;
+    }
+    if (storedParameters != parameters) {
+        LOG_I("Conversion parameters changed (" << storedParameters << " -> " << parameters
+                                                << "), every image will be converted");
+        return Code::SUCCESS;
+    }
+
+    // One line per source: size <TAB> mtime sec <TAB> mtime nsec <TAB> source <TAB> output
+    std::string line;
+    while (getline(in, line)) {
+        std::stringstream ss(line);
+        std::string source;
+        Entry entry;
+        char tab;
+        ss >> entry.size >> entry.mtimeSec >> entry.mtimeNSec >> std::noskipws >> tab;
+        if (!ss || tab != '\t' || !getline(ss, source, '\t') || !getline(ss, entry.output)) {
+            LOG_E("ERROR: Invalid manifest line \"" << line << "\" in " << filePath);
+            entries.clear();
+            return Code::ERROR;
+        }
+        entries[source] = entry;
+    }
+
+    return Code::SUCCESS;
+}
+
+int ConversionManifest::save() const {
+    std::string tmpPath = filePath + Default::TMP_FILE_INFIX + std::to_string(getpid());
+    std::ofstream out(tmpPath, std::ofstream::trunc);
+    if (!out) {
+        LOG_E("ERROR: Could not write manifest " << tmpPath);
+        return Code::ERROR;
+    }
+
+    out << MANIFEST_HEADER << "\n" << parameters << "\n";
+    for (const auto &sourceEntry : entries) {
+        const Entry &entry = sourceEntry.second;
+        out << entry.size << "\t" << entry.mtimeSec << "\t" << entry.mtimeNSec << "\t"
+            << sourceEntry.first << "\t" << entry.output << "\n";
+    }
+    out.close();
+
+    if (!out || std::rename(tmpPath.c_str(), filePath.c_str()) != 0) {
+        LOG_E("ERROR: Could not write manifest " << filePath);
+        std::remove(tmpPath.c_str());
+        return Code::ERROR;
+    }
+    return Code::SUCCESS;
+}
+
+bool ConversionManifest::isUpToDate(const std::string &source, const Entry &current) const {
+    auto it = entries.find(source);
+    return it != entries.end()
+           && it->second.output == current.output
+           && it->second.size == current.size
+           && it->second.mtimeSec == current.mtimeSec
+           && it->second.mtimeNSec == current.mtimeNSec;
+}
+
+void ConversionManifest::set(const std::string &source, const Entry &entry) {
+    entries[source] = entry;
+}
+
+void ConversionManifest::remove(const std::string &source) {
+    entries.erase(source);
+}
+
+const std::unordered_map<std::string, ConversionManifest::Entry> &ConversionManifest::getEntries() const {
+    return entries;
+}
+
+const std::string &ConversionManifest::getFilePath() const {
+    return filePath;
+}
+
+std::string ConversionManifest::pathFor(std::string directory) {
+    while (directory.size() > 1 && directory.back() == '/') {
+        directory.pop_back();
+    }
+    return directory + Default::MANIFEST_EXT;
+}
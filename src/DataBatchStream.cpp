@@ -0,0 +1,187 @@
+//
+// @author Loris Friedel
+//
+
+#include <numeric>
+#include <random>
+#include "../inc/DataBatchStream.hpp"
+#include "../inc/DataBinReader.hpp"
+#include "../inc/DataYmlReader.hpp"
+#include "../inc/DirectoryReader.hpp"
+#include "../inc/code.h"
+#include "../inc/constant.h"
+#include "../inc/log.h"
+
+DataBatchStream::DataBatchStream(std::string source, int batchSize, int prefetch, int nbThreads)
+        : source(source), batchSize(batchSize > 0 ? batchSize : 1), nbThreads(nbThreads),
+          queue((size_t) (prefetch > 0 ? prefetch : 1)), stopping(false) {}
+
+DataBatchStream::~DataBatchStream() {
+    stop();
+}
+
+int DataBatchStream::open() {
+    stop();
+    pathList.clear();
+    packedFile.reset();
+
+    if (DataBinReader::isDataBinFile(source)) {
+        if (DataBinReader::readHeader(source, packedHeader) != Code::SUCCESS
+            || !DataBin::isSupportedDtype(packedHeader.dtype)) {
+            LOG_E("ERROR: Unsupported packed data set " << source);
+            return Code::ERROR;
+        }
+
+        // Rows are read in a random order: no read ahead of the whole file
+        packedFile = std::make_shared<MappedFile>(source);
+        if (packedFile->open(false) != Code::SUCCESS || !DataBin::isConsistent(packedHeader, packedFile->size())) {
+            LOG_E("ERROR: Could not map packed data set " << source);
+            packedFile.reset();
+            return Code::ERROR;
+        }
+
+        nbOfSamples = (int) packedHeader.rows;
+        sampleSize = (int) packedHeader.cols;
+        return Code::SUCCESS;
+    }
+
+    DirectoryReader dirReader(source);
+    dirReader.setExtensions({Default::DATA_YML_EXT});
+    if (dirReader.foreachFile([this](std::string filePath, std::string fileName) {
+        pathList.push_back(filePath);
+    }) != Code::SUCCESS) {
+        LOG_E("ERROR: Could not list data directory " << source);
+        return Code::ERROR;
+    }
+
+    // The first readable file gives the sample size
+    sampleSize = 0;
+    for (const std::string &path : pathList) {
+        cv::Mat row;
+        int label;
+        if (DataYmlReader(path).read(row, label)) {
+            sampleSize = (int) row.total();
+            break;
+        }
+    }
+    if (sampleSize == 0) {
+        LOG_E("ERROR: No readable data file in " << source);
+        return Code::ERROR;
+    }
+
+    nbOfSamples = (int) pathList.size();
+    if (!pool) {
+        pool.reset(new WorkerPool(std::min(resolveThreadCount(nbThreads), batchSize)));
+    }
+    return Code::SUCCESS;
+}
+
+void DataBatchStream::startEpoch(int epoch) {
+    stop();
+
+    std::vector<int> order((size_t) nbOfSamples);
+    std::iota(order.begin(), order.end(), 0);
+    std::default_random_engine engine((unsigned int) epoch);
+    std::shuffle(order.begin(), order.end(), engine);
+
+    queue.reset();
+    stopping = false;
+    producer = std::thread(&DataBatchStream::produce, this, std::move(order));
+}
+
+bool DataBatchStream::nextBatch(cv::Mat &data, cv::Mat &responses) {
+    Batch batch;
+    if (!queue.pop(batch)) {
+        return false;
+    }
+    data = batch.data;
+    responses = batch.responses;
+    return true;
+}
+
+void DataBatchStream::stop() {
+    stopping = true;
+    queue.close();
+    if (producer.joinable()) {
+        producer.join();
+    }
+}
+
+void DataBatchStream::produce(std::vector<int> order) {
+    for (size_t begin = 0; begin < order.size() && !stopping; begin += batchSize) {
+        size_t end = std::min(order.size(), begin + (size_t) batchSize);
+
+        Batch batch;
+        readBatch(order, begin, end, batch);
+        if (batch.data.rows > 0 && !queue.push(batch)) {
+            break;
+        }
+    }
+    // End of epoch: consumers drain the queue then stop
+    queue.close();
+}
+
+void DataBatchStream::readBatch(const std::vector<int> &order, size_t begin, size_t end, Batch &batch) {
+    const int count = (int) (end - begin);
+    batch.data.create(count, sampleSize, CV_32FC1);
+    batch.responses.create(count, 1, CV_32SC1);
+
+    if (packedFile) {
+        // Rows stay in their stored form (float, uint8 or bits) until they are part of a batch
+        const size_t rowBytes = (size_t) DataBin::rowBytes(packedHeader.dtype, packedHeader.cols);
+        for (int i = 0; i < count; i++) {
+            int sample = order[begin + i];
+            DataBin::unpackRow(packedFile->data() + packedHeader.dataOffset + (size_t) sample * rowBytes,
+                               packedHeader.dtype, packedHeader.cols, batch.data.ptr<float>(i));
+            std::memcpy(batch.responses.ptr<int>(i),
+                        packedFile->data() + packedHeader.responsesOffset + (size_t) sample * sizeof(int32_t),
+                        sizeof(int32_t));
+        }
+        return;
+    }
+
+    std::vector<char> loaded((size_t) count, 0);
+    pool->run((size_t) count, [&](size_t i, int worker) {
+        const std::string &path = pathList[order[begin + i]];
+        cv::Mat row;
+        int label;
+        if (!DataYmlReader(path).read(row, label) || (int) row.total() != sampleSize) {
+            LOG_E("ERROR: can't load: " << path);
+            return;
+        }
+        cv::Mat dataRow = batch.data.row((int) i);
+        row.reshape(1, 1).convertTo(dataRow, CV_32FC1);
+        batch.responses.at<int>((int) i) = label;
+        loaded[i] = 1;
+    });
+
+    // Pack the loaded rows, preserving their order
+    int nbLoaded = 0;
+    for (int i = 0; i < count; i++) {
+        if (loaded[i]) {
+            if (nbLoaded != i) {
+                batch.data.row(i).copyTo(batch.data.row(nbLoaded));
+                batch.responses.at<int>(nbLoaded) = batch.responses.at<int>(i);
+            }
+            nbLoaded++;
+        }
+    }
+    batch.data = batch.data.rowRange(0, nbLoaded);
+    batch.responses = batch.responses.rowRange(0, nbLoaded);
+}
+
+int DataBatchStream::getSampleSize() const {
+    return sampleSize;
+}
+
+int DataBatchStream::getNbOfSamples() const {
+    return nbOfSamples;
+}
+
+int DataBatchStream::getBatchSize() const {
+    return batchSize;
+}
+
+const std::string &DataBatchStream::getSource() const {
+    return source;
+}
@@ -0,0 +1,134 @@
+//
+// @author Loris Friedel
+//
+
+#include <fstream>
+#include <sys/stat.h>
+#include "../inc/DataBinReader.hpp"
+#include "../inc/code.h"
+#include "../inc/log.h"
+
+DataBinReader::DataBinReader(std::string filePath)
+        : filePath(filePath) {}
+
+bool DataBinReader::isDataBinFile(const std::string &filePath) {
+    struct stat st;
+    if (stat(filePath.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+
+    std::ifstream in(filePath, std::ifstream::binary);
+    char magic[sizeof(DataBin::MAGIC)];
+    if (!in.read(magic, sizeof(magic))) {
+        return false;
+    }
+    return std::memcmp(magic, DataBin::MAGIC, sizeof(magic)) == 0;
+}
+
+int DataBinReader::readHeader(const std::string &filePath, DataBin::Header &header) {
+    std::ifstream in(filePath, std::ifstream::binary);
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+        return Code::ERROR;
+    }
+    if (!DataBin::hasMagic(header) || header.version != DataBin::VERSION) {
+        return Code::ERROR;
+    }
+    return Code::SUCCESS;
+}
+
+int DataBinReader::read(cv::Mat &dataOutput, cv::Mat &responsesOutput) {
+    cv::Mat storedData;
+    if (readStored(storedData, responsesOutput) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    if (header.dtype == CV_32F) {
+        dataOutput = storedData;
+        return Code::SUCCESS;
+    }
+
+    dataOutput.create((int) header.rows, (int) header.cols, CV_32FC1);
+    for (int r = 0; r < dataOutput.rows; r++) {
+        DataBin::unpackRow(storedData.ptr<uchar>(r), header.dtype, header.cols, dataOutput.ptr<float>(r));
+    }
+    return Code::SUCCESS;
+}
+
+int DataBinReader::readStored(cv::Mat &dataOutput, cv::Mat &responsesOutput) {
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(filePath);
+    if (file->open() != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+
+    if (file->size() < sizeof(DataBin::Header)) {
+        LOG_E("ERROR: Truncated data set " << filePath);
+        return Code::ERROR;
+    }
+
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    if (!DataBin::hasMagic(header) || header.version != DataBin::VERSION) {
+        LOG_E("ERROR: Not a packed data set (or unsupported version, re-run data_pack.exe): " << filePath);
+        return Code::ERROR;
+    }
+    const uint64_t rowBytes = DataBin::rowBytes(header.dtype, header.cols);
+    if (!DataBin::isConsistent(header, file->size())) {
+        LOG_E("ERROR: Corrupted data set " << filePath);
+        return Code::ERROR;
+    }
+
+    if (readLabelTable(*file, header) != Code::SUCCESS) {
+        LOG_E("ERROR: Corrupted label table in " << filePath);
+        return Code::ERROR;
+    }
+
+    if (header.dtype == CV_32F) {
+        dataOutput = MappedFile::wrap(file, header.dataOffset, (int) header.rows, (int) header.cols, CV_32FC1);
+    } else {
+        dataOutput = MappedFile::wrap(file, header.dataOffset, (int) header.rows, (int) rowBytes, CV_8UC1);
+    }
+    responsesOutput = MappedFile::wrap(file, header.responsesOffset, (int) header.rows, 1, CV_32SC1);
+
+    return Code::SUCCESS;
+}
+
+int DataBinReader::readLabelTable(const MappedFile &file, const DataBin::Header &header) {
+    labelMap.clear();
+    labelCounts.clear();
+
+    uint64_t offset = header.labelTableOffset;
+    for (uint32_t i = 0; i < header.nbLabels; i++) {
+        int32_t label;
+        uint32_t count;
+        uint32_t nameLength;
+        if (offset + sizeof(label) + sizeof(count) + sizeof(nameLength) > header.responsesOffset) {
+            return Code::ERROR;
+        }
+        std::memcpy(&label, file.data() + offset, sizeof(label));
+        offset += sizeof(label);
+        std::memcpy(&count, file.data() + offset, sizeof(count));
+        offset += sizeof(count);
+        std::memcpy(&nameLength, file.data() + offset, sizeof(nameLength));
+        offset += sizeof(nameLength);
+
+        if (offset + nameLength > header.responsesOffset) {
+            return Code::ERROR;
+        }
+        labelMap.put(label, std::string(reinterpret_cast<const char *>(file.data() + offset), nameLength));
+        labelCounts[label] = (int) count;
+        offset += nameLength;
+    }
+
+    return Code::SUCCESS;
+}
+
+const DataBin::Header &DataBinReader::getHeader() const {
+    return header;
+}
+
+const LabelMap &DataBinReader::getLabelMap() const {
+    return labelMap;
+}
+
+const std::map<int, int> &DataBinReader::getLabelCounts() const {
+    return labelCounts;
+}
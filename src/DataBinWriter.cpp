@@ -0,0 +1,150 @@
+//
+// @author Loris Friedel
+//
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <unistd.h>
+#include "../inc/DataBinWriter.hpp"
+#include "../inc/DataBinFormat.hpp"
+#include "../inc/constant.h"
+#include "../inc/code.h"
+#include "../inc/log.h"
+
+namespace {
+    void writePadding(std::ofstream &out, uint64_t from, uint64_t to) {
+        static const char zeros[DataBin::ALIGNMENT] = {0};
+        if (to > from) {
+            out.write(zeros, to - from);
+        }
+    }
+}
+
+DataBinWriter::DataBinWriter(std::string filePath)
+        : filePath(filePath) {}
+
+uint32_t DataBinWriter::smallestDtype(const cv::Mat &data) {
+    cv::Mat floatData;
+    data.convertTo(floatData, CV_32FC1);
+
+    bool binary = true;
+    for (int r = 0; r < floatData.rows; r++) {
+        const float *row = floatData.ptr<float>(r);
+        for (int c = 0; c < floatData.cols * floatData.channels(); c++) {
+            float value = row[c];
+            if (std::isnan(value)) {
+                return CV_32F;
+            }
+            if (value != 0.f && value != 255.f) {
+                binary = false;
+                if (value < 0.f || value > 255.f || value != (float) (int) value) {
+                    return CV_32F;
+                }
+            }
+        }
+    }
+    return binary ? DataBin::DTYPE_BIT : CV_8U;
+}
+
+int DataBinWriter::write(const cv::Mat &data, const cv::Mat &responses, LabelMap labelMap,
+                         uint64_t sourceFingerprint, uint32_t dtype, uint64_t nbOfSkippedFiles) {
+    if (data.rows != (int) responses.total()) {
+        LOG_E("ERROR: Data and responses sizes mismatch (" << data.rows << " vs " << responses.total() << ")");
+        return Code::ERROR;
+    }
+
+    if (dtype == DataBin::DTYPE_AUTO) {
+        dtype = smallestDtype(data);
+    } else if (!DataBin::isSupportedDtype(dtype)) {
+        LOG_E("ERROR: Unsupported data storage " << dtype);
+        return Code::ERROR;
+    }
+
+    // Stored rows, contiguous
+    const int cols = data.cols * data.channels();
+    const uint64_t rowBytes = DataBin::rowBytes(dtype, (uint32_t) cols);
+    cv::Mat storedData;
+    if (dtype == DataBin::DTYPE_BIT) {
+        cv::Mat byteData;
+        data.reshape(1, data.rows).convertTo(byteData, CV_8UC1);
+        storedData = cv::Mat::zeros(data.rows, (int) rowBytes, CV_8UC1);
+        for (int r = 0; r < byteData.rows; r++) {
+            const uchar *in = byteData.ptr<uchar>(r);
+            uchar *out = storedData.ptr<uchar>(r);
+            for (int c = 0; c < cols; c++) {
+                if (in[c] >= 128) {
+                    out[c >> 3] |= (uchar) (1 << (c & 7));
+                }
+            }
+        }
+    } else {
+        data.reshape(1, data.rows).convertTo(storedData, dtype == CV_8U ? CV_8UC1 : CV_32FC1);
+        if (!storedData.isContinuous()) {
+            storedData = storedData.clone();
+        }
+    }
+
+    cv::Mat intResponses;
+    responses.reshape(1, (int) responses.total()).convertTo(intResponses, CV_32SC1);
+    if (!intResponses.isContinuous()) {
+        intResponses = intResponses.clone();
+    }
+
+    // Label table: every label with its number of samples and its name
+    std::map<int, int> labelCounts;
+    for (int i = 0; i < intResponses.rows; i++) {
+        labelCounts[intResponses.at<int>(i)]++;
+    }
+
+    std::string labelTable;
+    for (auto it = labelCounts.begin(); it != labelCounts.end(); ++it) {
+        std::string name = labelMap.get(it->first);
+        int32_t label = it->first;
+        uint32_t count = (uint32_t) it->second;
+        uint32_t nameLength = (uint32_t) name.size();
+        labelTable.append(reinterpret_cast<const char *>(&label), sizeof(label));
+        labelTable.append(reinterpret_cast<const char *>(&count), sizeof(count));
+        labelTable.append(reinterpret_cast<const char *>(&nameLength), sizeof(nameLength));
+        labelTable.append(name);
+    }
+
+    DataBin::Header header;
+    std::memcpy(header.magic, DataBin::MAGIC, sizeof(DataBin::MAGIC));
+    header.version = DataBin::VERSION;
+    header.dtype = dtype;
+    header.rows = (uint32_t) data.rows;
+    header.cols = (uint32_t) cols;
+    header.nbLabels = (uint32_t) labelCounts.size();
+    header.labelTableOffset = sizeof(DataBin::Header);
+    header.responsesOffset = DataBin::align(header.labelTableOffset + labelTable.size());
+    header.dataOffset = DataBin::align(header.responsesOffset + (uint64_t) header.rows * sizeof(int32_t));
+    header.fileSize = header.dataOffset + (uint64_t) header.rows * rowBytes;
+    header.sourceFingerprint = sourceFingerprint;
+    header.nbOfSkippedFiles = nbOfSkippedFiles;
+
+    // Unique temporary name: several processes may write the same file at once
+    std::string tmpPath = filePath + Default::TMP_FILE_INFIX + std::to_string(getpid());
+    std::ofstream out(tmpPath, std::ofstream::binary | std::ofstream::trunc);
+    if (!out) {
+        LOG_E("ERROR: Could not write data set " << tmpPath);
+        return Code::ERROR;
+    }
+
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(labelTable.data(), labelTable.size());
+    writePadding(out, header.labelTableOffset + labelTable.size(), header.responsesOffset);
+    out.write(reinterpret_cast<const char *>(intResponses.data), header.rows * sizeof(int32_t));
+    writePadding(out, header.responsesOffset + (uint64_t) header.rows * sizeof(int32_t), header.dataOffset);
+    out.write(reinterpret_cast<const char *>(storedData.data), header.rows * rowBytes);
+    out.close();
+
+    if (!out || std::rename(tmpPath.c_str(), filePath.c_str()) != 0) {
+        LOG_E("ERROR: Could not write data set " << filePath);
+        std::remove(tmpPath.c_str());
+        return Code::ERROR;
+    }
+
+    return Code::SUCCESS;
+}
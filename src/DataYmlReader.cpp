@@ -9,6 +9,16 @@
 DataYmlReader::DataYmlReader(std::string filePath) : filePath(filePath) {}
 
 int DataYmlReader::read(cv::Mat &dataOutput, int &labelOutput) {
+    try {
+        return readOrThrow(dataOutput, labelOutput);
+    } catch (cv::Exception &e) {
+        // Malformed file: a failure of this file only
+        LOG_E("ERROR: Could not parse " << filePath << ": " << e.what());
+        return false;
+    }
+}
+
+int DataYmlReader::readOrThrow(cv::Mat &dataOutput, int &labelOutput) {
     cv::FileStorage fs(filePath, cv::FileStorage::READ);
 
     if (fs.isOpened()) {
@@ -0,0 +1,96 @@
+//
+// @author Loris Friedel
+//
+
+#include <algorithm>
+#include "../inc/DatasetRegistry.hpp"
+#include "../inc/Learning.hpp"
+#include "../inc/code.h"
+#include "../inc/log.h"
+
+size_t DatasetRegistry::Dataset::bytes() const {
+    return data.total() * data.elemSize() + responses.total() * responses.elemSize();
+}
+
+DatasetRegistry::DatasetRegistry(size_t maxBytes, int nbThreads, bool useCache)
+        : maxBytes(maxBytes), nbThreads(nbThreads), useCache(useCache), residentBytes(0), peakBytes(0) {}
+
+size_t DatasetRegistry::estimateBytes(int nbOfSamples, int sampleSize) {
+    // Float samples and int responses, as loaded by aggregateDataFrom
+    return (size_t) nbOfSamples * ((size_t) sampleSize * sizeof(float) + sizeof(int));
+}
+
+size_t DatasetRegistry::estimateTrainingBytes(int nbOfSamples, int sampleSize, bool nativeTraining) {
+    // One-hot float responses, with as many outputs as sample values; ANN_MLP adds scaled double copies of the
+    // samples and of the responses
+    const size_t values = (size_t) nbOfSamples * sampleSize;
+    return values * sizeof(float) + (nativeTraining ? 0 : 2 * values * sizeof(double));
+}
+
+bool DatasetRegistry::fits(size_t bytes) const {
+    return maxBytes == 0 || bytes <= maxBytes;
+}
+
+void DatasetRegistry::expect(const std::string &directory, int nbOfUses) {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[directory].pendingUses += nbOfUses;
+}
+
+std::shared_ptr<const DatasetRegistry::Dataset> DatasetRegistry::acquire(const std::string &directory) {
+    std::unique_lock<std::mutex> lock(mutex);
+    Entry &entry = entries[directory];
+    loaded.wait(lock, [&entry] { return !entry.loading; });
+    if (entry.dataset || entry.failed) {
+        return entry.dataset;
+    }
+
+    // First use: load without holding the lock, the other data sets stay available
+    entry.loading = true;
+    lock.unlock();
+    std::shared_ptr<Dataset> dataset = std::make_shared<Dataset>();
+    bool success = aggregateDataFrom(directory, dataset->data, dataset->responses, nbThreads, useCache)
+                   == Code::SUCCESS;
+    lock.lock();
+
+    entry.loading = false;
+    if (success) {
+        entry.dataset = dataset;
+        residentBytes += dataset->bytes();
+        peakBytes = std::max(peakBytes, residentBytes);
+        if (maxBytes > 0 && residentBytes > maxBytes) {
+            LOG_E("WARNING: Resident data sets (" << residentBytes / (1024 * 1024) << " MB) exceed the memory budget ("
+                                                  << maxBytes / (1024 * 1024) << " MB) after loading " << directory);
+        }
+    } else {
+        LOG_E("ERROR: Could not load training data \"" << directory << "\"");
+        entry.failed = true;
+    }
+    loaded.notify_all();
+    return entry.dataset;
+}
+
+void DatasetRegistry::release(const std::string &directory) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(directory);
+    if (it == entries.end() || --it->second.pendingUses > 0) {
+        return;
+    }
+    if (it->second.dataset) {
+        residentBytes -= it->second.dataset->bytes();
+    }
+    entries.erase(it);
+}
+
+size_t DatasetRegistry::getMaxBytes() const {
+    return maxBytes;
+}
+
+size_t DatasetRegistry::getResidentBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return residentBytes;
+}
+
+size_t DatasetRegistry::getPeakBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return peakBytes;
+}
@@ -2,33 +2,163 @@
 // @author Loris Friedel
 //
 
+#include <algorithm>
 #include <dirent.h>
-#include <opencv2/core/mat.hpp>
-#include <sstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include "../inc/DirectoryReader.hpp"
+#include "../inc/ParallelFor.hpp"
 #include "../inc/code.h"
 
+namespace {
+    // Entries read per system call: a few thousand names, instead of the ~32 KB of readdir
+    const size_t LIST_BUFFER_SIZE = 1 << 20;
+
+    struct LinuxDirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+}
+
 DirectoryReader::DirectoryReader(std::string directory)
-        : directory(directory) {}
+        : directory(directory), recursive(false), withStat(false), listed(false) {}
 
-int DirectoryReader::foreachFile(const std::function<void(std::string, std::string)> &callback) {
-    DIR *dir;
-    struct dirent *ent;
-    if ((dir = opendir(directory.c_str())) != NULL) {
-        while ((ent = readdir(dir)) != NULL) {
-            if (ent->d_type == DT_REG) {
-                std::string fileName = ent->d_name;
+DirectoryReader &DirectoryReader::setExtensions(std::vector<std::string> extensions) {
+    this->extensions = extensions;
+    listed = false;
+    return *this;
+}
+
+DirectoryReader &DirectoryReader::setRecursive(bool recursive) {
+    this->recursive = recursive;
+    listed = false;
+    return *this;
+}
+
+DirectoryReader &DirectoryReader::setWithStat(bool withStat) {
+    this->withStat = withStat;
+    listed = false;
+    return *this;
+}
+
+int DirectoryReader::list() {
+    files.clear();
+    listed = false;
+    if (listDirectory(directory, true) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
 
-                std::stringstream fullPath;
-                fullPath << directory << "/" << fileName;
+    std::sort(files.begin(), files.end(), [](const Entry &a, const Entry &b) {
+        return a.path < b.path;
+    });
+    listed = true;
+    return Code::SUCCESS;
+}
+
+int DirectoryReader::listDirectory(const std::string &path, bool isRoot) {
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        // Could not open directory
+        return Code::ERROR;
+    }
+
+    std::vector<char> buffer(LIST_BUFFER_SIZE);
+    std::vector<std::string> subdirectories;
+    long nread;
+    while ((nread = syscall(SYS_getdents64, fd, buffer.data(), buffer.size())) > 0) {
+        for (long offset = 0; offset < nread;) {
+            const LinuxDirent64 *ent = reinterpret_cast<const LinuxDirent64 *>(buffer.data() + offset);
+            offset += ent->d_reclen;
 
-                callback(fullPath.str(), fileName);
+            const char *name = ent->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
             }
+
+            unsigned char type = ent->d_type;
+            struct stat st;
+            bool statDone = false;
+            if (type == DT_UNKNOWN || (withStat && type == DT_REG)) {
+                // Some file systems do not fill the type
+                if (fstatat(fd, name, &st, 0) != 0) {
+                    continue;
+                }
+                statDone = true;
+                type = S_ISREG(st.st_mode) ? DT_REG : S_ISDIR(st.st_mode) ? DT_DIR : DT_UNKNOWN;
+            }
+
+            if (type == DT_DIR) {
+                if (recursive) {
+                    subdirectories.push_back(path + "/" + name);
+                }
+                continue;
+            }
+            if (type != DT_REG || !hasExtension(name)) {
+                continue;
+            }
+
+            Entry entry;
+            entry.name = name;
+            entry.path.reserve(path.size() + 1 + entry.name.size());
+            entry.path.append(path).append("/").append(entry.name);
+            if (statDone) {
+                entry.size = (int64_t) st.st_size;
+                entry.mtimeSec = (int64_t) st.st_mtim.tv_sec;
+                entry.mtimeNSec = (int64_t) st.st_mtim.tv_nsec;
+            }
+            files.push_back(std::move(entry));
         }
-        closedir(dir);
-        return Code::SUCCESS;
-    } else {
-        // Could not open directory
+    }
+    close(fd);
+
+    if (nread < 0 && isRoot) {
+        return Code::ERROR;
+    }
+
+    for (const std::string &subdirectory : subdirectories) {
+        listDirectory(subdirectory, false);
+    }
+    return Code::SUCCESS;
+}
+
+bool DirectoryReader::hasExtension(const std::string &fileName) const {
+    if (extensions.empty()) {
+        return true;
+    }
+    for (const std::string &extension : extensions) {
+        if (fileName.size() > extension.size()
+            && fileName.compare(fileName.size() - extension.size(), extension.size(), extension) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::vector<DirectoryReader::Entry> &DirectoryReader::getFiles() const {
+    return files;
+}
+
+int DirectoryReader::foreachFile(const std::function<void(std::string, std::string)> &callback) {
+    if (!listed && list() != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    for (const Entry &entry : files) {
+        callback(entry.path, entry.name);
+    }
+    return Code::SUCCESS;
+}
+
+int DirectoryReader::foreachFileParallel(int nbThreads, const std::function<void(const Entry &, int)> &callback) {
+    if (!listed && list() != Code::SUCCESS) {
         return Code::ERROR;
     }
+    parallelFor(files.size(), nbThreads, [&](size_t i, int worker) {
+        callback(files[i], worker);
+    });
+    return Code::SUCCESS;
 }
@@ -0,0 +1,80 @@
+//
+// @author Loris Friedel
+//
+
+#include <sstream>
+#include "../inc/FeatureSpec.hpp"
+#include "../inc/code.h"
+#include "../inc/log.h"
+
+int FeatureSpec::parse(const std::string &spec, FeatureSpec &feature) {
+    size_t equal = spec.find('=');
+    if (equal == std::string::npos || equal == 0) {
+        LOG_E("ERROR: Invalid feature \"" << spec << "\" (expected <type>=hog:... or <type>=resize:...)");
+        return Code::ERROR;
+    }
+    feature.type = spec.substr(0, equal);
+
+    std::vector<std::string> tokens;
+    std::stringstream ss(spec.substr(equal + 1));
+    std::string tok;
+    while (getline(ss, tok, ':')) {
+        tokens.push_back(tok);
+    }
+
+    try {
+        if (tokens.size() == 5 && tokens[0] == "hog") {
+            feature.kind = HOG;
+            feature.size = std::stoi(tokens[1]);
+            feature.blockSize = std::stoi(tokens[2]);
+            feature.blockStrideSize = std::stoi(tokens[3]);
+            feature.cellSize = std::stoi(tokens[4]);
+        } else if (tokens.size() == 2 && tokens[0] == "resize") {
+            feature.kind = RESIZE;
+            feature.size = std::stoi(tokens[1]);
+        } else {
+            LOG_E("ERROR: Invalid feature \"" << spec << "\" (expected hog:<size>:<block>:<stride>:<cell> or resize:<size>)");
+            return Code::ERROR;
+        }
+    } catch (std::exception &e) {
+        LOG_E("ERROR: Invalid number in feature \"" << spec << "\"");
+        return Code::ERROR;
+    }
+
+    if (feature.size <= 0) {
+        LOG_E("ERROR: Invalid size in feature \"" << spec << "\"");
+        return Code::ERROR;
+    }
+    return Code::SUCCESS;
+}
+
+cv::HOGDescriptor FeatureSpec::createDescriptor() const {
+    return cv::HOGDescriptor(cv::Size(size, size),
+                             cv::Size(blockSize, blockSize),
+                             cv::Size(blockStrideSize, blockStrideSize),
+                             cv::Size(cellSize, cellSize),
+                             9);
+}
+
+void FeatureSpec::compute(const cv::Mat &gray, const cv::HOGDescriptor &descriptor, cv::Mat &resized,
+                          std::vector<float> &description, cv::Mat &pixels) const {
+    // Pixels: same interpolation as the sign_detect hand input (see HandInput), so that samples match it.
+    // HOG: same interpolation as img_convert, so that both tools compute the same descriptors
+    cv::resize(gray, resized, cv::Size(size, size), 0, 0, kind == RESIZE ? cv::INTER_AREA : cv::INTER_LINEAR);
+    if (kind == HOG) {
+        descriptor.compute(resized, description);
+    } else {
+        pixels = resized.reshape(0, 1).clone(); // flatten
+    }
+}
+
+std::string FeatureSpec::toString() const {
+    std::stringstream ss;
+    ss << type << "=";
+    if (kind == HOG) {
+        ss << "hog:" << size << ":" << blockSize << ":" << blockStrideSize << ":" << cellSize;
+    } else {
+        ss << "resize:" << size;
+    }
+    return ss.str();
+}
@@ -0,0 +1,99 @@
+//
+// @author Loris Friedel
+//
+
+#include <algorithm>
+#include <cassert>
+#include "../inc/HandInput.hpp"
+
+HandInput::HandInput(int size, float scale) : size(size), scale(scale), row(1, size * size, CV_32FC1), rowSums((size_t) size) {
+    xTable.reserve(size, size);
+    yTable.reserve(size, size);
+}
+
+void HandInput::reserve(const cv::Size &frameSize) {
+    xTable.reserve(size, frameSize.width);
+    yTable.reserve(size, frameSize.height);
+}
+
+int HandInput::getSize() const {
+    return size;
+}
+
+cv::Rect HandInput::squareRoi(const cv::Rect &handRect, const cv::Size &imageSize) {
+    int largest = std::max(handRect.width, handRect.height);
+    cv::Rect roi = cv::Rect(handRect.x, handRect.y, largest, largest) & cv::Rect(0, 0, imageSize.width,
+                                                                                  imageSize.height);
+    roi.width = roi.height = std::min(roi.width, roi.height);
+    return roi;
+}
+
+void HandInput::AxisTable::reserve(int size, int srcLength) {
+    // A destination pixel boundary splits at most one source pixel in two
+    begin.reserve((size_t) size + 1);
+    index.reserve((size_t) (srcLength + size));
+    weight.reserve((size_t) (srcLength + size));
+}
+
+void HandInput::AxisTable::build(int size, int srcLength, float scale) {
+    if (srcLength == builtLength && scale == builtScale) {
+        return; // Same region size as the previous frame
+    }
+    builtLength = srcLength;
+    builtScale = scale;
+
+    begin.clear();
+    index.clear();
+    weight.clear();
+
+    const double ratio = (double) srcLength / size;
+    for (int d = 0; d < size; d++) {
+        begin.push_back((int) index.size());
+        // Destination pixel d covers [d * ratio, (d + 1) * ratio) in the source
+        double from = d * ratio;
+        double to = (d + 1) * ratio;
+        for (int s = (int) from; s < srcLength && s < to; s++) {
+            double overlap = std::min(to, s + 1.0) - std::max(from, (double) s);
+            if (overlap > 0) {
+                index.push_back(s);
+                weight.push_back((float) (overlap / ratio * scale));
+            }
+        }
+    }
+    begin.push_back((int) index.size());
+}
+
+const cv::Mat &HandInput::convert(const cv::Mat &backproj, const cv::Rect &handRect) {
+    assert(backproj.type() == CV_8UC1);
+
+    cv::Rect roi = squareRoi(handRect, backproj.size());
+    float *out = row.ptr<float>();
+    if (roi.width <= 0) {
+        std::fill(out, out + size * size, 0.0f);
+        return row;
+    }
+
+    // Scaling folded into the vertical weights
+    xTable.build(size, roi.width, 1.0f);
+    yTable.build(size, roi.height, scale);
+
+    for (int dy = 0; dy < size; dy++) {
+        float *outRow = out + dy * size;
+        std::fill(outRow, outRow + size, 0.0f);
+        for (int ey = yTable.begin[dy]; ey < yTable.begin[dy + 1]; ey++) {
+            const uchar *src = backproj.ptr<uchar>(roi.y + yTable.index[ey]) + roi.x;
+            for (int dx = 0; dx < size; dx++) {
+                float sum = 0;
+                for (int ex = xTable.begin[dx]; ex < xTable.begin[dx + 1]; ex++) {
+                    sum += src[xTable.index[ex]] * xTable.weight[ex];
+                }
+                rowSums[dx] = sum;
+            }
+            const float wy = yTable.weight[ey];
+            for (int dx = 0; dx < size; dx++) {
+                outRow[dx] += wy * rowSums[dx];
+            }
+        }
+    }
+    return row;
+}
@@ -0,0 +1,123 @@
+//
+// @author Loris Friedel
+//
+
+#include <algorithm>
+#include <thread>
+#include "../inc/JobScheduler.hpp"
+#include "../inc/ParallelFor.hpp"
+
+JobScheduler::JobScheduler(int nbThreads) : nbThreads(resolveThreadCount(nbThreads)), lastNbOfWorkers(1), nbOfSteals(0) {}
+
+void JobScheduler::submit(double cost, Job job, int group) {
+    auto rank = groupRanks.insert(std::make_pair(group, groupRanks.size())).first;
+    pending.push_back({rank->second, cost, std::move(job)});
+}
+
+void JobScheduler::run() {
+    const int nbWorkers = getNbOfWorkers();
+    nbOfSteals = 0;
+    if (pending.empty()) {
+        return;
+    }
+    lastNbOfWorkers = nbWorkers;
+
+    // Group by group, largest first, dealt round-robin: every deque is sorted the same way and holds about the
+    // same share of the work
+    std::stable_sort(pending.begin(), pending.end(), [](const Entry &a, const Entry &b) {
+        return a.groupRank != b.groupRank ? a.groupRank < b.groupRank : a.cost > b.cost;
+    });
+    queues.clear();
+    for (int w = 0; w < nbWorkers; w++) {
+        queues.emplace_back(new WorkerQueue());
+    }
+    for (size_t i = 0; i < pending.size(); i++) {
+        queues[i % nbWorkers]->jobs.push_back(std::move(pending[i]));
+    }
+    pending.clear();
+    groupRanks.clear();
+
+    std::vector<std::thread> workers;
+    for (int w = 1; w < nbWorkers; w++) {
+        workers.push_back(std::thread(&JobScheduler::work, this, w));
+    }
+    work(0);
+
+    for (std::thread &t : workers) {
+        t.join();
+    }
+    queues.clear();
+}
+
+int JobScheduler::getNbOfWorkers() const {
+    if (pending.empty()) {
+        return lastNbOfWorkers;
+    }
+    return (int) std::min<size_t>((size_t) nbThreads, pending.size());
+}
+
+int JobScheduler::getThreadBudget() const {
+    return std::max(1, nbThreads / getNbOfWorkers());
+}
+
+size_t JobScheduler::getNbOfSteals() const {
+    return nbOfSteals;
+}
+
+bool JobScheduler::popOwn(int worker, Entry &entry) {
+    WorkerQueue &queue = *queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.jobs.empty()) {
+        return false;
+    }
+    entry = std::move(queue.jobs.front());
+    queue.jobs.pop_front();
+    return true;
+}
+
+bool JobScheduler::steal(int worker, Entry &entry) {
+    // Take from the victim running the earliest group, so that the thief stays on the data most workers read, and
+    // take the smallest job of that group: its owner keeps the large ones it is about to start
+    const int nbWorkers = (int) queues.size();
+    while (true) {
+        int best = -1;
+        size_t bestRank = 0;
+        for (int i = 1; i < nbWorkers; i++) {
+            const int w = (worker + i) % nbWorkers;
+            WorkerQueue &victim = *queues[w];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty() && (best < 0 || victim.jobs.front().groupRank < bestRank)) {
+                best = w;
+                bestRank = victim.jobs.front().groupRank;
+            }
+        }
+        if (best < 0) {
+            return false;
+        }
+
+        WorkerQueue &victim = *queues[best];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.jobs.empty()) {
+            continue;  // Emptied by its owner since the scan
+        }
+        // Each deque is sorted by group then cost descending: the last job of the front group is its smallest
+        const size_t rank = victim.jobs.front().groupRank;
+        auto last = victim.jobs.begin();
+        while (last + 1 != victim.jobs.end() && (last + 1)->groupRank == rank) {
+            ++last;
+        }
+        entry = std::move(*last);
+        victim.jobs.erase(last);
+        nbOfSteals++;
+        return true;
+    }
+}
+
+void JobScheduler::work(int worker) {
+    // No job is submitted while running: once every deque is empty, the work is done
+    Entry entry;
+    while (popOwn(worker, entry) || steal(worker, entry)) {
+        entry.job(worker);
+        entry.job = nullptr;
+    }
+}
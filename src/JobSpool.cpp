@@ -0,0 +1,314 @@
+//
+// @author Loris Friedel
+//
+
+#include <cv.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "../inc/JobSpool.hpp"
+#include "../inc/DirectoryReader.hpp"
+#include "../inc/constant.h"
+#include "../inc/code.h"
+#include "../inc/log.h"
+
+const std::string JobSpool::QUEUED = "queued";
+const std::string JobSpool::CLAIMED = "claimed";
+const std::string JobSpool::DONE = "done";
+const std::string JobSpool::FAILED = "failed";
+
+static const char CLAIM_SEPARATOR = '@';
+static const std::string CLOSED_MARKER = "closed";
+
+/**
+ * Write a FileStorage file through a temporary file in the spool, then rename it to its path:
+ * other processes never see a partial file.
+ */
+template<typename Writer>
+static int writeAtomically(const std::string &spoolDir, const std::string &path, Writer writer) {
+    std::string tmpPath = spoolDir + "/" + JobSpool::workerId() + Default::TMP_FILE_INFIX
+                          + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count())
+                          + Default::DATA_YML_EXT;
+    cv::FileStorage fs(tmpPath, cv::FileStorage::WRITE);
+    if (!fs.isOpened()) {
+        LOG_E("ERROR: Could not write " << tmpPath);
+        return Code::ERROR;
+    }
+    writer(fs);
+    fs.release();
+
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        LOG_E("ERROR: Could not write " << path);
+        std::remove(tmpPath.c_str());
+        return Code::ERROR;
+    }
+    return Code::SUCCESS;
+}
+
+/**
+ * @return job id of a state file name (<id>.yml, or <id>@<worker>.yml when claimed)
+ */
+static std::string idOf(const std::string &fileName) {
+    std::string id = fileName.substr(0, fileName.size() - Default::DATA_YML_EXT.size());
+    return id.substr(0, id.find(CLAIM_SEPARATOR));
+}
+
+JobSpool::Lease::Lease(const Job &job, int leaseMS)
+        : claimPath(job.claimPath), intervalMS(std::max(1, leaseMS / 4)), stopping(false), held(true) {
+    toucher = std::thread([this]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopped.wait_for(lock, std::chrono::milliseconds(intervalMS), [this] { return stopping; })) {
+            // Null times: set to the current time of the file system
+            if (held && utimes(claimPath.c_str(), nullptr) != 0) {
+                LOG_E("WARNING: Lost the lease of " << claimPath);
+                held = false;
+            }
+        }
+    });
+}
+
+JobSpool::Lease::~Lease() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    stopped.notify_all();
+    toucher.join();
+}
+
+bool JobSpool::Lease::isHeld() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return held;
+}
+
+JobSpool::JobSpool(std::string directory) : directory(directory) {}
+
+int JobSpool::create() {
+    // mkdir(2) rather than the shell: the spool path is given by the user
+    std::vector<std::string> paths;
+    for (size_t slash = directory.find('/', 1); slash != std::string::npos; slash = directory.find('/', slash + 1)) {
+        paths.push_back(directory.substr(0, slash));
+    }
+    paths.push_back(directory);
+    for (const std::string &state : {QUEUED, CLAIMED, DONE, FAILED}) {
+        paths.push_back(directory + "/" + state);
+    }
+
+    for (const std::string &path : paths) {
+        struct stat st;
+        if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+            LOG_E("ERROR: Could not create spool directory " << path << ": " << std::strerror(errno));
+            return Code::ERROR;
+        }
+        if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            LOG_E("ERROR: Could not create spool directory " << path);
+            return Code::ERROR;
+        }
+    }
+    return Code::SUCCESS;
+}
+
+int JobSpool::submit(const Job &job) {
+    // A result of an earlier run would be taken for the result of this one (e.g. its model file was since removed)
+    std::remove(pathFor(DONE, job.id + Default::DATA_YML_EXT).c_str());
+    std::remove(pathFor(FAILED, job.id + Default::DATA_YML_EXT).c_str());
+    for (const std::string &state : {QUEUED, CLAIMED}) {
+        std::vector<std::string> ids = list(state);
+        if (std::find(ids.begin(), ids.end(), job.id) != ids.end()) {
+            return Code::SUCCESS;
+        }
+    }
+
+    return writeAtomically(directory, pathFor(QUEUED, job.id + Default::DATA_YML_EXT), [&job](cv::FileStorage &fs) {
+        fs << "id" << job.id;
+        fs << "name" << job.name;
+        fs << "type" << job.type;
+        fs << "topology" << job.topology;
+        fs << "source" << job.source;
+        fs << "modelPath" << job.modelPath;
+        fs << "batchSize" << job.batchSize;
+        fs << "prefetch" << job.prefetch;
+        fs << "epochs" << job.epochs;
+        fs << "optimizer" << job.optimizer;
+        fs << "learningRate" << job.learningRate;
+        fs << "miniBatch" << job.miniBatch;
+    });
+}
+
+int JobSpool::setClosed(bool closed) {
+    if (!closed) {
+        if (std::remove(closedPath().c_str()) != 0 && errno != ENOENT) {
+            LOG_E("ERROR: Could not open spool " << directory);
+            return Code::ERROR;
+        }
+        return Code::SUCCESS;
+    }
+
+    int fd = open(closedPath().c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+        LOG_E("ERROR: Could not close spool " << directory);
+        return Code::ERROR;
+    }
+    close(fd);
+    return Code::SUCCESS;
+}
+
+bool JobSpool::isClosed() const {
+    return modifiedNS(closedPath()) >= 0;
+}
+
+bool JobSpool::claim(Job &job) {
+    for (const std::string &id : list(QUEUED)) {
+        std::string queuedPath = pathFor(QUEUED, id + Default::DATA_YML_EXT);
+        std::string claimPath = pathFor(CLAIMED, id + CLAIM_SEPARATOR + workerId() + Default::DATA_YML_EXT);
+        // The lease starts now, not when the job was queued: touch before the rename, so that the claim never
+        // appears with the queuing time (requeueExpired would take it back)
+        if (utimes(queuedPath.c_str(), nullptr) != 0
+            || std::rename(queuedPath.c_str(), claimPath.c_str()) != 0) {
+            continue; // Claimed by another worker meanwhile
+        }
+        if (modifiedNS(pathFor(DONE, id + Default::DATA_YML_EXT)) >= 0) {
+            // Finished by a worker whose lease had expired
+            std::remove(claimPath.c_str());
+            continue;
+        }
+
+        cv::FileStorage fs(claimPath, cv::FileStorage::READ);
+        if (!fs.isOpened() || fs["id"].empty()) {
+            LOG_E("ERROR: Invalid job file " << claimPath);
+            std::rename(claimPath.c_str(), pathFor(FAILED, id + Default::DATA_YML_EXT).c_str());
+            continue;
+        }
+        fs["id"] >> job.id;
+        fs["name"] >> job.name;
+        fs["type"] >> job.type;
+        fs["topology"] >> job.topology;
+        fs["source"] >> job.source;
+        fs["modelPath"] >> job.modelPath;
+        fs["batchSize"] >> job.batchSize;
+        fs["prefetch"] >> job.prefetch;
+        fs["epochs"] >> job.epochs;
+        fs["optimizer"] >> job.optimizer;
+        fs["learningRate"] >> job.learningRate;
+        fs["miniBatch"] >> job.miniBatch;
+        job.claimPath = claimPath;
+        return true;
+    }
+    return false;
+}
+
+int JobSpool::publish(const Job &job, const Result &result) {
+    const std::string &state = result.success ? DONE : FAILED;
+    int code = writeAtomically(directory, pathFor(state, job.id + Default::DATA_YML_EXT), [&result](cv::FileStorage &fs) {
+        fs << "id" << result.id;
+        fs << "success" << (int) result.success;
+        fs << "modelPath" << result.modelPath;
+        fs << "trainSeconds" << result.trainSeconds;
+        fs << "worker" << result.worker;
+    });
+    std::remove(job.claimPath.c_str());
+    return code;
+}
+
+int JobSpool::requeueExpired(int leaseMS) {
+    const long long now = spoolTimeNS();
+    int nbRequeued = 0;
+
+    DirectoryReader dirReader(pathFor(CLAIMED, ""));
+    dirReader.setExtensions({Default::DATA_YML_EXT}).setWithStat(true);
+    if (now < 0 || dirReader.list() != Code::SUCCESS) {
+        return 0;
+    }
+    for (const DirectoryReader::Entry &file : dirReader.getFiles()) {
+        long long modified = file.mtimeSec * 1000000000LL + file.mtimeNSec;
+        if (now - modified <= (long long) leaseMS * 1000000LL) {
+            continue;
+        }
+        // Only one process succeeds, the claim file is gone for the others
+        if (std::rename(file.path.c_str(), pathFor(QUEUED, idOf(file.name) + Default::DATA_YML_EXT).c_str()) == 0) {
+            LOG_I("Lease of " << file.name << " expired, job queued again");
+            nbRequeued++;
+        }
+    }
+    return nbRequeued;
+}
+
+std::vector<std::string> JobSpool::list(const std::string &state) const {
+    std::vector<std::string> ids;
+    DirectoryReader dirReader(pathFor(state, ""));
+    dirReader.setExtensions({Default::DATA_YML_EXT});
+    if (dirReader.list() == Code::SUCCESS) {
+        for (const DirectoryReader::Entry &file : dirReader.getFiles()) {
+            ids.push_back(idOf(file.name));
+        }
+    }
+    return ids;
+}
+
+int JobSpool::readResult(const std::string &id, Result &result) const {
+    for (const std::string &state : {DONE, FAILED}) {
+        cv::FileStorage fs(pathFor(state, id + Default::DATA_YML_EXT), cv::FileStorage::READ);
+        if (!fs.isOpened()) {
+            continue;
+        }
+        int success = 0;
+        fs["id"] >> result.id;
+        fs["success"] >> success;
+        fs["modelPath"] >> result.modelPath;
+        fs["trainSeconds"] >> result.trainSeconds;
+        fs["worker"] >> result.worker;
+        result.success = success != 0;
+        return Code::SUCCESS;
+    }
+    return Code::ERROR;
+}
+
+const std::string &JobSpool::getDirectory() const {
+    return directory;
+}
+
+std::string JobSpool::workerId() {
+    char host[256] = {0};
+    if (gethostname(host, sizeof(host) - 1) != 0) {
+        host[0] = '\0';
+    }
+    std::string id = host;
+    std::replace(id.begin(), id.end(), CLAIM_SEPARATOR, '_');
+    return id + "." + std::to_string(getpid());
+}
+
+std::string JobSpool::pathFor(const std::string &state, const std::string &fileName) const {
+    return directory + "/" + state + "/" + fileName;
+}
+
+std::string JobSpool::closedPath() const {
+    return directory + "/" + CLOSED_MARKER;
+}
+
+long long JobSpool::modifiedNS(const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return -1;
+    }
+    return (long long) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+long long JobSpool::spoolTimeNS() const {
+    // Touch a file of the spool: its modification time is the clock the leases are compared with
+    std::string clockPath = directory + "/clock." + workerId();
+    int fd = open(clockPath.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    close(fd);
+    utimes(clockPath.c_str(), nullptr);
+    long long now = modifiedNS(clockPath);
+    std::remove(clockPath.c_str());
+    return now;
+}
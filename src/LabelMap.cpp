@@ -28,13 +28,22 @@ void LabelMap::clear() {
     labelMap.clear();
 }
 
-std::string LabelMap::get(int key) {
-    if(labelMap.find(key) != labelMap.end()) {
-        return labelMap[key];
+std::string LabelMap::get(int key) const {
+    auto it = labelMap.find(key);
+    if (it != labelMap.end()) {
+        return it->second;
     }
     return std::to_string(key);
 }
 
+bool LabelMap::has(int key) const {
+    return labelMap.find(key) != labelMap.end();
+}
+
+bool LabelMap::empty() const {
+    return labelMap.empty();
+}
+
 void write(cv::FileStorage &fs, const std::string &, const LabelMap &obj) {
     obj.write(fs);
 }
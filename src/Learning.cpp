@@ -3,12 +3,26 @@
 //
 
 #include <random>
+#include <sys/stat.h>
 #include "../inc/Learning.hpp"
 #include "../inc/log.h"
 #include "../inc/code.h"
 #include "../inc/Timer.hpp"
 #include "../inc/DirectoryReader.hpp"
 #include "../inc/DataYmlReader.hpp"
+#include "../inc/DataBinReader.hpp"
+#include "../inc/DataBinWriter.hpp"
+#include "../inc/DataBatchStream.hpp"
+#include "../inc/ParallelFor.hpp"
+#include "../inc/Hash.hpp"
+#include "../inc/constant.h"
+
+static uint64_t fingerprintFiles(const std::vector<DirectoryReader::Entry> &files);
+
+static int aggregateSerial(const std::vector<std::string> &dataPathList, cv::Mat &matData, cv::Mat &matResponses);
+
+static int aggregateParallel(const std::vector<std::string> &dataPathList, const int nbThreads,
+                              cv::Mat &matData, cv::Mat &matResponses);
 
 int trainMLPModel(cv::Mat &data, cv::Mat &responses,
                   MLPModel &model, const bool noTest, std::string testDir) {
@@ -25,12 +39,12 @@ int trainMLPModel(cv::Mat &data, cv::Mat &responses,
 }
 
 int trainMLPModel(const std::string dataDir, const std::string testDir,
-                  MLPModel &model, const bool noTest) {
+                  MLPModel &model, const bool noTest, const bool useCache) {
     cv::Mat data;
     cv::Mat responses;
 
     LOGP_I(&model, "Start training process..");
-    if (aggregateDataFrom(dataDir, data, responses) != Code::SUCCESS) {
+    if (aggregateDataFrom(dataDir, data, responses, 0, useCache) != Code::SUCCESS) {
         LOGP_E(&model, "Could not load training data");
         return Code::ERROR;
     };
@@ -38,6 +52,27 @@ int trainMLPModel(const std::string dataDir, const std::string testDir,
     return trainMLPModel(data, responses, model, noTest, testDir);
 }
 
+int trainMLPModelStreaming(const std::string dataDir, const std::string testDir,
+                           MLPModel &model, const bool noTest,
+                           const int batchSize, const int prefetch, const int nbOfEpochs) {
+    LOGP_I(&model, "Start streaming training process..");
+    DataBatchStream stream(dataDir, batchSize, prefetch);
+    if (stream.open() != Code::SUCCESS) {
+        LOGP_E(&model, "Could not open training data");
+        return Code::ERROR;
+    }
+
+    if (model.learnFrom(stream, nbOfEpochs) == Code::SUCCESS) {
+        if (!noTest) {
+            return testModel(model, testDir);
+        }
+        return Code::SUCCESS;
+    } else {
+        LOGP_E(&model, "ERROR: model training failed");
+        return Code::ERROR;
+    }
+}
+
 int executeTestModel(std::string modelPath, std::string testDir, LabelMap &labelMap) {
     MLPModel model;
     model.setLabelMap(labelMap);
@@ -100,33 +135,80 @@ int testModel(MLPModel &model, std::string inputDir) {
     return testModel(model, dataTest, responsesTest);
 }
 
-int aggregateDataFrom(std::string directory, cv::Mat &matData, cv::Mat &matResponses) {
+int aggregateDataFrom(std::string directory, cv::Mat &matData, cv::Mat &matResponses, int nbThreads,
+                      bool useCache, uint32_t cacheDtype) {
     LOG_I("Loading data...");
     Timer timer;
 
     timer.start();
+
+    // Packed data set: map it, no parsing
+    if (DataBinReader::isDataBinFile(directory)) {
+        DataBinReader binReader(directory);
+        if (binReader.read(matData, matResponses) != Code::SUCCESS) {
+            LOG_I("Loading data finished with errors.");
+            return Code::ERROR;
+        }
+        timer.stop();
+
+        LOG_I("Loading data done! (" << matData.rows << " packed samples, " << timer.getDurationS() << " s)");
+        return Code::SUCCESS;
+    }
+
     DirectoryReader dirReader(directory);
-    std::vector<std::string> dataPathList;
-    int dirReadCode = dirReader.foreachFile([&dataPathList](std::string filePath, std::string fileName) {
-        dataPathList.push_back(filePath);
-    });
+    dirReader.setExtensions({Default::DATA_YML_EXT}).setWithStat(useCache);
+    int dirReadCode = dirReader.list();
 
     if (dirReadCode == Code::SUCCESS) {
+        std::vector<std::string> dataPathList;
+        dataPathList.reserve(dirReader.getFiles().size());
+        for (const DirectoryReader::Entry &entry : dirReader.getFiles()) {
+            dataPathList.push_back(entry.path);
+        }
+
+        // Reuse the cached data set if the directory did not change since it was written
+        std::string cachePath = cachePathFor(directory);
+        uint64_t fingerprint = 0;
+        if (useCache) {
+            fingerprint = fingerprintFiles(dirReader.getFiles());
+            DataBin::Header cacheHeader;
+            if (DataBinReader::readHeader(cachePath, cacheHeader) == Code::SUCCESS
+                && cacheHeader.sourceFingerprint == fingerprint
+                && (cacheDtype == DataBin::DTYPE_AUTO || cacheHeader.dtype == cacheDtype)
+                && DataBinReader(cachePath).read(matData, matResponses) == Code::SUCCESS) {
+                timer.stop();
+                if (cacheHeader.nbOfSkippedFiles > 0) {
+                    LOG_E("WARNING: " << cacheHeader.nbOfSkippedFiles << " file(s) of " << directory
+                                      << " could not be loaded and are missing from the cache");
+                }
+                LOG_I("Loading data done! (" << matData.rows << " samples from cache " << cachePath << ", "
+                                             << timer.getDurationS() << " s)");
+                return Code::SUCCESS;
+            }
+        }
+
         auto engine = std::default_random_engine{};
         std::shuffle(std::begin(dataPathList), std::end(dataPathList), engine);
-        for (std::string path : dataPathList) {
-            int labelTmp;
-            cv::Mat labelDataRow;
-
-            // If no error while reading data
-            DataYmlReader reader(path);
-            if (reader.read(labelDataRow, labelTmp) != Code::SUCCESS) {
-                labelDataRow.convertTo(labelDataRow, CV_32FC1);
-
-                matResponses.push_back(labelTmp);
-                matData.push_back(labelDataRow);
-            } else {
-                LOG_E("ERROR: can't load: " << path);
+
+        int nbOfSkipped = resolveThreadCount(nbThreads) == 1
+                          ? aggregateSerial(dataPathList, matData, matResponses)
+                          : aggregateParallel(dataPathList, nbThreads, matData, matResponses);
+        if (nbOfSkipped > 0) {
+            LOG_E("WARNING: " << nbOfSkipped << "/" << dataPathList.size() << " file(s) of " << directory
+                              << " could not be loaded");
+        }
+
+        if (useCache && !matData.empty()) {
+            if (DataBinWriter(cachePath).write(matData, matResponses, LabelMap(), fingerprint, cacheDtype,
+                                               (uint64_t) nbOfSkipped) != Code::SUCCESS) {
+                LOG_E("WARNING: Could not write data set cache " << cachePath);
+            } else if (cacheDtype == CV_32F) {
+                // Same values, but mapped: the parsed copy is freed
+                cv::Mat mappedData, mappedResponses;
+                if (DataBinReader(cachePath).read(mappedData, mappedResponses) == Code::SUCCESS) {
+                    matData = mappedData;
+                    matResponses = mappedResponses;
+                }
             }
         }
     } else {
@@ -138,3 +220,134 @@ int aggregateDataFrom(std::string directory, cv::Mat &matData, cv::Mat &matRespo
     LOG_I("Loading data done! (" << timer.getDurationS() << " s)");
     return Code::SUCCESS;
 }
+
+std::string cachePathFor(std::string directory) {
+    while (directory.size() > 1 && directory.back() == '/') {
+        directory.pop_back();
+    }
+    return directory + Default::DATA_CACHE_EXT;
+}
+
+int fingerprintData(std::string directory, uint64_t &fingerprint) {
+    if (DataBinReader::isDataBinFile(directory)) {
+        struct stat st;
+        if (stat(directory.c_str(), &st) != 0) {
+            return Code::ERROR;
+        }
+        DirectoryReader::Entry entry;
+        entry.path = entry.name = directory;
+        entry.size = st.st_size;
+        entry.mtimeSec = st.st_mtim.tv_sec;
+        entry.mtimeNSec = st.st_mtim.tv_nsec;
+        fingerprint = fingerprintFiles({entry});
+        return Code::SUCCESS;
+    }
+
+    DirectoryReader dirReader(directory);
+    dirReader.setExtensions({Default::DATA_YML_EXT}).setWithStat(true);
+    if (dirReader.list() != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    fingerprint = fingerprintFiles(dirReader.getFiles());
+    return Code::SUCCESS;
+}
+
+static uint64_t fingerprintFiles(const std::vector<DirectoryReader::Entry> &files) {
+    // Files are listed sorted by path, with their size and modification time
+    Hash hash;
+    hash.add(DataBin::VERSION);
+    for (const DirectoryReader::Entry &entry : files) {
+        hash.add(entry.name);
+        hash.add(entry.size);
+        hash.add(entry.mtimeSec);
+        hash.add(entry.mtimeNSec);
+    }
+    return hash.get();
+}
+
+static int aggregateSerial(const std::vector<std::string> &dataPathList, cv::Mat &matData, cv::Mat &matResponses) {
+    int nbOfSkipped = 0;
+    for (std::string path : dataPathList) {
+        int labelTmp;
+        cv::Mat labelDataRow;
+
+        // If no error while reading data
+        DataYmlReader reader(path);
+        if (reader.read(labelDataRow, labelTmp) != Code::SUCCESS) {
+            labelDataRow.convertTo(labelDataRow, CV_32FC1);
+
+            matResponses.push_back(labelTmp);
+            matData.push_back(labelDataRow);
+        } else {
+            LOG_E("ERROR: can't load: " << path);
+            nbOfSkipped++;
+        }
+    }
+    return nbOfSkipped;
+}
+
+static int aggregateParallel(const std::vector<std::string> &dataPathList, const int nbThreads,
+                             cv::Mat &matData, cv::Mat &matResponses) {
+    const int nbOfFiles = (int) dataPathList.size();
+
+    // The first readable file gives the sample size, so the whole matrix is allocated once
+    int first = 0;
+    int firstLabel = 0;
+    cv::Mat firstRow;
+    for (; first < nbOfFiles; first++) {
+        DataYmlReader reader(dataPathList[first]);
+        if (reader.read(firstRow, firstLabel)) {
+            break;
+        }
+    }
+    if (first == nbOfFiles) {
+        for (const std::string &path : dataPathList) {
+            LOG_E("ERROR: can't load: " << path);
+        }
+        return nbOfFiles;
+    }
+    const int sampleSize = (int) firstRow.total();
+
+    cv::Mat data(nbOfFiles, sampleSize, CV_32FC1);
+    cv::Mat responses(nbOfFiles, 1, CV_32SC1);
+
+    // Rows keep the shuffled file order, whatever the worker that parses them
+    std::vector<char> loaded(nbOfFiles, 0);
+    parallelFor((size_t) nbOfFiles, nbThreads, [&](size_t i, int worker) {
+        if ((int) i < first) {
+            return;
+        }
+
+        int label = firstLabel;
+        cv::Mat row = firstRow;
+        if ((int) i != first) {
+            DataYmlReader reader(dataPathList[i]);
+            if (!reader.read(row, label) || (int) row.total() != sampleSize) {
+                return;
+            }
+        }
+
+        cv::Mat dataRow = data.row((int) i);
+        row.reshape(1, 1).convertTo(dataRow, CV_32FC1);
+        responses.at<int>((int) i) = label;
+        loaded[i] = 1;
+    });
+
+    // Report failures and pack the loaded rows, preserving their order
+    int nbLoaded = 0;
+    for (int i = 0; i < nbOfFiles; i++) {
+        if (!loaded[i]) {
+            LOG_E("ERROR: can't load: " << dataPathList[i]);
+            continue;
+        }
+        if (nbLoaded != i) {
+            data.row(i).copyTo(data.row(nbLoaded));
+            responses.at<int>(nbLoaded) = responses.at<int>(i);
+        }
+        nbLoaded++;
+    }
+
+    matData = data.rowRange(0, nbLoaded);
+    matResponses = responses.rowRange(0, nbLoaded);
+    return nbOfFiles - nbLoaded;
+}
@@ -0,0 +1,772 @@
+//
+// @author Loris Friedel
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cv.hpp>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MLP_INFERENCE_X86
+#endif
+#include "../inc/MLPInference.hpp"
+#include "../inc/ModelBundle.hpp"
+#include "../inc/TanhApprox.hpp"
+#include "../inc/code.h"
+#include "../inc/log.h"
+
+namespace {
+    const int LANES = 8;
+    const int QUANTIZED_LANES = 16;
+    const int QUANTIZED_NEURONS = 4;
+    const int QUANTIZED_MAX = 127;
+
+    using namespace TanhApprox;
+
+    /**
+     * output = tanh(bias + input * weights), scalar version.
+     */
+    void layerScalar(const float *input, int inSize, const float *weights, const float *bias, int outPadded,
+                     float *output) {
+        std::memcpy(output, bias, outPadded * sizeof(float));
+        for (int i = 0; i < inSize; i++) {
+            const float x = input[i];
+            const float *row = weights + (size_t) i * outPadded;
+            for (int o = 0; o < outPadded; o++) {
+                output[o] += x * row[o];
+            }
+        }
+        for (int o = 0; o < outPadded; o++) {
+            output[o] = tanhApprox(output[o]);
+        }
+    }
+
+#ifdef MLP_INFERENCE_X86
+    inline __m128 tanhSse(__m128 x) {
+        x = _mm_min_ps(_mm_set1_ps(CLAMP), _mm_max_ps(_mm_set1_ps(-CLAMP), x));
+        __m128 x2 = _mm_mul_ps(x, x);
+        __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A13), x2), _mm_set1_ps(A11));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(A9));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(A7));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(A5));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(A3));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(A1));
+        p = _mm_mul_ps(p, x);
+        __m128 q = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(B6), x2), _mm_set1_ps(B4));
+        q = _mm_add_ps(_mm_mul_ps(q, x2), _mm_set1_ps(B2));
+        q = _mm_add_ps(_mm_mul_ps(q, x2), _mm_set1_ps(B0));
+        return _mm_div_ps(p, q);
+    }
+
+    /**
+     * SSE version: 8 neurons (two registers) per pass over the input.
+     */
+    void layerSse(const float *input, int inSize, const float *weights, const float *bias, int outPadded,
+                  float *output) {
+        for (int o = 0; o < outPadded; o += LANES) {
+            __m128 acc0 = _mm_load_ps(bias + o);
+            __m128 acc1 = _mm_load_ps(bias + o + 4);
+            const float *column = weights + o;
+            for (int i = 0; i < inSize; i++, column += outPadded) {
+                __m128 x = _mm_set1_ps(input[i]);
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(x, _mm_load_ps(column)));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(x, _mm_load_ps(column + 4)));
+            }
+            _mm_store_ps(output + o, tanhSse(acc0));
+            _mm_store_ps(output + o + 4, tanhSse(acc1));
+        }
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline __m256 tanhAvx(__m256 x) {
+        x = _mm256_min_ps(_mm256_set1_ps(CLAMP), _mm256_max_ps(_mm256_set1_ps(-CLAMP), x));
+        __m256 x2 = _mm256_mul_ps(x, x);
+        __m256 p = _mm256_fmadd_ps(_mm256_set1_ps(A13), x2, _mm256_set1_ps(A11));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(A9));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(A7));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(A5));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(A3));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(A1));
+        p = _mm256_mul_ps(p, x);
+        __m256 q = _mm256_fmadd_ps(_mm256_set1_ps(B6), x2, _mm256_set1_ps(B4));
+        q = _mm256_fmadd_ps(q, x2, _mm256_set1_ps(B2));
+        q = _mm256_fmadd_ps(q, x2, _mm256_set1_ps(B0));
+        return _mm256_div_ps(p, q);
+    }
+
+    /**
+     * AVX2/FMA version: 32 neurons (four independent accumulators) per pass over the input, then 8 at a time.
+     */
+    __attribute__((target("avx2,fma")))
+    void layerAvx2(const float *input, int inSize, const float *weights, const float *bias, int outPadded,
+                   float *output) {
+        int o = 0;
+        for (; o + 4 * LANES <= outPadded; o += 4 * LANES) {
+            __m256 acc0 = _mm256_load_ps(bias + o);
+            __m256 acc1 = _mm256_load_ps(bias + o + LANES);
+            __m256 acc2 = _mm256_load_ps(bias + o + 2 * LANES);
+            __m256 acc3 = _mm256_load_ps(bias + o + 3 * LANES);
+            const float *column = weights + o;
+            for (int i = 0; i < inSize; i++, column += outPadded) {
+                __m256 x = _mm256_set1_ps(input[i]);
+                acc0 = _mm256_fmadd_ps(x, _mm256_load_ps(column), acc0);
+                acc1 = _mm256_fmadd_ps(x, _mm256_load_ps(column + LANES), acc1);
+                acc2 = _mm256_fmadd_ps(x, _mm256_load_ps(column + 2 * LANES), acc2);
+                acc3 = _mm256_fmadd_ps(x, _mm256_load_ps(column + 3 * LANES), acc3);
+            }
+            _mm256_store_ps(output + o, tanhAvx(acc0));
+            _mm256_store_ps(output + o + LANES, tanhAvx(acc1));
+            _mm256_store_ps(output + o + 2 * LANES, tanhAvx(acc2));
+            _mm256_store_ps(output + o + 3 * LANES, tanhAvx(acc3));
+        }
+        for (; o < outPadded; o += LANES) {
+            __m256 acc = _mm256_load_ps(bias + o);
+            const float *column = weights + o;
+            for (int i = 0; i < inSize; i++, column += outPadded) {
+                acc = _mm256_fmadd_ps(_mm256_set1_ps(input[i]), _mm256_load_ps(column), acc);
+            }
+            _mm256_store_ps(output + o, tanhAvx(acc));
+        }
+    }
+#endif
+
+    /**
+     * output = tanh(bias + scale * (input . weights)) with 8 bits weights (outPadded rows of inPadded values) and
+     * 16 bits inputs (values in [-127, 127], no overflow of the 32 bits sums before 2^17 terms).
+     * outPadded is a multiple of QUANTIZED_NEURONS and inPadded a multiple of 16, scalar version.
+     */
+    void quantizedLayerScalar(const int16_t *input, int inPadded, const int8_t *weights, const float *scales,
+                              const float *bias, int outPadded, float *output) {
+        for (int o = 0; o < outPadded; o++) {
+            const int8_t *row = weights + (size_t) o * inPadded;
+            int32_t acc = 0;
+            for (int i = 0; i < inPadded; i++) {
+                acc += (int32_t) input[i] * row[i];
+            }
+            output[o] = tanhApprox(acc * scales[o] + bias[o]);
+        }
+    }
+
+#ifdef MLP_INFERENCE_X86
+    /**
+     * Sums of each of the four registers, in this order.
+     */
+    inline __m128i sum4Sse(__m128i a0, __m128i a1, __m128i a2, __m128i a3) {
+        __m128i s01 = _mm_add_epi32(_mm_unpacklo_epi32(a0, a1), _mm_unpackhi_epi32(a0, a1));
+        __m128i s23 = _mm_add_epi32(_mm_unpacklo_epi32(a2, a3), _mm_unpackhi_epi32(a2, a3));
+        return _mm_add_epi32(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+    }
+
+    /**
+     * Products of 16 weights and 16 inputs, summed by pairs.
+     */
+    inline __m128i madd16Sse(const int8_t *weights, __m128i xLow, __m128i xHigh) {
+        __m128i w = _mm_load_si128(reinterpret_cast<const __m128i *>(weights));
+        __m128i wLow = _mm_srai_epi16(_mm_unpacklo_epi8(w, w), 8);
+        __m128i wHigh = _mm_srai_epi16(_mm_unpackhi_epi8(w, w), 8);
+        return _mm_add_epi32(_mm_madd_epi16(wLow, xLow), _mm_madd_epi16(wHigh, xHigh));
+    }
+
+    /**
+     * SSE2 version, four neurons per pass over the input: weights are widened by unpacking then an arithmetic shift.
+     */
+    void quantizedLayerSse(const int16_t *input, int inPadded, const int8_t *weights, const float *scales,
+                           const float *bias, int outPadded, float *output) {
+        for (int o = 0; o < outPadded; o += QUANTIZED_NEURONS) {
+            const int8_t *rows = weights + (size_t) o * inPadded;
+            __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+            __m128i acc2 = _mm_setzero_si128(), acc3 = _mm_setzero_si128();
+            for (int i = 0; i < inPadded; i += QUANTIZED_LANES) {
+                __m128i xLow = _mm_load_si128(reinterpret_cast<const __m128i *>(input + i));
+                __m128i xHigh = _mm_load_si128(reinterpret_cast<const __m128i *>(input + i + 8));
+                acc0 = _mm_add_epi32(acc0, madd16Sse(rows + i, xLow, xHigh));
+                acc1 = _mm_add_epi32(acc1, madd16Sse(rows + inPadded + i, xLow, xHigh));
+                acc2 = _mm_add_epi32(acc2, madd16Sse(rows + 2 * inPadded + i, xLow, xHigh));
+                acc3 = _mm_add_epi32(acc3, madd16Sse(rows + 3 * inPadded + i, xLow, xHigh));
+            }
+            __m128 sum = _mm_cvtepi32_ps(sum4Sse(acc0, acc1, acc2, acc3));
+            sum = _mm_add_ps(_mm_mul_ps(sum, _mm_loadu_ps(scales + o)), _mm_loadu_ps(bias + o));
+            _mm_storeu_ps(output + o, tanhSse(sum));
+        }
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i widen16Avx2(const int8_t *weights) {
+        return _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(weights)));
+    }
+
+    __attribute__((target("avx2")))
+    inline __m128i halves32Avx2(__m256i x) {
+        return _mm_add_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+    }
+
+    /**
+     * AVX2 version: 16 weights sign extended at once.
+     */
+    __attribute__((target("avx2,fma")))
+    void quantizedLayerAvx2(const int16_t *input, int inPadded, const int8_t *weights, const float *scales,
+                            const float *bias, int outPadded, float *output) {
+        for (int o = 0; o < outPadded; o += QUANTIZED_NEURONS) {
+            const int8_t *rows = weights + (size_t) o * inPadded;
+            __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+            __m256i acc2 = _mm256_setzero_si256(), acc3 = _mm256_setzero_si256();
+            for (int i = 0; i < inPadded; i += QUANTIZED_LANES) {
+                __m256i x = _mm256_load_si256(reinterpret_cast<const __m256i *>(input + i));
+                acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(widen16Avx2(rows + i), x));
+                acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(widen16Avx2(rows + inPadded + i), x));
+                acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(widen16Avx2(rows + 2 * inPadded + i), x));
+                acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(widen16Avx2(rows + 3 * inPadded + i), x));
+            }
+            __m128i sum = sum4Sse(halves32Avx2(acc0), halves32Avx2(acc1), halves32Avx2(acc2), halves32Avx2(acc3));
+            __m128 value = _mm_fmadd_ps(_mm_cvtepi32_ps(sum), _mm_loadu_ps(scales + o), _mm_loadu_ps(bias + o));
+            _mm_storeu_ps(output + o, tanhSse(value));
+        }
+    }
+#endif
+
+    /**
+     * Round value / scale to the nearest integer in [-127, 127].
+     */
+    inline int8_t quantizeValue(float value, float invScale) {
+        float q = std::min((float) QUANTIZED_MAX, std::max((float) -QUANTIZED_MAX, value * invScale));
+        return (int8_t) std::nearbyint(q);
+    }
+
+    /**
+     * output = quantizeValue(input), widened to 16 bits. SSE2 rounds to the nearest even integer as nearbyint.
+     */
+    void quantizeInput(const float *input, int size, float invScale, bool sse, int16_t *output) {
+        int i = 0;
+#ifdef MLP_INFERENCE_X86
+        if (sse) {
+            const __m128 scale = _mm_set1_ps(invScale);
+            const __m128 high = _mm_set1_ps((float) QUANTIZED_MAX);
+            const __m128 low = _mm_set1_ps((float) -QUANTIZED_MAX);
+            for (; i + 8 <= size; i += 8) {
+                __m128 a = _mm_min_ps(high, _mm_max_ps(low, _mm_mul_ps(_mm_loadu_ps(input + i), scale)));
+                __m128 b = _mm_min_ps(high, _mm_max_ps(low, _mm_mul_ps(_mm_loadu_ps(input + i + 4), scale)));
+                _mm_store_si128(reinterpret_cast<__m128i *>(output + i),
+                                _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+            }
+        }
+#endif
+        for (; i < size; i++) {
+            output[i] = quantizeValue(input[i], invScale);
+        }
+    }
+
+    /**
+     * Scale of the 8 bits weights of one neuron: the clipping threshold is searched below the largest weight,
+     * minimizing the squared error of the weights weighted by the energy of their input (a few large weights
+     * should not cost the precision of all the others).
+     */
+    float weightScale(const std::vector<float> &weights, const std::vector<double> &energy) {
+        float maxWeight = 0;
+        for (float w : weights) {
+            maxWeight = std::max(maxWeight, std::abs(w));
+        }
+        if (maxWeight == 0) {
+            return 1;
+        }
+
+        float bestScale = maxWeight / QUANTIZED_MAX;
+        double bestError = -1;
+        float clip = maxWeight;
+        for (int k = 0; k < 60; k++, clip *= 0.9f) {
+            const float scale = clip / QUANTIZED_MAX;
+            double error = 0;
+            for (size_t i = 0; i < weights.size(); i++) {
+                double diff = weights[i] - quantizeValue(weights[i], 1 / scale) * scale;
+                error += energy[i] * diff * diff;
+            }
+            if (bestError < 0 || error < bestError) {
+                bestError = error;
+                bestScale = scale;
+            }
+        }
+        return bestScale;
+    }
+}
+
+const std::string MLPInference::QUANTIZED_NODE = "mlp_int8";
+
+MLPInference::MLPInference() : isa(detectIsa()) {}
+
+MLPInference::Isa MLPInference::detectIsa() {
+#ifdef MLP_INFERENCE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SSE;
+    }
+#endif
+    return SCALAR;
+}
+
+std::string MLPInference::isaName(Isa isa) {
+    switch (isa) {
+        case AVX2:
+            return "AVX2";
+        case SSE:
+            return "SSE";
+        default:
+            return "scalar";
+    }
+}
+
+void MLPInference::setIsa(Isa isa) {
+    this->isa = std::min(isa, detectIsa());
+}
+
+MLPInference::Isa MLPInference::getIsa() const {
+    return isa;
+}
+
+template<typename T>
+std::unique_ptr<T[], MLPInference::AlignedFree> MLPInference::allocate(size_t count) {
+    void *memory = nullptr;
+    if (posix_memalign(&memory, 64, std::max<size_t>(count, 1) * sizeof(T)) != 0) {
+        throw std::bad_alloc();
+    }
+    std::memset(memory, 0, count * sizeof(T));
+    return std::unique_ptr<T[], AlignedFree>(static_cast<T *>(memory));
+}
+
+int MLPInference::load(const std::string xmlFileName) {
+    layers.clear();
+    quantizedLayers.clear();
+    outputScale.clear();
+
+    if (ModelBundle::isBundleFile(xmlFileName)) {
+        ModelBundle bundle;
+        if (bundle.load(xmlFileName) != Code::SUCCESS) {
+            return Code::ERROR;
+        }
+        return load(bundle);
+    }
+
+    cv::FileStorage fs(xmlFileName, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        LOG_E("ERROR: Could not read the classifier : " << xmlFileName);
+        return Code::ERROR;
+    }
+    if (!fs[QUANTIZED_NODE].empty()) {
+        if (loadQuantized(fs[QUANTIZED_NODE]) != Code::SUCCESS) {
+            LOG_E("ERROR: Corrupted quantized classifier : " << xmlFileName);
+            quantizedLayers.clear();
+            outputScale.clear();
+            return Code::ERROR;
+        }
+        return Code::SUCCESS;
+    }
+
+    cv::FileNode root = fs["opencv_ml_ann_mlp"];
+    if (root.empty()) {
+        root = fs.getFirstTopLevelNode();
+    }
+    ModelBundle bundle;
+    if (bundle.readNetwork(root) != Code::SUCCESS) {
+        LOG_E("ERROR: Corrupted classifier : " << xmlFileName);
+        return Code::ERROR;
+    }
+    return load(bundle);
+}
+
+int MLPInference::load(const ModelBundle &bundle) {
+    layers.clear();
+    quantizedLayers.clear();
+    outputScale.clear();
+
+    if (bundle.activation != cv::ml::ANN_MLP::SIGMOID_SYM) {
+        LOG_E("ERROR: Unsupported classifier (SIGMOID_SYM networks only, not "
+                      << ModelBundle::activationName(bundle.activation) << ")");
+        return Code::ERROR;
+    }
+    const std::vector<int> &layerSizes = bundle.layerSizes;
+    const int nbLayers = (int) layerSizes.size() - 1;
+    const double alpha = bundle.activationParam1;
+    const double beta = bundle.activationParam2;
+    const double *inputScale = bundle.inputScale.ptr<double>();
+    const double *outScale = bundle.outputScale.ptr<double>();
+
+    /*
+     * OpenCV computes, for each layer, y = f(x * W + b) with f(s) = beta * (1 - e^(-alpha s)) / (1 + e^(-alpha s))
+     * = beta * tanh(alpha s / 2), after scaling the input (x * scale + shift).
+     * Stored here: W' and b' such that the layer output is tanh(x' * W' + b') where x' is the raw input for the
+     * first layer, and the previous tanh output for the others (beta is folded into the next layer).
+     */
+    const double half = alpha / 2;
+    for (int l = 0; l < nbLayers; l++) {
+        Layer layer;
+        layer.inSize = layerSizes[l];
+        layer.outSize = layerSizes[l + 1];
+        layer.outPadded = (layer.outSize + LANES - 1) / LANES * LANES;
+
+        const cv::Mat &w = bundle.weights[l];
+
+        layer.weights = allocate<float>((size_t) layer.inSize * layer.outPadded);
+        layer.bias = allocate<float>((size_t) layer.outPadded);
+        for (int o = 0; o < layer.outSize; o++) {
+            double b = w.at<double>(layer.inSize, o);
+            for (int i = 0; i < layer.inSize; i++) {
+                double wio = w.at<double>(i, o);
+                if (l == 0) {
+                    b += inputScale[2 * i + 1] * wio;
+                    wio *= inputScale[2 * i];
+                } else {
+                    wio *= beta;
+                }
+                layer.weights[(size_t) i * layer.outPadded + o] = (float) (wio * half);
+            }
+            layer.bias[o] = (float) (b * half);
+        }
+        layers.push_back(std::move(layer));
+    }
+
+    // Last activation: beta * tanh, then output scaling
+    for (int o = 0; o < layerSizes.back(); o++) {
+        outputScale.push_back((float) (beta * outScale[2 * o]));
+        outputScale.push_back((float) outScale[2 * o + 1]);
+    }
+
+    allocateBuffers();
+    return Code::SUCCESS;
+}
+
+int MLPInference::loadQuantized(const cv::FileNode &root) {
+    std::vector<int> layerSizes;
+    root["layer_sizes"] >> layerSizes;
+    root["output_scale"] >> outputScale;
+
+    cv::FileNode layersNode = root["layers"];
+    if (layerSizes.size() < 2 || (int) layersNode.size() != (int) layerSizes.size() - 1
+        || (int) outputScale.size() != 2 * layerSizes.back()) {
+        return Code::ERROR;
+    }
+
+    int l = 0;
+    for (cv::FileNodeIterator it = layersNode.begin(); it != layersNode.end(); ++it, l++) {
+        QuantizedLayer layer;
+        layer.inSize = layerSizes[l];
+        layer.outSize = layerSizes[l + 1];
+        layer.inPadded = (layer.inSize + QUANTIZED_LANES - 1) / QUANTIZED_LANES * QUANTIZED_LANES;
+        layer.outPadded = (layer.outSize + QUANTIZED_NEURONS - 1) / QUANTIZED_NEURONS * QUANTIZED_NEURONS;
+
+        cv::Mat weights;
+        (*it)["input_scale"] >> layer.inputScale;
+        (*it)["weight_scales"] >> layer.weightScales;
+        (*it)["bias"] >> layer.bias;
+        (*it)["weights"] >> weights;
+        if (weights.type() != CV_8SC1 || weights.rows != layer.outSize || weights.cols != layer.inSize
+            || (int) layer.weightScales.size() != layer.outSize || (int) layer.bias.size() != layer.outSize
+            || layer.inputScale <= 0) {
+            return Code::ERROR;
+        }
+
+        layer.weights = allocate<int8_t>((size_t) layer.outPadded * layer.inPadded);
+        layer.outputScales.assign((size_t) layer.outPadded, 0);
+        for (int o = 0; o < layer.outSize; o++) {
+            std::memcpy(layer.weights.get() + (size_t) o * layer.inPadded, weights.ptr<int8_t>(o),
+                        (size_t) layer.inSize);
+            layer.outputScales[o] = layer.inputScale * layer.weightScales[o];
+        }
+        layer.bias.resize((size_t) layer.outPadded, 0);
+        quantizedLayers.push_back(std::move(layer));
+    }
+
+    allocateBuffers();
+    return Code::SUCCESS;
+}
+
+void MLPInference::allocateBuffers() {
+    int maxWidth = 0, maxInput = 0;
+    for (const Layer &layer : layers) {
+        maxWidth = std::max(maxWidth, std::max(layer.inSize, layer.outPadded));
+    }
+    for (const QuantizedLayer &layer : quantizedLayers) {
+        maxWidth = std::max(maxWidth, std::max(layer.inSize, layer.outPadded));
+        maxInput = std::max(maxInput, layer.inPadded);
+    }
+    buffers[0] = allocate<float>((size_t) maxWidth);
+    buffers[1] = allocate<float>((size_t) maxWidth);
+    quantizedInput = allocate<int16_t>((size_t) maxInput);
+}
+
+int MLPInference::quantize(const cv::Mat &calibrationData) {
+    if (layers.empty()) {
+        LOG_E("ERROR: No float model to quantize");
+        return Code::ERROR;
+    }
+    if (calibrationData.empty() || calibrationData.type() != CV_32FC1 || calibrationData.cols != getInputSize()) {
+        LOG_E("ERROR: Invalid calibration data (" << getInputSize() << " float columns expected)");
+        return Code::ERROR;
+    }
+
+    // Mean square value of every layer input, and range of the model input, with the float model
+    std::vector<std::vector<double>> energy;
+    for (const Layer &layer : layers) {
+        energy.emplace_back((size_t) layer.inSize, 0.0);
+    }
+    float maxInput = 0;
+    for (int r = 0; r < calibrationData.rows; r++) {
+        const float *in = calibrationData.ptr<float>(r);
+        for (int i = 0; i < layers.front().inSize; i++) {
+            maxInput = std::max(maxInput, std::abs(in[i]));
+        }
+        for (size_t l = 0; l < layers.size(); l++) {
+            for (int i = 0; i < layers[l].inSize; i++) {
+                energy[l][i] += (double) in[i] * in[i] / calibrationData.rows;
+            }
+            float *out = buffers[l & 1].get();
+            runLayer(layers[l], in, out);
+            in = out;
+        }
+    }
+
+    quantizedLayers.clear();
+    for (size_t l = 0; l < layers.size(); l++) {
+        const Layer &source = layers[l];
+        QuantizedLayer layer;
+        layer.inSize = source.inSize;
+        layer.outSize = source.outSize;
+        layer.inPadded = (source.inSize + QUANTIZED_LANES - 1) / QUANTIZED_LANES * QUANTIZED_LANES;
+        layer.outPadded = (source.outSize + QUANTIZED_NEURONS - 1) / QUANTIZED_NEURONS * QUANTIZED_NEURONS;
+        // Hidden layers inputs are tanh outputs, in [-1, 1]
+        layer.inputScale = l == 0 ? std::max(maxInput, 1e-6f) / QUANTIZED_MAX : 1.0f / QUANTIZED_MAX;
+        layer.weights = allocate<int8_t>((size_t) layer.outPadded * layer.inPadded);
+        layer.outputScales.assign((size_t) layer.outPadded, 0);
+        layer.bias.assign((size_t) layer.outPadded, 0);
+
+        std::vector<float> neuronWeights((size_t) source.inSize);
+        for (int o = 0; o < source.outSize; o++) {
+            for (int i = 0; i < source.inSize; i++) {
+                neuronWeights[i] = source.weights[(size_t) i * source.outPadded + o];
+            }
+            const float scale = weightScale(neuronWeights, energy[l]);
+            int8_t *row = layer.weights.get() + (size_t) o * layer.inPadded;
+            for (int i = 0; i < source.inSize; i++) {
+                row[i] = quantizeValue(neuronWeights[i], 1 / scale);
+            }
+            layer.weightScales.push_back(scale);
+            layer.outputScales[o] = layer.inputScale * scale;
+            layer.bias[o] = source.bias[o];
+        }
+        quantizedLayers.push_back(std::move(layer));
+    }
+
+    allocateBuffers();
+    return Code::SUCCESS;
+}
+
+bool MLPInference::isQuantized() const {
+    return !quantizedLayers.empty();
+}
+
+int MLPInference::saveQuantized(const std::string fileName) const {
+    if (quantizedLayers.empty()) {
+        LOG_E("ERROR: The model is not quantized");
+        return Code::ERROR;
+    }
+
+    cv::FileStorage fs(fileName, cv::FileStorage::WRITE);
+    if (!fs.isOpened()) {
+        LOG_E("ERROR: Could not write the classifier : " << fileName);
+        return Code::ERROR;
+    }
+
+    std::vector<int> layerSizes = {quantizedLayers.front().inSize};
+    for (const QuantizedLayer &layer : quantizedLayers) {
+        layerSizes.push_back(layer.outSize);
+    }
+
+    fs << QUANTIZED_NODE << "{";
+    fs << "layer_sizes" << layerSizes;
+    fs << "output_scale" << outputScale;
+    fs << "layers" << "[";
+    for (const QuantizedLayer &layer : quantizedLayers) {
+        cv::Mat weights(layer.outSize, layer.inSize, CV_8SC1);
+        for (int o = 0; o < layer.outSize; o++) {
+            std::memcpy(weights.ptr<int8_t>(o), layer.weights.get() + (size_t) o * layer.inPadded,
+                        (size_t) layer.inSize);
+        }
+        fs << "{";
+        fs << "input_scale" << layer.inputScale;
+        fs << "weight_scales" << layer.weightScales;
+        fs << "bias" << std::vector<float>(layer.bias.begin(), layer.bias.begin() + layer.outSize);
+        fs << "weights" << weights;
+        fs << "}";
+    }
+    fs << "]";
+    fs << "}";
+    return Code::SUCCESS;
+}
+
+size_t MLPInference::getWeightsSize() const {
+    size_t size = 0;
+    if (!quantizedLayers.empty()) {
+        for (const QuantizedLayer &layer : quantizedLayers) {
+            size += (size_t) layer.outPadded * layer.inPadded + 2 * layer.outPadded * sizeof(float);
+        }
+        return size;
+    }
+    for (const Layer &layer : layers) {
+        size += ((size_t) layer.inSize + 1) * layer.outPadded * sizeof(float);
+    }
+    return size;
+}
+
+bool MLPInference::isLoaded() const {
+    return !layers.empty() || !quantizedLayers.empty();
+}
+
+int MLPInference::getInputSize() const {
+    if (!quantizedLayers.empty()) {
+        return quantizedLayers.front().inSize;
+    }
+    return layers.empty() ? 0 : layers.front().inSize;
+}
+
+int MLPInference::getOutputSize() const {
+    if (!quantizedLayers.empty()) {
+        return quantizedLayers.back().outSize;
+    }
+    return layers.empty() ? 0 : layers.back().outSize;
+}
+
+int MLPInference::getNbOfLayers() const {
+    return (int) layers.size();
+}
+
+void MLPInference::getLayer(int index, std::vector<float> &weights, std::vector<float> &bias) const {
+    assert(index >= 0 && index < (int) layers.size());
+
+    const Layer &layer = layers[index];
+    weights.resize((size_t) layer.inSize * layer.outSize);
+    for (int i = 0; i < layer.inSize; i++) {
+        std::memcpy(&weights[(size_t) i * layer.outSize], layer.weights.get() + (size_t) i * layer.outPadded,
+                    layer.outSize * sizeof(float));
+    }
+    bias.assign(layer.bias.get(), layer.bias.get() + layer.outSize);
+}
+
+const std::vector<float> &MLPInference::getOutputScale() const {
+    return outputScale;
+}
+
+void MLPInference::runLayer(const Layer &layer, const float *input, float *output) const {
+    switch (isa) {
+#ifdef MLP_INFERENCE_X86
+        case AVX2:
+            layerAvx2(input, layer.inSize, layer.weights.get(), layer.bias.get(), layer.outPadded, output);
+            break;
+        case SSE:
+            layerSse(input, layer.inSize, layer.weights.get(), layer.bias.get(), layer.outPadded, output);
+            break;
+#endif
+        default:
+            layerScalar(input, layer.inSize, layer.weights.get(), layer.bias.get(), layer.outPadded, output);
+            break;
+    }
+}
+
+void MLPInference::runQuantizedLayer(const QuantizedLayer &layer, const float *input, float *output) {
+    int16_t *x = quantizedInput.get();
+    quantizeInput(input, layer.inSize, 1 / layer.inputScale, isa != SCALAR, x);
+    // The padding may hold the input of a wider layer
+    std::fill(x + layer.inSize, x + layer.inPadded, 0);
+
+    switch (isa) {
+#ifdef MLP_INFERENCE_X86
+        case AVX2:
+            quantizedLayerAvx2(x, layer.inPadded, layer.weights.get(), layer.outputScales.data(), layer.bias.data(),
+                               layer.outPadded, output);
+            break;
+        case SSE:
+            quantizedLayerSse(x, layer.inPadded, layer.weights.get(), layer.outputScales.data(), layer.bias.data(),
+                              layer.outPadded, output);
+            break;
+#endif
+        default:
+            quantizedLayerScalar(x, layer.inPadded, layer.weights.get(), layer.outputScales.data(),
+                                 layer.bias.data(), layer.outPadded, output);
+            break;
+    }
+}
+
+void MLPInference::forward(const float *input, float *output) {
+    const float *in = input;
+    if (!quantizedLayers.empty()) {
+        for (size_t l = 0; l < quantizedLayers.size(); l++) {
+            float *out = buffers[l & 1].get();
+            runQuantizedLayer(quantizedLayers[l], in, out);
+            in = out;
+        }
+    } else {
+        for (size_t l = 0; l < layers.size(); l++) {
+            float *out = buffers[l & 1].get();
+            runLayer(layers[l], in, out);
+            in = out;
+        }
+    }
+
+    const int outSize = getOutputSize();
+    for (int o = 0; o < outSize; o++) {
+        output[o] = in[o] * outputScale[2 * o] + outputScale[2 * o + 1];
+    }
+}
+
+std::pair<int, float> MLPInference::predict(const float *input, float *scores) {
+    assert(isLoaded());
+
+    float localScores[256];
+    std::vector<float> largeScores;
+    const int outSize = getOutputSize();
+    if (scores == nullptr) {
+        if (outSize <= 256) {
+            scores = localScores;
+        } else {
+            largeScores.resize((size_t) outSize);
+            scores = largeScores.data();
+        }
+    }
+
+    forward(input, scores);
+
+    int best = 0;
+    for (int o = 1; o < outSize; o++) {
+        if (scores[o] > scores[best]) {
+            best = o;
+        }
+    }
+    return {best, scores[best]};
+}
+
+std::pair<int, float> MLPInference::predict(const cv::Mat &input) {
+    assert(input.type() == CV_32FC1 && (int) input.total() == getInputSize());
+
+    if (input.isContinuous()) {
+        return predict(input.ptr<float>());
+    }
+    cv::Mat continuous = input.clone();
+    return predict(continuous.ptr<float>());
+}
+
+void MLPInference::predictBatch(const cv::Mat &input, cv::Mat &labels, cv::Mat &confidences, cv::Mat *scores) {
+    assert(isLoaded() && input.type() == CV_32FC1 && input.cols == getInputSize());
+
+    labels.create(input.rows, 1, CV_32SC1);
+    confidences.create(input.rows, 1, CV_32FC1);
+    if (scores != nullptr) {
+        scores->create(input.rows, getOutputSize(), CV_32FC1);
+    }
+
+    for (int i = 0; i < input.rows; i++) {
+        std::pair<int, float> prediction = predict(input.ptr<float>(i),
+                                                   scores != nullptr ? scores->ptr<float>(i) : nullptr);
+        labels.at<int>(i) = prediction.first;
+        confidences.at<float>(i) = prediction.second;
+    }
+}
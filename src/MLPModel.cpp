@@ -3,12 +3,16 @@
 //
 
 #include <chrono>
+#include <cstdio>
 #include <iterator>
 #include <fstream>
+#include <unistd.h>
 #include "../inc/MLPModel.hpp"
 #include "../inc/log.h"
 #include "../inc/code.h"
 #include "../inc/Timer.hpp"
+#include "../inc/ModelBundle.hpp"
+#include "../inc/constant.h"
 
 MLPModel::MLPModel(int nbOfHiddenLayer, int nbOfNeuron) {
     for (int i = 0; i < nbOfHiddenLayer; i++) {
@@ -42,6 +46,11 @@ void MLPModel::setMethodEpsilon(double epsilon) {
     this->methodEpsilon = epsilon;
 }
 
+void MLPModel::setOptimizer(const MLPTrainer::Params &params) {
+    nativeTraining = true;
+    trainerParams = params;
+}
+
 void MLPModel::setLabelMap(LabelMap labelMap) {
     this->labelMap = labelMap;
 }
@@ -78,28 +87,64 @@ void MLPModel::exportTrainDataDistribution(const std::string jsonFilePath) {
 }
 
 int MLPModel::learnFrom(const std::string classifier_file_name) {
+    LOGP_I(this, "Loading classifier...");
+    if (ModelBundle::isBundleFile(classifier_file_name)) {
+        ModelBundle bundle;
+        if (bundle.load(classifier_file_name) != Code::SUCCESS || learnFrom(bundle) != Code::SUCCESS) {
+            LOGP_E(this, "ERROR: Could not read the classifier : " << classifier_file_name);
+            return Code::CASCADE_LOAD_ERROR;
+        }
+        LOGP_I(this, "Classifier " << classifier_file_name << " successfully loaded!");
+        return Code::SUCCESS;
+    }
+
     model = cv::ml::StatModel::load<cv::ml::ANN_MLP>(classifier_file_name);
 
-    LOGP_I(this, "Loading classifier...");
     if (model.empty()) {
         LOGP_E(this, "ERROR: Could not read the classifier : " << classifier_file_name);
         return Code::CASCADE_LOAD_ERROR;
     } else {
-        cv::Mat layers = model.get()->getLayerSizes();
-        hiddenLayers.clear();
-        inputSize = model.get()->getLayerSizes().row(0).at<int>(0);
-        outputSize = model.get()->getLayerSizes().row(layers.rows - 1).at<int>(0);
-
-        for (int i = 1; i < layers.rows - 1; i++) {
-            int layerSize = model.get()->getLayerSizes().row(i).at<int>(0);
-            hiddenLayers.push_back(layerSize);
-        }
-
+        readLayerSizes();
         LOGP_I(this, "Classifier " << classifier_file_name << " successfully loaded!");
         return Code::SUCCESS;
     }
 }
 
+int MLPModel::learnFrom(const ModelBundle &bundle) {
+    // ANN_MLP can only be built from its serialized form: write the network in memory and read it back
+    cv::FileStorage out(".yml", cv::FileStorage::WRITE | cv::FileStorage::MEMORY);
+    out << "opencv_ml_ann_mlp" << "{";
+    bundle.writeNetwork(out);
+    out << "}";
+    cv::FileStorage in(out.releaseAndGetString(), cv::FileStorage::READ | cv::FileStorage::MEMORY);
+
+    cv::Ptr<cv::ml::ANN_MLP> loaded = cv::ml::ANN_MLP::create();
+    loaded->read(in["opencv_ml_ann_mlp"]);
+    if (!loaded->isTrained()) {
+        return Code::ERROR;
+    }
+
+    model = loaded;
+    readLayerSizes();
+    if (!bundle.labelMap.empty()) {
+        labelMap = bundle.labelMap;
+    }
+    feature = bundle.feature;
+    featureScale = bundle.featureScale;
+    return Code::SUCCESS;
+}
+
+void MLPModel::readLayerSizes() {
+    cv::Mat layers = model->getLayerSizes();
+    hiddenLayers.clear();
+    inputSize = layers.at<int>(0);
+    outputSize = layers.at<int>(layers.rows - 1);
+
+    for (int i = 1; i < layers.rows - 1; i++) {
+        hiddenLayers.push_back(layers.at<int>(i));
+    }
+}
+
 inline cv::TermCriteria MLPModel::TC(int iters, double eps) {
     return cv::TermCriteria(cv::TermCriteria::MAX_ITER + (eps > 0 ? cv::TermCriteria::EPS : 0), iters, eps);
 }
@@ -113,92 +158,336 @@ int MLPModel::learnFrom(const cv::Mat &trainingData, const cv::Mat &trainingResp
     const int nbOutputClasses = trainingData.cols;
     int nbOfSamples = trainingData.rows;
 
-    cv::Mat formattedResponses = cv::Mat::zeros(nbOfSamples, nbOutputClasses, CV_32FC1);
+    cv::Mat formattedResponses;
 
     // Unrolling the responses
     LOGP_I(this, "Formatting responses...");
     classesCountMap.clear();
+    countClasses(trainingResponses);
+    formatResponses(trainingResponses, nbOutputClasses, formattedResponses);
+    LOGP_I(this, "Formatting responses done!");
+
+    if (!jsonDistribFilePath.empty()) {
+        exportTrainDataDistribution(jsonDistribFilePath);
+    }
+
+    logTrainingComposition();
+
+    if (nativeTraining) {
+        createModel(trainingData.cols, nbOutputClasses);
+        MLPTrainer trainer(layerSizesFor(inputSize, outputSize), trainerParams);
+
+        LOGP_I(this, "Training the classifier (" << nbOfSamples << " samples, "
+                                                 << MLPTrainer::optimizerName(trainerParams.optimizer) << ", "
+                                                 << trainerParams.nbOfEpochs << " epochs) - layer pattern: "
+                                                 << getTopologyStr() << " (may take a few minutes)...");
+
+        trainer.initialize(trainingData, trainingResponses);
+        for (int epoch = 0; epoch < trainerParams.nbOfEpochs; epoch++) {
+            Timer epochMonitor;
+            epochMonitor.start();
+            MLPTrainer::Stats stats = trainer.trainEpoch(trainingData, trainingResponses, epoch);
+            epochMonitor.stop();
+            LOGP_I(this, "Epoch " << (epoch + 1) << "/" << trainerParams.nbOfEpochs << ": loss " << stats.loss
+                                  << ", training success " << 100. * stats.nbOfSuccesses / std::max(1, stats.nbOfSamples)
+                                  << "% (" << epochMonitor.getDurationS() << " s)");
+        }
+
+        if (loadTrainedNetwork(trainer) != Code::SUCCESS) {
+            LOGP_E(this, "ERROR: could not load the trained network");
+            return Code::ERROR;
+        }
+
+        timeMonitor.stop();
+        LOGP_I(this, "Training done! (" << timeMonitor.getDurationS() << " s)");
+        return Code::SUCCESS;
+    }
+
+    // Train classifier
+    cv::Ptr<cv::ml::TrainData> tData =
+            cv::ml::TrainData::create(trainingData, cv::ml::ROW_SAMPLE, formattedResponses);
+
+    createModel(trainingData.cols, nbOutputClasses);
+
+    LOGP_I(this, "Training the classifier (" << nbOfSamples << " samples) - layer pattern: " << getTopologyStr()
+                                             << " (may take a few minutes)...");
+
+    model->setTermCriteria(TC(maxIter, 0));
+    model->train(tData);
+
+    // End timer
+    timeMonitor.stop();
+
+    LOGP_I(this, "Training done! (" << timeMonitor.getDurationS() << " s)");
+
+    return Code::SUCCESS;
+}
+
+int MLPModel::learnFrom(DataBatchStream &stream, const int nbOfEpochs) {
+    Timer timeMonitor;
+
+    // Start timer
+    timeMonitor.start();
+
+    // Same output layer as the in-memory training, so that both kinds of model are interchangeable
+    const int nbOutputClasses = stream.getSampleSize();
+
+    createModel(stream.getSampleSize(), nbOutputClasses);
+
+    LOGP_I(this, "Training the classifier by mini-batches (" << stream.getNbOfSamples() << " samples, "
+                                                               << stream.getBatchSize() << " per batch, "
+                                                               << nbOfEpochs << " epochs) - layer pattern: "
+                                                               << getTopologyStr() << " (may take a few minutes)...");
+
+    cv::Mat batchData;
+    cv::Mat batchResponses;
+    cv::Mat formattedResponses;
+    bool initialized = false;
+
+    // Native training: the stream gives the samples and their order, each streamed batch is split in mini-batches
+    MLPTrainer::Params params = trainerParams;
+    params.nbOfEpochs = nbOfEpochs;
+    MLPTrainer trainer(layerSizesFor(inputSize, outputSize), params);
+
+    classesCountMap.clear();
+    for (int epoch = 0; epoch < nbOfEpochs; epoch++) {
+        int nbOfBatches = 0;
+        double epochLoss = 0;
+        int epochSamples = 0, epochSuccesses = 0;
+        stream.startEpoch(epoch);
+
+        while (stream.nextBatch(batchData, batchResponses)) {
+            // Training data distribution is the one of a whole pass
+            if (epoch == 0) {
+                countClasses(batchResponses);
+            }
+            if (nativeTraining) {
+                if (!initialized) {
+                    trainer.initialize(batchData, batchResponses);
+                    initialized = true;
+                }
+                MLPTrainer::Stats stats = trainer.trainOn(batchData, batchResponses);
+                epochLoss += stats.loss * stats.nbOfSamples;
+                epochSamples += stats.nbOfSamples;
+                epochSuccesses += stats.nbOfSuccesses;
+                nbOfBatches++;
+                continue;
+            }
+
+            formatResponses(batchResponses, nbOutputClasses, formattedResponses);
+
+            cv::Ptr<cv::ml::TrainData> tData =
+                    cv::ml::TrainData::create(batchData, cv::ml::ROW_SAMPLE, formattedResponses);
+
+            if (!initialized) {
+                // First batch initializes the weights and the input/output scaling
+                model->setTermCriteria(TC(1, 0));
+                model->train(tData);
+                initialized = true;
+            } else {
+                model->train(tData, cv::ml::ANN_MLP::UPDATE_WEIGHTS);
+            }
+            nbOfBatches++;
+        }
+
+        if (epoch == 0 && !classesCountMap.empty()) {
+            if (!jsonDistribFilePath.empty()) {
+                exportTrainDataDistribution(jsonDistribFilePath);
+            }
+            logTrainingComposition();
+        }
+
+        if (nativeTraining) {
+            LOGP_I(this, "Epoch " << (epoch + 1) << "/" << nbOfEpochs << " done (" << nbOfBatches << " batches): loss "
+                                  << epochLoss / std::max(1, epochSamples) << ", training success "
+                                  << 100. * epochSuccesses / std::max(1, epochSamples) << "%");
+        } else {
+            LOGP_I(this, "Epoch " << (epoch + 1) << "/" << nbOfEpochs << " done (" << nbOfBatches << " batches)");
+        }
+    }
+    stream.stop();
+
+    // End timer
+    timeMonitor.stop();
+
+    if (!initialized) {
+        LOGP_E(this, "ERROR: no training data in " << stream.getSource());
+        return Code::ERROR;
+    }
+
+    if (nativeTraining && loadTrainedNetwork(trainer) != Code::SUCCESS) {
+        LOGP_E(this, "ERROR: could not load the trained network");
+        return Code::ERROR;
+    }
+
+    LOGP_I(this, "Training done! (" << timeMonitor.getDurationS() << " s)");
+
+    return Code::SUCCESS;
+}
+
+void MLPModel::formatResponses(const cv::Mat &responses, const int nbOutputClasses, cv::Mat &formattedResponses) {
+    const int nbOfSamples = (int) responses.total();
+    formattedResponses = cv::Mat::zeros(nbOfSamples, nbOutputClasses, CV_32FC1);
+
     for (int i = 0; i < nbOfSamples; i++) {
-        int response = trainingResponses.at<int>(i);
-        formattedResponses.at<float>(i, response) = 1.f;
+        formattedResponses.at<float>(i, responses.at<int>(i)) = 1.f;
+    }
+}
 
+void MLPModel::countClasses(const cv::Mat &responses) {
+    const int nbOfSamples = (int) responses.total();
+    for (int i = 0; i < nbOfSamples; i++) {
+        int response = responses.at<int>(i);
         if (classesCountMap.find(response) == classesCountMap.end()) {
             classesCountMap[response] = 0;
         }
         classesCountMap[response]++;
     }
-    LOGP_I(this, "Formatting responses done!");
-
-    if (!jsonDistribFilePath.empty()) {
-        exportTrainDataDistribution(jsonDistribFilePath);
-    }
+}
 
+void MLPModel::logTrainingComposition() {
     LOGP_I(this, "Training samples composition: ");
     for (auto it = classesCountMap.begin(); it != classesCountMap.end(); ++it) {
         std::string key = labelMap.get(it->first);
         LOGP_I(this, " - " << key << " * " << it->second);
     }
     LOGP_I(this, "");
+}
 
-    // Create and configure layers
+std::vector<int> MLPModel::layerSizesFor(const int nbInputs, const int nbOutputClasses) const {
     std::vector<int> layerSizes;
-    layerSizes.push_back(trainingData.cols);
+    layerSizes.push_back(nbInputs);
     for (int i = 0; i < hiddenLayers.size(); i++) {
         layerSizes.push_back(hiddenLayers[i]);
     }
     layerSizes.push_back(nbOutputClasses);
+    return layerSizes;
+}
 
-    // Train classifier
-    cv::Ptr<cv::ml::TrainData> tData =
-            cv::ml::TrainData::create(trainingData, cv::ml::ROW_SAMPLE, formattedResponses);
-
-    LOGP_I(this, "Training the classifier (" << nbOfSamples << " samples) - layer pattern: " << getTopologyStr()
-                                             << " (may take a few minutes)...");
+void MLPModel::createModel(const int nbInputs, const int nbOutputClasses) {
+    inputSize = nbInputs;
+    outputSize = nbOutputClasses;
 
+    // Create and configure layers
     model = cv::ml::ANN_MLP::create();
-    model->setLayerSizes(layerSizes);
+    model->setLayerSizes(layerSizesFor(nbInputs, nbOutputClasses));
     model->setActivationFunction(cv::ml::ANN_MLP::SIGMOID_SYM);
-    model->setTermCriteria(TC(maxIter, 0));
     model->setTrainMethod(method, methodEpsilon);
-    model->train(tData);
-
-    // End timer
-    timeMonitor.stop();
-
-    LOGP_I(this, "Training done! (" << timeMonitor.getDurationS() << " s)");
+}
 
-    return Code::SUCCESS;
+int MLPModel::loadTrainedNetwork(const MLPTrainer &trainer) {
+    ModelBundle bundle;
+    trainer.toBundle(bundle);
+    bundle.feature = feature;
+    bundle.featureScale = featureScale;
+    bundle.labelMap = labelMap;
+    return learnFrom(bundle);
 }
 
 std::pair<int, float> MLPModel::predict(cv::Mat &input) {
+    // Per thread, not per model: threads sharing a model do not share buffers
+    static thread_local cv::Mat predictLabels, predictConfidences;
+    predictBatch(input, predictLabels, predictConfidences);
+    return {predictLabels.at<int>(0), predictConfidences.at<float>(0)};
+}
+
+void MLPModel::predictBatch(const cv::Mat &input, cv::Mat &labels, cv::Mat &confidences, cv::Mat *scores) {
     assert(model->isTrained());
 
-    std::vector<float> output;
-    int result = (int) model->predict(input, output);
-    return {result, output[result]};
+    // One pass of the network for all the rows
+    static thread_local cv::Mat predictScores;
+    cv::Mat &output = scores != nullptr ? *scores : predictScores;
+    model->predict(input, output);
+
+    labels.create(output.rows, 1, CV_32SC1);
+    confidences.create(output.rows, 1, CV_32FC1);
+    for (int i = 0; i < output.rows; i++) {
+        const float *row = output.ptr<float>(i);
+        int best = 0;
+        for (int c = 1; c < output.cols; c++) {
+            if (row[c] > row[best]) {
+                best = c;
+            }
+        }
+        labels.at<int>(i) = best;
+        confidences.at<float>(i) = row[best];
+    }
 }
 
 int MLPModel::exportModelTo(const std::string xmlFileName) {
     assert(model->isTrained());
 
-    if (!xmlFileName.empty()) {
-        LOGP_I(this, "Exporting model to " + xmlFileName);
-        model->save(xmlFileName);
+    const std::string &ext = Default::MODEL_BUNDLE_EXT;
+    if (xmlFileName.size() > ext.size() && xmlFileName.compare(xmlFileName.size() - ext.size(), ext.size(), ext) == 0) {
+        LOGP_I(this, "Exporting model bundle to " + xmlFileName);
+        ModelBundle bundle;
+        if (toBundle(bundle) != Code::SUCCESS || bundle.save(xmlFileName) != Code::SUCCESS) {
+            LOGP_E(this, "ERROR: model not exported");
+            return Code::ERROR;
+        }
         LOGP_I(this, "Model successfully exported");
         return Code::SUCCESS;
     }
 
+    if (!xmlFileName.empty()) {
+        LOGP_I(this, "Exporting model to " + xmlFileName);
+        // Temporary file then rename: an interrupted export never leaves a truncated model behind.
+        // The temporary file keeps the extension, which selects the format.
+        size_t extPos = xmlFileName.find_last_of("./");
+        std::string tmpPath = xmlFileName + Default::TMP_FILE_INFIX + std::to_string(getpid())
+                              + (extPos != std::string::npos && xmlFileName[extPos] == '.' ? xmlFileName.substr(extPos) : "");
+        cv::FileStorage fs(tmpPath, cv::FileStorage::WRITE);
+        if (fs.isOpened()) {
+            fs << model->getDefaultName() << "{";
+            model->write(fs);
+            fs << "}";
+            fs.release();
+            if (std::rename(tmpPath.c_str(), xmlFileName.c_str()) == 0) {
+                LOGP_I(this, "Model successfully exported");
+                return Code::SUCCESS;
+            }
+        }
+        std::remove(tmpPath.c_str());
+    }
+
     LOGP_E(this, "ERROR: model not exported");
     return Code::ERROR;
 }
 
+int MLPModel::toBundle(ModelBundle &bundle) const {
+    // Weights and activation parameters are only available through the serialized form of ANN_MLP
+    cv::FileStorage out(".yml", cv::FileStorage::WRITE | cv::FileStorage::MEMORY);
+    out << "opencv_ml_ann_mlp" << "{";
+    model->write(out);
+    out << "}";
+    cv::FileStorage in(out.releaseAndGetString(), cv::FileStorage::READ | cv::FileStorage::MEMORY);
+    if (bundle.readNetwork(in["opencv_ml_ann_mlp"]) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+
+    bundle.feature = feature;
+    bundle.featureScale = featureScale;
+    bundle.labelMap = labelMap;
+    return Code::SUCCESS;
+}
+
 std::pair<double, std::map<int, StatPredict *>>
 MLPModel::testOn(const cv::Mat &testData, const cv::Mat &testResponses) {
     assert(model->isTrained());
 
+    // Predict the whole test set at once
+    cv::Mat predictions, trusts, outputs;
+    predictBatch(testData, predictions, trusts, &outputs);
+
+    return collectStats(testResponses, predictions, trusts, outputs);
+}
+
+std::pair<double, std::map<int, StatPredict *>>
+MLPModel::collectStats(const cv::Mat &testResponses, const cv::Mat &predictions, const cv::Mat &trusts,
+                       const cv::Mat &outputs) {
     std::map<int, StatPredict *> statMap;
 
-    int nbOfSamples = testData.rows;
+    int nbOfSamples = predictions.rows;
     int totalSuccess = 0;
 
     // Compute prediction error on test data
@@ -207,10 +496,10 @@ MLPModel::testOn(const cv::Mat &testData, const cv::Mat &testResponses) {
         // Get response
         int response = testResponses.at<int>(i);
 
-        // Predict output
-        std::vector<float> predictOutput;
-        int prediction = (int) model->predict(testData.row(i), predictOutput);
-        float trustPercentage = predictOutput[prediction];
+        // Predicted output
+        int prediction = predictions.at<int>(i);
+        float trustPercentage = trusts.at<float>(i);
+        std::vector<float> predictOutput(outputs.ptr<float>(i), outputs.ptr<float>(i) + outputs.cols);
 
         // Check if already in the stat map
         if (statMap.find(response) == statMap.end()) {
@@ -242,6 +531,24 @@ std::string MLPModel::getTopologyStr() {
     return patternStream.str();
 }
 
+int MLPModel::getInputSize() const {
+    return inputSize;
+}
+
+int MLPModel::getOutputSize() const {
+    return outputSize;
+}
+
+long MLPModel::estimateNbOfWeights(int nbInputs, int nbOutputClasses) const {
+    long nbOfWeights = 0;
+    int previous = nbInputs;
+    for (int neurons : hiddenLayers) {
+        nbOfWeights += (long) (previous + 1) * neurons;
+        previous = neurons;
+    }
+    return nbOfWeights + (long) (previous + 1) * nbOutputClasses;
+}
+
 std::string MLPModel::convertLabel(int label) {
     return labelMap.get(label);
 }
@@ -249,3 +556,16 @@ std::string MLPModel::convertLabel(int label) {
 const LabelMap &MLPModel::getLabelMap() const {
     return labelMap;
 }
+
+void MLPModel::setFeature(const std::string &feature, double featureScale) {
+    this->feature = feature;
+    this->featureScale = featureScale;
+}
+
+const std::string &MLPModel::getFeature() const {
+    return feature;
+}
+
+double MLPModel::getFeatureScale() const {
+    return featureScale;
+}
@@ -0,0 +1,343 @@
+//
+// @author Loris Friedel
+//
+
+#include <cv.hpp>
+#include <ml.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include "../inc/MLPTrainer.hpp"
+#include "../inc/ModelBundle.hpp"
+#include "../inc/code.h"
+
+const int MLPTrainer::SHARD_SIZE;
+constexpr double MLPTrainer::ALPHA;
+constexpr double MLPTrainer::BETA;
+constexpr double MLPTrainer::MAX_VAL;
+constexpr double MLPTrainer::MAX_VAL1;
+
+int MLPTrainer::parseOptimizer(const std::string &name, Optimizer &optimizer) {
+    for (Optimizer candidate : {SGD, MOMENTUM, ADAM}) {
+        if (name == optimizerName(candidate)) {
+            optimizer = candidate;
+            return Code::SUCCESS;
+        }
+    }
+    return Code::ERROR;
+}
+
+std::string MLPTrainer::optimizerName(Optimizer optimizer) {
+    switch (optimizer) {
+        case SGD:
+            return "sgd";
+        case MOMENTUM:
+            return "momentum";
+        default:
+            return "adam";
+    }
+}
+
+MLPTrainer::MLPTrainer(const std::vector<int> &layerSizes, const Params &params)
+        : layerSizes(layerSizes), params(params) {}
+
+void MLPTrainer::initialize(const cv::Mat &data, const cv::Mat &responses) {
+    const int nbInputs = layerSizes.front();
+    const int nbOutputs = layerSizes.back();
+
+    // Inputs: zero mean and unit variance, as ANN_MLP
+    inputScale.assign((size_t) 2 * nbInputs, 0);
+    for (int i = 0; i < data.rows; i++) {
+        const float *row = data.ptr<float>(i);
+        for (int j = 0; j < nbInputs; j++) {
+            inputScale[2 * j] += row[j];
+            inputScale[2 * j + 1] += (double) row[j] * row[j];
+        }
+    }
+    for (int j = 0; j < nbInputs; j++) {
+        double mean = inputScale[2 * j] / std::max(1, data.rows);
+        double sigma = std::sqrt(std::max(0., inputScale[2 * j + 1] / std::max(1, data.rows) - mean * mean));
+        inputScale[2 * j] = sigma < DBL_EPSILON ? 1 : 1 / sigma;
+        inputScale[2 * j + 1] = -mean * inputScale[2 * j];
+    }
+
+    // Outputs: the range of each one-hot response mapped to [-MAX_VAL, MAX_VAL], as ANN_MLP
+    std::vector<double> minResponse((size_t) nbOutputs, 1), maxResponse((size_t) nbOutputs, 0);
+    for (int i = 0; i < responses.rows * responses.cols; i++) {
+        int label = responses.at<int>(i);
+        for (int j = 0; j < nbOutputs; j++) {
+            double response = j == label ? 1 : 0;
+            minResponse[j] = std::min(minResponse[j], response);
+            maxResponse[j] = std::max(maxResponse[j], response);
+        }
+    }
+    outputScale.assign((size_t) 2 * nbOutputs, 0);
+    invOutputScale.assign((size_t) 2 * nbOutputs, 0);
+    for (int j = 0; j < nbOutputs; j++) {
+        double delta = maxResponse[j] - minResponse[j];
+        double a = 1, b = -(maxResponse[j] + minResponse[j]) * 0.5;
+        if (delta >= DBL_EPSILON) {
+            a = 2 * MAX_VAL / delta;
+            b = -MAX_VAL - minResponse[j] * a;
+        }
+        invOutputScale[2 * j] = a;
+        invOutputScale[2 * j + 1] = b;
+        outputScale[2 * j] = 1 / a;
+        outputScale[2 * j + 1] = -b / a;
+    }
+
+    // Weights: uniform, scaled to the layer fan-in and fan-out; bias: zero
+    std::mt19937 engine(params.seed);
+    weights.clear();
+    velocities.clear();
+    squares.clear();
+    for (size_t l = 0; l + 1 < layerSizes.size(); l++) {
+        const int inSize = layerSizes[l], outSize = layerSizes[l + 1];
+        std::uniform_real_distribution<float> uniform(-1, 1);
+        const float limit = (float) std::sqrt(6.0 / (inSize + outSize));
+
+        cv::Mat layer = cv::Mat::zeros(inSize + 1, outSize, CV_32FC1);
+        for (int i = 0; i < inSize; i++) {
+            float *row = layer.ptr<float>(i);
+            for (int o = 0; o < outSize; o++) {
+                row[o] = uniform(engine) * limit;
+            }
+        }
+        weights.push_back(layer);
+        velocities.push_back(cv::Mat::zeros(inSize + 1, outSize, CV_32FC1));
+        squares.push_back(cv::Mat::zeros(inSize + 1, outSize, CV_32FC1));
+    }
+    nbOfSteps = 0;
+}
+
+MLPTrainer::Stats MLPTrainer::trainEpoch(const cv::Mat &data, const cv::Mat &responses, int epoch) {
+    std::vector<int> order((size_t) data.rows);
+    std::iota(order.begin(), order.end(), 0);
+    std::mt19937 engine(params.seed + 1 + (unsigned int) epoch);
+    std::shuffle(order.begin(), order.end(), engine);
+
+    Stats stats;
+    const size_t batchSize = (size_t) std::max(1, params.batchSize);
+    for (size_t begin = 0; begin < order.size(); begin += batchSize) {
+        step(data, responses, order, begin, std::min(order.size(), begin + batchSize), stats);
+    }
+    stats.loss /= std::max(1, stats.nbOfSamples);
+    return stats;
+}
+
+MLPTrainer::Stats MLPTrainer::trainOn(const cv::Mat &data, const cv::Mat &responses) {
+    std::vector<int> order((size_t) data.rows);
+    std::iota(order.begin(), order.end(), 0);
+
+    Stats stats;
+    const size_t batchSize = (size_t) std::max(1, params.batchSize);
+    for (size_t begin = 0; begin < order.size(); begin += batchSize) {
+        step(data, responses, order, begin, std::min(order.size(), begin + batchSize), stats);
+    }
+    stats.loss /= std::max(1, stats.nbOfSamples);
+    return stats;
+}
+
+void MLPTrainer::step(const cv::Mat &data, const cv::Mat &responses, const std::vector<int> &order, size_t begin,
+                      size_t end, Stats &stats) {
+    const int count = (int) (end - begin);
+    const int nbShards = (count + SHARD_SIZE - 1) / SHARD_SIZE;
+    for (int s = 0; s < nbShards; s++) {
+        shardAt((size_t) s).stats = Stats();
+    }
+
+    cv::parallel_for_(cv::Range(0, nbShards), [&](const cv::Range &range) {
+        for (int s = range.start; s < range.end; s++) {
+            computeShard(shards[s], data, responses, &order[begin + (size_t) s * SHARD_SIZE],
+                         std::min(SHARD_SIZE, count - s * SHARD_SIZE));
+        }
+    });
+
+    // Fixed order reduction
+    std::vector<cv::Mat> &gradients = shards[0].gradients;
+    for (int s = 0; s < nbShards; s++) {
+        if (s > 0) {
+            for (size_t l = 0; l < gradients.size(); l++) {
+                cv::add(gradients[l], shards[s].gradients[l], gradients[l]);
+            }
+        }
+        stats.loss += shards[s].stats.loss;
+        stats.nbOfSamples += shards[s].stats.nbOfSamples;
+        stats.nbOfSuccesses += shards[s].stats.nbOfSuccesses;
+    }
+
+    applyGradients(gradients, count);
+}
+
+void MLPTrainer::computeShard(Shard &shard, const cv::Mat &data, const cv::Mat &responses, const int *rows,
+                              int count) {
+    const int nbLayers = (int) weights.size();
+    const int nbInputs = layerSizes.front();
+    const int nbOutputs = layerSizes.back();
+    const float halfAlpha = (float) (ALPHA / 2);
+    const float beta = (float) BETA;
+
+    // Scaled input
+    cv::Mat input = shard.activations[0].rowRange(0, count);
+    for (int i = 0; i < count; i++) {
+        const float *src = data.ptr<float>(rows[i]);
+        float *dst = input.ptr<float>(i);
+        for (int j = 0; j < nbInputs; j++) {
+            dst[j] = (float) (src[j] * inputScale[2 * j] + inputScale[2 * j + 1]);
+        }
+    }
+
+    // Forward
+    for (int l = 0; l < nbLayers; l++) {
+        const int inSize = layerSizes[l], outSize = layerSizes[l + 1];
+        cv::Mat in = shard.activations[l].rowRange(0, count);
+        cv::Mat out = shard.activations[l + 1].rowRange(0, count);
+        cv::gemm(in, weights[l].rowRange(0, inSize), 1, cv::noArray(), 0, out);
+
+        const float *bias = weights[l].ptr<float>(inSize);
+        for (int i = 0; i < count; i++) {
+            float *y = out.ptr<float>(i);
+            for (int o = 0; o < outSize; o++) {
+                y[o] = beta * std::tanh(halfAlpha * (y[o] + bias[o]));
+            }
+        }
+    }
+
+    // Output error: squared distance to the scaled one-hot target, then through the activation derivative
+    // f'(s) = alpha / 2 * (beta - f(s)^2 / beta)
+    cv::Mat output = shard.activations[nbLayers].rowRange(0, count);
+    cv::Mat outputDelta = shard.deltas[nbLayers - 1].rowRange(0, count);
+    for (int i = 0; i < count; i++) {
+        const int label = responses.at<int>(rows[i]);
+        const float *y = output.ptr<float>(i);
+        float *delta = outputDelta.ptr<float>(i);
+
+        int best = 0;
+        double bestScore = -DBL_MAX;
+        for (int o = 0; o < nbOutputs; o++) {
+            double target = (o == label ? 1 : 0) * invOutputScale[2 * o] + invOutputScale[2 * o + 1];
+            double error = y[o] - target;
+            shard.stats.loss += error * error;
+            delta[o] = (float) error * halfAlpha * (beta - y[o] * y[o] / beta);
+
+            double score = y[o] * outputScale[2 * o] + outputScale[2 * o + 1];
+            if (score > bestScore) {
+                bestScore = score;
+                best = o;
+            }
+        }
+        shard.stats.nbOfSuccesses += best == label ? 1 : 0;
+    }
+    shard.stats.nbOfSamples += count;
+
+    // Backward
+    for (int l = nbLayers - 1; l >= 0; l--) {
+        const int inSize = layerSizes[l], outSize = layerSizes[l + 1];
+        cv::Mat in = shard.activations[l].rowRange(0, count);
+        cv::Mat delta = shard.deltas[l].rowRange(0, count);
+
+        cv::Mat weightsGradient = shard.gradients[l].rowRange(0, inSize);
+        cv::gemm(in, delta, 1, cv::noArray(), 0, weightsGradient, cv::GEMM_1_T);
+
+        float *biasGradient = shard.gradients[l].ptr<float>(inSize);
+        std::fill(biasGradient, biasGradient + outSize, 0.f);
+        for (int i = 0; i < count; i++) {
+            const float *d = delta.ptr<float>(i);
+            for (int o = 0; o < outSize; o++) {
+                biasGradient[o] += d[o];
+            }
+        }
+
+        if (l > 0) {
+            cv::Mat previousDelta = shard.deltas[l - 1].rowRange(0, count);
+            cv::gemm(delta, weights[l].rowRange(0, inSize), 1, cv::noArray(), 0, previousDelta, cv::GEMM_2_T);
+            for (int i = 0; i < count; i++) {
+                const float *y = in.ptr<float>(i);
+                float *d = previousDelta.ptr<float>(i);
+                for (int j = 0; j < inSize; j++) {
+                    d[j] *= halfAlpha * (beta - y[j] * y[j] / beta);
+                }
+            }
+        }
+    }
+}
+
+void MLPTrainer::applyGradients(const std::vector<cv::Mat> &gradients, int batchSize) {
+    nbOfSteps++;
+    const float rate = (float) params.learningRate;
+    const float gradientScale = 1.f / (float) std::max(1, batchSize);
+    const float momentum = (float) params.momentum;
+    const float beta1 = (float) params.beta1, beta2 = (float) params.beta2;
+    // Adam bias corrections, folded in the step size
+    const float adamRate = (float) (params.learningRate * std::sqrt(1 - std::pow(params.beta2, (double) nbOfSteps))
+                                    / (1 - std::pow(params.beta1, (double) nbOfSteps)));
+    const float epsilon = (float) params.epsilon;
+
+    for (size_t l = 0; l < weights.size(); l++) {
+        float *w = weights[l].ptr<float>();
+        float *v = velocities[l].ptr<float>();
+        float *v2 = squares[l].ptr<float>();
+        const float *g = gradients[l].ptr<float>();
+        const size_t size = weights[l].total();
+
+        for (size_t k = 0; k < size; k++) {
+            const float gk = g[k] * gradientScale;
+            switch (params.optimizer) {
+                case SGD:
+                    w[k] -= rate * gk;
+                    break;
+                case MOMENTUM:
+                    v[k] = momentum * v[k] - rate * gk;
+                    w[k] += v[k];
+                    break;
+                case ADAM:
+                    v[k] = beta1 * v[k] + (1 - beta1) * gk;
+                    v2[k] = beta2 * v2[k] + (1 - beta2) * gk * gk;
+                    w[k] -= adamRate * v[k] / (std::sqrt(v2[k]) + epsilon);
+                    break;
+            }
+        }
+    }
+}
+
+MLPTrainer::Shard &MLPTrainer::shardAt(size_t index) {
+    while (shards.size() <= index) {
+        Shard shard;
+        for (size_t l = 0; l < layerSizes.size(); l++) {
+            shard.activations.push_back(cv::Mat(SHARD_SIZE, layerSizes[l], CV_32FC1));
+        }
+        for (size_t l = 0; l + 1 < layerSizes.size(); l++) {
+            shard.deltas.push_back(cv::Mat(SHARD_SIZE, layerSizes[l + 1], CV_32FC1));
+            shard.gradients.push_back(cv::Mat(layerSizes[l] + 1, layerSizes[l + 1], CV_32FC1));
+        }
+        shards.push_back(shard);
+    }
+    return shards[index];
+}
+
+void MLPTrainer::toBundle(ModelBundle &bundle) const {
+    bundle.layerSizes = layerSizes;
+    bundle.activation = cv::ml::ANN_MLP::SIGMOID_SYM;
+    bundle.activationParam1 = ALPHA;
+    bundle.activationParam2 = BETA;
+    bundle.minVal = -MAX_VAL;
+    bundle.maxVal = MAX_VAL;
+    bundle.minVal1 = -MAX_VAL1;
+    bundle.maxVal1 = MAX_VAL1;
+    bundle.inputScale = cv::Mat(inputScale, true).reshape(1, 1);
+    bundle.outputScale = cv::Mat(outputScale, true).reshape(1, 1);
+    bundle.invOutputScale = cv::Mat(invOutputScale, true).reshape(1, 1);
+
+    bundle.weights.clear();
+    for (const cv::Mat &layer : weights) {
+        cv::Mat layer64;
+        layer.convertTo(layer64, CV_64F);
+        bundle.weights.push_back(layer64);
+    }
+}
+
+const MLPTrainer::Params &MLPTrainer::getParams() const {
+    return params;
+}
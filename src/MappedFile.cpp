@@ -0,0 +1,124 @@
+//
+// @author Loris Friedel
+//
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../inc/MappedFile.hpp"
+#include "../inc/code.h"
+#include "../inc/log.h"
+
+namespace {
+    /**
+     * Allocator used by matrices created with MappedFile::wrap.
+     * The matrix reference counter drives the lifetime of the mapping through a shared pointer
+     * stored in the UMatData user data. Any reallocation of such a matrix falls back to the standard allocator.
+     */
+    class MappedMatAllocator : public cv::MatAllocator {
+    public:
+        cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                               int flags, cv::UMatUsageFlags usageFlags) const override {
+            return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+        }
+
+        bool allocate(cv::UMatData *data, int accessflags, cv::UMatUsageFlags usageFlags) const override {
+            return cv::Mat::getStdAllocator()->allocate(data, accessflags, usageFlags);
+        }
+
+        void deallocate(cv::UMatData *u) const override {
+            if (u == nullptr) {
+                return;
+            }
+            delete static_cast<std::shared_ptr<MappedFile> *>(u->userdata);
+            u->userdata = nullptr;
+            u->data = u->origdata = nullptr;
+            delete u;
+        }
+    };
+
+    MappedMatAllocator *mappedMatAllocator() {
+        static MappedMatAllocator allocator;
+        return &allocator;
+    }
+}
+
+MappedFile::MappedFile(std::string filePath)
+        : filePath(filePath), mapped(nullptr), mappedSize(0) {}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+int MappedFile::open(bool prefetch) {
+    close();
+
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_E("ERROR: Could not open " << filePath);
+        return Code::ERROR;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        LOG_E("ERROR: Could not stat (or empty file) " << filePath);
+        ::close(fd);
+        return Code::ERROR;
+    }
+
+    void *addr = mmap(nullptr, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping stays valid after the descriptor is closed
+
+    if (addr == MAP_FAILED) {
+        LOG_E("ERROR: Could not map " << filePath);
+        return Code::ERROR;
+    }
+
+    mapped = static_cast<unsigned char *>(addr);
+    mappedSize = (size_t) st.st_size;
+    madvise(mapped, mappedSize, prefetch ? MADV_WILLNEED : MADV_RANDOM);
+
+    return Code::SUCCESS;
+}
+
+void MappedFile::close() {
+    if (mapped != nullptr) {
+        munmap(mapped, mappedSize);
+        mapped = nullptr;
+        mappedSize = 0;
+    }
+}
+
+bool MappedFile::isOpened() const {
+    return mapped != nullptr;
+}
+
+const unsigned char *MappedFile::data() const {
+    return mapped;
+}
+
+size_t MappedFile::size() const {
+    return mappedSize;
+}
+
+const std::string &MappedFile::getFilePath() const {
+    return filePath;
+}
+
+cv::Mat MappedFile::wrap(const std::shared_ptr<MappedFile> &file, size_t offset, int rows, int cols, int type) {
+    assert(file && file->isOpened());
+
+    unsigned char *begin = file->mapped + offset;
+    cv::Mat result(rows, cols, type, begin);
+
+    cv::UMatData *u = new cv::UMatData(mappedMatAllocator());
+    u->data = u->origdata = begin;
+    u->size = result.total() * result.elemSize();
+    u->userdata = new std::shared_ptr<MappedFile>(file);
+    u->refcount = 1;
+
+    result.u = u;
+    result.allocator = mappedMatAllocator();
+    return result;
+}
@@ -0,0 +1,330 @@
+//
+// @author Loris Friedel
+//
+
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../inc/ModelBundle.hpp"
+#include "../inc/constant.h"
+#include "../inc/code.h"
+#include "../inc/log.h"
+
+namespace {
+    // Index: cv::ml::ANN_MLP::ActivationFunctions
+    const char *const ACTIVATION_NAMES[] = {"IDENTITY", "SIGMOID_SYM", "GAUSSIAN", "RELU", "LEAKYRELU"};
+    const int NB_OF_ACTIVATIONS = sizeof(ACTIVATION_NAMES) / sizeof(ACTIVATION_NAMES[0]);
+
+    void writePadding(std::ofstream &out, uint64_t from, uint64_t to) {
+        static const char zeros[MLPBundle::ALIGNMENT] = {0};
+        if (to > from) {
+            out.write(zeros, to - from);
+        }
+    }
+
+    void writeMat(std::ofstream &out, const cv::Mat &mat) {
+        cv::Mat continuous = mat.isContinuous() ? mat : mat.clone();
+        out.write(reinterpret_cast<const char *>(continuous.data), continuous.total() * continuous.elemSize());
+    }
+
+    std::vector<double> toVector(const cv::Mat &mat) {
+        cv::Mat continuous = mat.isContinuous() ? mat : mat.clone();
+        const double *values = continuous.ptr<double>();
+        return std::vector<double>(values, values + continuous.total());
+    }
+}
+
+bool ModelBundle::isBundleFile(const std::string &filePath) {
+    struct stat st;
+    if (stat(filePath.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+
+    std::ifstream in(filePath, std::ifstream::binary);
+    char magic[sizeof(MLPBundle::MAGIC)];
+    if (!in.read(magic, sizeof(magic))) {
+        return false;
+    }
+    return std::memcmp(magic, MLPBundle::MAGIC, sizeof(magic)) == 0;
+}
+
+std::string ModelBundle::activationName(int activation) {
+    return activation >= 0 && activation < NB_OF_ACTIVATIONS ? ACTIVATION_NAMES[activation] : "unknown";
+}
+
+int ModelBundle::getInputSize() const {
+    return layerSizes.empty() ? 0 : layerSizes.front();
+}
+
+int ModelBundle::getOutputSize() const {
+    return layerSizes.empty() ? 0 : layerSizes.back();
+}
+
+uint64_t ModelBundle::scalesBytes() const {
+    return (2 * (uint64_t) getInputSize() + 4 * (uint64_t) getOutputSize()) * sizeof(double);
+}
+
+bool ModelBundle::isConsistent() const {
+    if (layerSizes.size() < 2 || weights.size() != layerSizes.size() - 1
+        || (int) inputScale.total() != 2 * getInputSize() || (int) outputScale.total() != 2 * getOutputSize()
+        || (int) invOutputScale.total() != 2 * getOutputSize()) {
+        return false;
+    }
+    for (size_t l = 0; l < weights.size(); l++) {
+        if (layerSizes[l] <= 0 || layerSizes[l + 1] <= 0 || weights[l].type() != CV_64FC1
+            || weights[l].rows != layerSizes[l] + 1 || weights[l].cols != layerSizes[l + 1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int ModelBundle::load(const std::string &filePath) {
+    std::shared_ptr<MappedFile> mapped = std::make_shared<MappedFile>(filePath);
+    if (mapped->open() != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+
+    MLPBundle::Header header;
+    if (mapped->size() < sizeof(header)) {
+        LOG_E("ERROR: Truncated model bundle " << filePath);
+        return Code::ERROR;
+    }
+    std::memcpy(&header, mapped->data(), sizeof(header));
+    if (!MLPBundle::hasMagic(header) || header.version != MLPBundle::VERSION) {
+        LOG_E("ERROR: Not a model bundle (or unsupported version, convert the model again): " << filePath);
+        return Code::ERROR;
+    }
+
+    const uint64_t size = header.fileSize;
+    if (size > mapped->size() || header.nbLayerSizes < 2
+        || header.layerSizesOffset + header.nbLayerSizes * sizeof(int32_t) > size
+        || header.featureOffset + header.featureLength > size || header.labelTableOffset > size
+        || header.scalesOffset > size || header.weightsOffset > size) {
+        LOG_E("ERROR: Corrupted model bundle " << filePath);
+        return Code::ERROR;
+    }
+
+    const unsigned char *data = mapped->data();
+    layerSizes.resize(header.nbLayerSizes);
+    for (uint32_t i = 0; i < header.nbLayerSizes; i++) {
+        int32_t layerSize;
+        std::memcpy(&layerSize, data + header.layerSizesOffset + i * sizeof(int32_t), sizeof(layerSize));
+        if (layerSize <= 0) {
+            LOG_E("ERROR: Corrupted model bundle " << filePath);
+            return Code::ERROR;
+        }
+        layerSizes[i] = layerSize;
+    }
+
+    // Scales and weights must fit in the file before being wrapped
+    uint64_t weightsEnd = header.weightsOffset;
+    for (size_t l = 0; l + 1 < layerSizes.size(); l++) {
+        weightsEnd += MLPBundle::layerBytes((uint32_t) layerSizes[l], (uint32_t) layerSizes[l + 1]);
+    }
+    if (header.scalesOffset + scalesBytes() > header.weightsOffset || weightsEnd > size) {
+        LOG_E("ERROR: Corrupted model bundle " << filePath);
+        return Code::ERROR;
+    }
+
+    feature.assign(reinterpret_cast<const char *>(data + header.featureOffset), header.featureLength);
+
+    labelMap.clear();
+    uint64_t offset = header.labelTableOffset;
+    for (uint32_t i = 0; i < header.nbLabels; i++) {
+        int32_t label;
+        uint32_t nameLength;
+        if (offset + sizeof(label) + sizeof(nameLength) > size) {
+            LOG_E("ERROR: Corrupted label table in " << filePath);
+            return Code::ERROR;
+        }
+        std::memcpy(&label, data + offset, sizeof(label));
+        offset += sizeof(label);
+        std::memcpy(&nameLength, data + offset, sizeof(nameLength));
+        offset += sizeof(nameLength);
+        if (offset + nameLength > size) {
+            LOG_E("ERROR: Corrupted label table in " << filePath);
+            return Code::ERROR;
+        }
+        labelMap.put(label, std::string(reinterpret_cast<const char *>(data + offset), nameLength));
+        offset += nameLength;
+    }
+
+    activation = (int) header.activation;
+    activationParam1 = header.activationParam1;
+    activationParam2 = header.activationParam2;
+    minVal = header.minVal;
+    maxVal = header.maxVal;
+    minVal1 = header.minVal1;
+    maxVal1 = header.maxVal1;
+    featureScale = header.featureScale;
+
+    offset = header.scalesOffset;
+    inputScale = MappedFile::wrap(mapped, offset, 1, 2 * getInputSize(), CV_64FC1);
+    offset += 2 * getInputSize() * sizeof(double);
+    outputScale = MappedFile::wrap(mapped, offset, 1, 2 * getOutputSize(), CV_64FC1);
+    offset += 2 * getOutputSize() * sizeof(double);
+    invOutputScale = MappedFile::wrap(mapped, offset, 1, 2 * getOutputSize(), CV_64FC1);
+
+    weights.clear();
+    offset = header.weightsOffset;
+    for (size_t l = 0; l + 1 < layerSizes.size(); l++) {
+        weights.push_back(MappedFile::wrap(mapped, offset, layerSizes[l] + 1, layerSizes[l + 1], CV_64FC1));
+        offset += MLPBundle::layerBytes((uint32_t) layerSizes[l], (uint32_t) layerSizes[l + 1]);
+    }
+    file = mapped;
+
+    return Code::SUCCESS;
+}
+
+int ModelBundle::save(const std::string &filePath) const {
+    if (!isConsistent()) {
+        LOG_E("ERROR: Incomplete model, not written to " << filePath);
+        return Code::ERROR;
+    }
+
+    std::string labelTable;
+    uint32_t nbLabels = 0;
+    for (int label = 0; label < getOutputSize(); label++) {
+        if (!labelMap.has(label)) {
+            continue;
+        }
+        std::string name = labelMap.get(label);
+        int32_t key = label;
+        uint32_t nameLength = (uint32_t) name.size();
+        labelTable.append(reinterpret_cast<const char *>(&key), sizeof(key));
+        labelTable.append(reinterpret_cast<const char *>(&nameLength), sizeof(nameLength));
+        labelTable.append(name);
+        nbLabels++;
+    }
+
+    MLPBundle::Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MLPBundle::MAGIC, sizeof(MLPBundle::MAGIC));
+    header.version = MLPBundle::VERSION;
+    header.activation = (uint32_t) activation;
+    header.nbLayerSizes = (uint32_t) layerSizes.size();
+    header.activationParam1 = activationParam1;
+    header.activationParam2 = activationParam2;
+    header.minVal = minVal;
+    header.maxVal = maxVal;
+    header.minVal1 = minVal1;
+    header.maxVal1 = maxVal1;
+    header.featureScale = featureScale;
+    header.featureLength = (uint32_t) feature.size();
+    header.nbLabels = nbLabels;
+    header.layerSizesOffset = sizeof(MLPBundle::Header);
+    header.featureOffset = header.layerSizesOffset + layerSizes.size() * sizeof(int32_t);
+    header.labelTableOffset = header.featureOffset + feature.size();
+    header.scalesOffset = MLPBundle::align(header.labelTableOffset + labelTable.size());
+    header.weightsOffset = MLPBundle::align(header.scalesOffset + scalesBytes());
+    header.fileSize = header.weightsOffset;
+    for (size_t l = 0; l < weights.size(); l++) {
+        header.fileSize += MLPBundle::layerBytes((uint32_t) layerSizes[l], (uint32_t) layerSizes[l + 1]);
+    }
+
+    // Unique temporary name: several processes may write the same file at once
+    std::string tmpPath = filePath + Default::TMP_FILE_INFIX + std::to_string(getpid());
+    std::ofstream out(tmpPath, std::ofstream::binary | std::ofstream::trunc);
+    if (!out) {
+        LOG_E("ERROR: Could not write model bundle " << tmpPath);
+        return Code::ERROR;
+    }
+
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (int layerSize : layerSizes) {
+        int32_t value = layerSize;
+        out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+    out.write(feature.data(), feature.size());
+    out.write(labelTable.data(), labelTable.size());
+    writePadding(out, header.labelTableOffset + labelTable.size(), header.scalesOffset);
+    writeMat(out, inputScale);
+    writeMat(out, outputScale);
+    writeMat(out, invOutputScale);
+    writePadding(out, header.scalesOffset + scalesBytes(), header.weightsOffset);
+    uint64_t offset = header.weightsOffset;
+    for (size_t l = 0; l < weights.size(); l++) {
+        writeMat(out, weights[l]);
+        uint64_t written = weights[l].total() * sizeof(double);
+        uint64_t padded = MLPBundle::layerBytes((uint32_t) layerSizes[l], (uint32_t) layerSizes[l + 1]);
+        writePadding(out, offset + written, offset + padded);
+        offset += padded;
+    }
+    out.close();
+
+    if (!out || std::rename(tmpPath.c_str(), filePath.c_str()) != 0) {
+        LOG_E("ERROR: Could not write model bundle " << filePath);
+        std::remove(tmpPath.c_str());
+        return Code::ERROR;
+    }
+    return Code::SUCCESS;
+}
+
+int ModelBundle::readNetwork(const cv::FileNode &node) {
+    std::vector<int> sizes;
+    std::string activationStr;
+    node["layer_sizes"] >> sizes;
+    node["activation_function"] >> activationStr;
+
+    int activationId = -1;
+    for (int a = 0; a < NB_OF_ACTIVATIONS; a++) {
+        if (activationStr == ACTIVATION_NAMES[a]) {
+            activationId = a;
+        }
+    }
+    if (sizes.size() < 2 || activationId < 0) {
+        return Code::ERROR;
+    }
+
+    layerSizes = sizes;
+    activation = activationId;
+    node["f_param1"] >> activationParam1;
+    node["f_param2"] >> activationParam2;
+    node["min_val"] >> minVal;
+    node["max_val"] >> maxVal;
+    node["min_val1"] >> minVal1;
+    node["max_val1"] >> maxVal1;
+
+    std::vector<double> values;
+    node["input_scale"] >> values;
+    inputScale = cv::Mat(values, true).reshape(1, 1);
+    node["output_scale"] >> values;
+    outputScale = cv::Mat(values, true).reshape(1, 1);
+    node["inv_output_scale"] >> values;
+    invOutputScale = cv::Mat(values, true).reshape(1, 1);
+
+    weights.clear();
+    cv::FileNode weightsNode = node["weights"];
+    size_t l = 0;
+    for (cv::FileNodeIterator it = weightsNode.begin(); it != weightsNode.end(); ++it, l++) {
+        (*it) >> values;
+        if (l + 1 >= layerSizes.size() || values.size() != (size_t) (layerSizes[l] + 1) * layerSizes[l + 1]) {
+            return Code::ERROR;
+        }
+        weights.push_back(cv::Mat(values, true).reshape(1, layerSizes[l] + 1));
+    }
+    file.reset();
+
+    return isConsistent() ? Code::SUCCESS : Code::ERROR;
+}
+
+void ModelBundle::writeNetwork(cv::FileStorage &fs) const {
+    fs << "layer_sizes" << layerSizes;
+    fs << "activation_function" << activationName(activation);
+    fs << "f_param1" << activationParam1;
+    fs << "f_param2" << activationParam2;
+    fs << "min_val" << minVal;
+    fs << "max_val" << maxVal;
+    fs << "min_val1" << minVal1;
+    fs << "max_val1" << maxVal1;
+    fs << "input_scale" << toVector(inputScale);
+    fs << "output_scale" << toVector(outputScale);
+    fs << "inv_output_scale" << toVector(invOutputScale);
+    fs << "weights" << "[";
+    for (const cv::Mat &layer : weights) {
+        fs << toVector(layer);
+    }
+    fs << "]";
+}
@@ -6,7 +6,10 @@
 #include "../inc/MultiConfig.hpp"
 #include "../inc/log.h"
 
-MultiConfig::MultiConfig(std::string configPath) throw(ParsingException) {
+MultiConfig::MultiConfig(std::string configPath) throw(ParsingException)
+        : batchSize(Default::BATCH_SIZE), prefetch(Default::PREFETCH_BATCHES), epochs(Default::NB_OF_EPOCHS),
+          threads(0), maxMemoryMB(0), cache(false), learningRate(Default::TRAINER_LEARNING_RATE),
+          miniBatch(Default::TRAINER_BATCH_SIZE) {
     using namespace cv;
     FileStorage fs(configPath, FileStorage::READ);
 
@@ -29,6 +32,36 @@ MultiConfig::MultiConfig(std::string configPath) throw(ParsingException) {
             topologies.push_back(*it);
         }
 
+        if (!fs["batchSize"].empty()) {
+            fs["batchSize"] >> batchSize;
+        }
+        if (!fs["prefetch"].empty()) {
+            fs["prefetch"] >> prefetch;
+        }
+        if (!fs["epochs"].empty()) {
+            fs["epochs"] >> epochs;
+        }
+        if (!fs["threads"].empty()) {
+            fs["threads"] >> threads;
+        }
+        if (!fs["maxMemoryMB"].empty()) {
+            fs["maxMemoryMB"] >> maxMemoryMB;
+        }
+        if (!fs["cache"].empty()) {
+            int useCache = 0;
+            fs["cache"] >> useCache;
+            cache = useCache != 0;
+        }
+        if (!fs["optimizer"].empty()) {
+            fs["optimizer"] >> optimizer;
+        }
+        if (!fs["learningRate"].empty()) {
+            fs["learningRate"] >> learningRate;
+        }
+        if (!fs["miniBatch"].empty()) {
+            fs["miniBatch"] >> miniBatch;
+        }
+
         fs.release();
     } else {
         throw ParsingException(configPath);
@@ -0,0 +1,101 @@
+//
+// @author Loris Friedel
+//
+
+#include <algorithm>
+#include "../inc/ParallelFor.hpp"
+
+int resolveThreadCount(int nbThreads) {
+    if (nbThreads > 0) {
+        return nbThreads;
+    }
+    int hardwareThreads = (int) std::thread::hardware_concurrency();
+    return hardwareThreads > 0 ? hardwareThreads : 1;
+}
+
+WorkerPool::WorkerPool(int nbThreads) : next(0) {
+    // The calling thread is worker 0
+    for (int w = 1; w < resolveThreadCount(nbThreads); w++) {
+        threads.push_back(std::thread(&WorkerPool::loop, this, w));
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    started.notify_all();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+}
+
+void WorkerPool::run(size_t count, const std::function<void(size_t, int)> &fn) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->fn = &fn;
+        this->count = count;
+        next = 0;
+        error = nullptr;
+        // Threads would find no index left: do not wake them up
+        nbOfRunning = count > 1 ? (int) threads.size() : 0;
+        if (nbOfRunning > 0) {
+            generation++;
+        }
+    }
+    started.notify_all();
+
+    work(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return nbOfRunning == 0; });
+    this->fn = nullptr;
+    if (error) {
+        std::exception_ptr caught = error;
+        error = nullptr;
+        std::rethrow_exception(caught);
+    }
+}
+
+int WorkerPool::getNbOfThreads() const {
+    return (int) threads.size() + 1;
+}
+
+void WorkerPool::loop(int worker) {
+    long seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        started.wait(lock, [this, seen] { return stopping || generation != seen; });
+        if (stopping) {
+            return;
+        }
+        seen = generation;
+
+        lock.unlock();
+        work(worker);
+        lock.lock();
+
+        if (--nbOfRunning == 0) {
+            finished.notify_all();
+        }
+    }
+}
+
+void WorkerPool::work(int worker) {
+    for (size_t i = next++; i < count; i = next++) {
+        try {
+            (*fn)(i, worker);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+}
+
+void parallelFor(size_t count, int nbThreads, const std::function<void(size_t, int)> &fn) {
+    WorkerPool pool((int) std::min<size_t>((size_t) resolveThreadCount(nbThreads), std::max<size_t>(count, 1)));
+    pool.run(count, fn);
+}
@@ -0,0 +1,143 @@
+//
+// @author Loris Friedel
+//
+
+#include <algorithm>
+#include <cstring>
+#include "../inc/PredictionCache.hpp"
+#include "../inc/log.h"
+
+namespace {
+    size_t roundUpPowerOfTwo(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+}
+
+PredictionCache::PredictionCache(size_t capacity, float threshold)
+        : capacity(roundUpPowerOfTwo(std::max((size_t) NB_OF_PROBES, capacity))), threshold(threshold),
+          slots(new Slot[this->capacity]), nbOfHits(0), nbOfMisses(0) {
+    for (size_t i = 0; i < this->capacity; i++) {
+        slots[i].sequence.store(0, std::memory_order_relaxed);
+        for (int w = 0; w < KEY_WORDS; w++) {
+            slots[i].key[w].store(0, std::memory_order_relaxed);
+        }
+        slots[i].value.store(EMPTY_VALUE, std::memory_order_relaxed);
+    }
+}
+
+bool PredictionCache::makeKey(const float *input, int size, Key &key) const {
+    if (size > MAX_INPUT_SIZE) {
+        return false;
+    }
+    std::memset(key.words, 0, sizeof(key.words));
+    for (int i = 0; i < size; i++) {
+        if (input[i] > threshold) {
+            key.words[i >> 6] |= (uint64_t) 1 << (i & 63);
+        }
+    }
+    return true;
+}
+
+uint64_t PredictionCache::hash(const Key &key) {
+    uint64_t h = 0;
+    for (uint64_t word : key.words) {
+        // splitmix64 finalizer on each word
+        h ^= word + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+    }
+    return h;
+}
+
+bool PredictionCache::find(const Key &key, std::pair<int, float> &prediction) const {
+    const uint64_t h = hash(key);
+    for (int probe = 0; probe < NB_OF_PROBES; probe++) {
+        const Slot &slot = slots[(h + probe) & (capacity - 1)];
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if ((before & 1) != 0) {
+            continue;
+        }
+
+        bool same = true;
+        for (int w = 0; w < KEY_WORDS; w++) {
+            same &= slot.key[w].load(std::memory_order_relaxed) == key.words[w];
+        }
+        uint64_t value = slot.value.load(std::memory_order_relaxed);
+
+        // Nothing was written in the slot while reading it
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (same && value != EMPTY_VALUE && slot.sequence.load(std::memory_order_relaxed) == before) {
+            uint32_t confidenceBits = (uint32_t) (value >> 32);
+            float confidence;
+            std::memcpy(&confidence, &confidenceBits, sizeof(confidence));
+            prediction = {(int) (uint32_t) value, confidence};
+            return true;
+        }
+    }
+    return false;
+}
+
+void PredictionCache::insert(const Key &key, const std::pair<int, float> &prediction) {
+    const uint64_t h = hash(key);
+
+    // An empty slot among the probed ones, otherwise one of them chosen by the hash
+    Slot *target = &slots[(h + (h >> 32) % NB_OF_PROBES) & (capacity - 1)];
+    for (int probe = 0; probe < NB_OF_PROBES; probe++) {
+        Slot &slot = slots[(h + probe) & (capacity - 1)];
+        if (slot.value.load(std::memory_order_relaxed) == EMPTY_VALUE) {
+            target = &slot;
+            break;
+        }
+    }
+
+    uint32_t confidenceBits;
+    std::memcpy(&confidenceBits, &prediction.second, sizeof(confidenceBits));
+    write(*target, key.words, ((uint64_t) confidenceBits << 32) | (uint32_t) prediction.first);
+}
+
+void PredictionCache::write(Slot &slot, const uint64_t *key, uint64_t value) {
+    uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    if ((sequence & 1) != 0
+        || !slot.sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire)) {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (int w = 0; w < KEY_WORDS; w++) {
+        slot.key[w].store(key[w], std::memory_order_relaxed);
+    }
+    slot.value.store(value, std::memory_order_relaxed);
+
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void PredictionCache::clear() {
+    const uint64_t emptyKey[KEY_WORDS] = {};
+    for (size_t i = 0; i < capacity; i++) {
+        write(slots[i], emptyKey, EMPTY_VALUE);
+    }
+}
+
+size_t PredictionCache::getCapacity() const {
+    return capacity;
+}
+
+long PredictionCache::getNbOfHits() const {
+    return nbOfHits;
+}
+
+long PredictionCache::getNbOfMisses() const {
+    return nbOfMisses;
+}
+
+void PredictionCache::logStats() const {
+    long lookups = nbOfHits + nbOfMisses;
+    LOG_I("Prediction cache: " << nbOfHits << " hits, " << nbOfMisses << " misses ("
+                               << (lookups > 0 ? nbOfHits * 100.0 / lookups : 0) << "% hits, "
+                               << capacity << " slots)");
+}
@@ -0,0 +1,174 @@
+//
+// @author Loris Friedel
+//
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include "../inc/TrainingManifest.hpp"
+#include "../inc/Crc32.hpp"
+#include "../inc/DirectoryReader.hpp"
+#include "../inc/constant.h"
+#include "../inc/code.h"
+#include "../inc/log.h"
+
+static const std::string MANIFEST_HEADER = "multi_learning manifest v1";
+
+TrainingManifest::TrainingManifest(std::string filePath) : filePath(filePath) {}
+
+int TrainingManifest::load() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+
+    std::ifstream in(filePath);
+    if (!in) {
+        return Code::SUCCESS; // No previous run
+    }
+
+    std::string header;
+    if (!getline(in, header) || header != MANIFEST_HEADER) {
+        LOG_E("ERROR: Invalid manifest " << filePath);
+        return Code::ERROR;
+    }
+
+    // One line per job: hash <TAB> train seconds <TAB> checksum <TAB> model path (hash and checksum in hex)
+    std::string line;
+    while (getline(in, line)) {
+        std::stringstream ss(line);
+        uint64_t jobHash;
+        Entry entry;
+        char tab;
+        ss >> std::hex >> jobHash >> std::dec >> entry.trainSeconds >> std::hex >> entry.checksum >> std::noskipws
+           >> tab;
+        if (!ss || tab != '\t' || !getline(ss, entry.modelPath) || entry.modelPath.empty()) {
+            LOG_E("ERROR: Invalid manifest line \"" << line << "\" in " << filePath);
+            entries.clear();
+            return Code::ERROR;
+        }
+        entries[jobHash] = entry;
+    }
+
+    return Code::SUCCESS;
+}
+
+bool TrainingManifest::isDone(uint64_t jobHash) const {
+    Entry entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(jobHash);
+        if (it == entries.end()) {
+            return false;
+        }
+        entry = it->second;
+    }
+
+    // Deleted or overwritten since: train again
+    uint32_t crc;
+    return checksum(entry.modelPath, crc) == Code::SUCCESS && crc == entry.checksum;
+}
+
+int TrainingManifest::record(uint64_t jobHash, const std::string &modelPath, double trainSeconds) {
+    Entry entry;
+    entry.modelPath = modelPath;
+    entry.trainSeconds = trainSeconds;
+    if (checksum(modelPath, entry.checksum) != Code::SUCCESS) {
+        LOG_E("ERROR: Could not read " << modelPath);
+        return Code::ERROR;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[jobHash] = entry;
+    return save();
+}
+
+size_t TrainingManifest::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+int TrainingManifest::save() const {
+    std::string tmpPath = filePath + Default::TMP_FILE_INFIX + std::to_string(getpid());
+    std::ofstream out(tmpPath, std::ofstream::trunc);
+    if (!out) {
+        LOG_E("ERROR: Could not write manifest " << tmpPath);
+        return Code::ERROR;
+    }
+
+    out << MANIFEST_HEADER << "\n";
+    for (const auto &jobEntry : entries) {
+        const Entry &entry = jobEntry.second;
+        out << std::hex << jobEntry.first << std::dec << "\t" << entry.trainSeconds << "\t" << std::hex
+            << entry.checksum << std::dec << "\t" << entry.modelPath << "\n";
+    }
+    out.close();
+
+    if (!out || std::rename(tmpPath.c_str(), filePath.c_str()) != 0) {
+        LOG_E("ERROR: Could not write manifest " << filePath);
+        std::remove(tmpPath.c_str());
+        return Code::ERROR;
+    }
+    return Code::SUCCESS;
+}
+
+/**
+ * @return true if the process that wrote the temporary file may still be running on this host
+ */
+static bool writerMayBeAlive(const std::string &name) {
+    size_t start = name.find(Default::TMP_FILE_INFIX) + Default::TMP_FILE_INFIX.size();
+    size_t end = start;
+    while (end < name.size() && name[end] >= '0' && name[end] <= '9') {
+        end++;
+    }
+    if (end == start || end - start > 9) {
+        return true; // Not written by an export of this program
+    }
+    pid_t pid = (pid_t) std::stol(name.substr(start, end - start));
+    return pid == getpid() || kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+int TrainingManifest::removePartialOutputs(const std::string &directory, int minAgeMS) {
+    DirectoryReader dirReader(directory);
+    dirReader.setWithStat(true);
+    if (dirReader.list() != Code::SUCCESS) {
+        return 0;
+    }
+
+    const int64_t now = (int64_t) time(nullptr);
+    int nbRemoved = 0;
+    for (const DirectoryReader::Entry &file : dirReader.getFiles()) {
+        if (file.name.find(Default::TMP_FILE_INFIX) == std::string::npos || writerMayBeAlive(file.name)
+            || (now - file.mtimeSec) * 1000 < minAgeMS) {
+            continue;
+        }
+        if (std::remove(file.path.c_str()) == 0) {
+            LOG_I("Removed partial output " << file.path);
+            nbRemoved++;
+        }
+    }
+    return nbRemoved;
+}
+
+int TrainingManifest::checksum(const std::string &filePath, uint32_t &crc) {
+    std::ifstream in(filePath, std::ifstream::binary);
+    if (!in) {
+        return Code::ERROR;
+    }
+
+    Crc32 crc32;
+    std::vector<char> buffer(1 << 16);
+    while (in) {
+        in.read(buffer.data(), buffer.size());
+        crc32.add(buffer.data(), (size_t) in.gcount());
+    }
+    if (in.bad()) {
+        return Code::ERROR;
+    }
+    crc = crc32.get();
+    return Code::SUCCESS;
+}
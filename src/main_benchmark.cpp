@@ -0,0 +1,458 @@
+//
+// @author Loris Friedel
+//
+
+#include <tclap/CmdLine.h>
+#include <cv.hpp>
+#include <sys/stat.h>
+#include "../inc/code.h"
+#include "../inc/log.h"
+#include "../inc/constant.h"
+#include "../inc/Learning.hpp"
+#include "../inc/MLPModel.hpp"
+#include "../inc/MLPInference.hpp"
+#include "../inc/DirectoryReader.hpp"
+#include "../inc/ParallelFor.hpp"
+#include "../inc/Timer.hpp"
+#include "../inc/HandInput.hpp"
+#include "../inc/AllocationCounter.hpp"
+
+/**
+ * @param modelPath A model file, or a directory of models
+ * @return the model file, or the models of the directory: OpenCV (.xml), quantized (_int8.yml) and bundles (.mlpb)
+ */
+std::vector<std::string> listModels(const std::string &modelPath) {
+    std::vector<std::string> modelPathList;
+    struct stat st;
+    if (stat(modelPath.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+        modelPathList.push_back(modelPath);
+        return modelPathList;
+    }
+    DirectoryReader dirReader(modelPath);
+    dirReader.setExtensions({".xml", Default::QUANTIZED_MODEL_SUFFIX, Default::MODEL_BUNDLE_EXT});
+    dirReader.foreachFile([&](std::string filePath, std::string fileName) {
+        modelPathList.push_back(filePath);
+    });
+    return modelPathList;
+}
+
+/**
+ * @return true if the model can only be run by MLPInference (no OpenCV network to compare with)
+ */
+bool isQuantizedModel(const std::string &modelPath) {
+    const std::string &suffix = Default::QUANTIZED_MODEL_SUFFIX;
+    return modelPath.size() > suffix.size()
+           && modelPath.compare(modelPath.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/**
+ * Load the same directory with the serial loader, the multi-threaded one and through its cache, check that
+ * all of them produce the same samples in the same order, and report the loading time of each.
+ */
+int benchmarkLoading(const std::string &dataDir, const int nbThreads, const int nbRuns) {
+    LOG_I("=== Loading benchmark on " << dataDir << " (" << nbRuns << " run(s)) ===");
+
+    cv::Mat serialData, serialResponses;
+    cv::Mat parallelData, parallelResponses;
+    Timer timer;
+    double serialTotal = 0;
+    double parallelTotal = 0;
+
+    for (int run = 0; run < nbRuns; run++) {
+        serialData.release();
+        serialResponses.release();
+        timer.start();
+        if (aggregateDataFrom(dataDir, serialData, serialResponses, 1, false) != Code::SUCCESS) {
+            return Code::ERROR;
+        }
+        timer.stop();
+        serialTotal += timer.getDurationMS();
+
+        parallelData.release();
+        parallelResponses.release();
+        timer.start();
+        if (aggregateDataFrom(dataDir, parallelData, parallelResponses, nbThreads, false) != Code::SUCCESS) {
+            return Code::ERROR;
+        }
+        timer.stop();
+        parallelTotal += timer.getDurationMS();
+    }
+
+    // First call (re)builds the cache next to the directory, second one only maps it
+    cv::Mat cachedData, cachedResponses;
+    if (aggregateDataFrom(dataDir, cachedData, cachedResponses, nbThreads, true) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    cachedData.release();
+    cachedResponses.release();
+    timer.start();
+    if (aggregateDataFrom(dataDir, cachedData, cachedResponses, nbThreads, true) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    timer.stop();
+    double cachedDuration = timer.getDurationMS();
+
+    bool same = serialData.size() == parallelData.size()
+                && serialResponses.size() == parallelResponses.size()
+                && cv::norm(serialData, parallelData, cv::NORM_INF) == 0
+                && cv::norm(serialResponses, parallelResponses, cv::NORM_INF) == 0
+                && cv::norm(serialData, cachedData, cv::NORM_INF) == 0
+                && cv::norm(serialResponses, cachedResponses, cv::NORM_INF) == 0;
+
+    LOG_I("");
+    LOG_I("Samples: " << serialData.rows << " x " << serialData.cols);
+    LOG_I(" - Serial loader: " << serialTotal / nbRuns << " ms");
+    LOG_I(" - Parallel loader (" << resolveThreadCount(nbThreads) << " threads): "
+                                 << parallelTotal / nbRuns << " ms");
+    LOG_I(" - Speedup: x" << serialTotal / parallelTotal);
+    LOG_I(" - Cached data set (" << cachePathFor(dataDir) << "): " << cachedDuration << " ms");
+    LOG_I(" - Identical output: " << (same ? "yes" : "NO"));
+    LOG_I("");
+
+    return same ? Code::SUCCESS : Code::ERROR;
+}
+
+/**
+ * Predict the whole data set one row at a time and with a single batch, with each model of the given path
+ * (a model file or a directory of models, see listModels) whose input size matches the data, check that both give
+ * the same labels, and report the time per sample of each. Quantized models have no OpenCV network and are skipped.
+ */
+int benchmarkPrediction(const std::string &dataDir, const std::string &modelPath, const int nbRuns) {
+    LOG_I("=== Prediction benchmark on " << dataDir << " with " << modelPath << " (" << nbRuns << " run(s)) ===");
+
+    cv::Mat data, responses;
+    if (aggregateDataFrom(dataDir, data, responses) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+
+    std::vector<std::string> modelPathList = listModels(modelPath);
+
+    int result = Code::SUCCESS;
+    Timer timer;
+    LOG_I("");
+    LOG_I("Samples: " << data.rows << " x " << data.cols);
+    for (const std::string &path : modelPathList) {
+        if (isQuantizedModel(path)) {
+            continue;
+        }
+        MLPModel model;
+        if (model.learnFrom(path) != Code::SUCCESS) {
+            result = Code::ERROR;
+            continue;
+        }
+        if (model.getInputSize() != data.cols) {
+            continue;
+        }
+
+        double rowTotal = 0;
+        double batchTotal = 0;
+        std::vector<int> rowLabels((size_t) data.rows);
+        cv::Mat labels, confidences;
+        for (int run = 0; run < nbRuns; run++) {
+            timer.start();
+            for (int i = 0; i < data.rows; i++) {
+                cv::Mat row = data.row(i);
+                rowLabels[i] = model.predict(row).first;
+            }
+            timer.stop();
+            rowTotal += timer.getDurationMS();
+
+            timer.start();
+            model.predictBatch(data, labels, confidences);
+            timer.stop();
+            batchTotal += timer.getDurationMS();
+        }
+
+        bool same = true;
+        for (int i = 0; i < data.rows; i++) {
+            same = same && rowLabels[i] == labels.at<int>(i);
+        }
+        if (!same) {
+            result = Code::ERROR;
+        }
+
+        LOG_I(" - " << path << " " << model.getTopologyStr() << ": row by row "
+                    << rowTotal * 1000 / nbRuns / data.rows << " us/sample, batch "
+                    << batchTotal * 1000 / nbRuns / data.rows << " us/sample, speedup x" << rowTotal / batchTotal
+                    << ", identical labels: " << (same ? "yes" : "NO"));
+    }
+    LOG_I("");
+
+    return result;
+}
+
+/**
+ * Compare the native forward pass (each instruction set supported by the CPU) with OpenCV, for each model of the
+ * given path whose input size matches the data: largest output difference, labels agreement, and latency of a
+ * single-sample prediction (the per-frame cost in sign_detect). Quantized models are skipped.
+ */
+int benchmarkInference(const std::string &dataDir, const std::string &modelPath, const int nbRuns,
+                       const double tolerance) {
+    LOG_I("=== Inference benchmark on " << dataDir << " with " << modelPath << " (" << nbRuns << " run(s)) ===");
+
+    cv::Mat data, responses;
+    if (aggregateDataFrom(dataDir, data, responses) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+
+    std::vector<std::string> modelPathList = listModels(modelPath);
+
+    int result = Code::SUCCESS;
+    Timer timer;
+    LOG_I("");
+    LOG_I("Samples: " << data.rows << " x " << data.cols << ", tolerance " << tolerance);
+    for (const std::string &path : modelPathList) {
+        if (isQuantizedModel(path)) {
+            continue;
+        }
+        MLPModel model;
+        MLPInference inference;
+        if (model.learnFrom(path) != Code::SUCCESS || inference.load(path) != Code::SUCCESS) {
+            result = Code::ERROR;
+            continue;
+        }
+        if (model.getInputSize() != data.cols) {
+            continue;
+        }
+
+        cv::Mat cvLabels, cvConfidences, cvScores;
+        model.predictBatch(data, cvLabels, cvConfidences, &cvScores);
+
+        timer.start();
+        for (int run = 0; run < nbRuns; run++) {
+            for (int i = 0; i < data.rows; i++) {
+                cv::Mat row = data.row(i);
+                model.predict(row);
+            }
+        }
+        timer.stop();
+        double cvLatency = timer.getDurationMS() * 1000 / nbRuns / data.rows;
+        LOG_I(" - " << path << " " << model.getTopologyStr() << ": OpenCV " << cvLatency << " us/sample");
+
+        for (int isa = MLPInference::SCALAR; isa <= MLPInference::detectIsa(); isa++) {
+            inference.setIsa((MLPInference::Isa) isa);
+
+            cv::Mat labels, confidences, scores;
+            inference.predictBatch(data, labels, confidences, &scores);
+            double maxDiff = cv::norm(scores, cvScores, cv::NORM_INF);
+            int nbOfSameLabels = 0;
+            for (int i = 0; i < data.rows; i++) {
+                nbOfSameLabels += labels.at<int>(i) == cvLabels.at<int>(i) ? 1 : 0;
+            }
+
+            timer.start();
+            for (int run = 0; run < nbRuns; run++) {
+                for (int i = 0; i < data.rows; i++) {
+                    inference.predict(data.ptr<float>(i));
+                }
+            }
+            timer.stop();
+            double latency = timer.getDurationMS() * 1000 / nbRuns / data.rows;
+
+            bool ok = maxDiff <= tolerance;
+            if (!ok) {
+                result = Code::ERROR;
+            }
+            LOG_I("     " << MLPInference::isaName(inference.getIsa()) << ": " << latency << " us/sample (x"
+                          << cvLatency / latency << "), max difference " << maxDiff << " "
+                          << (ok ? "ok" : "OUT OF TOLERANCE") << ", same labels " << nbOfSameLabels << "/"
+                          << data.rows);
+        }
+    }
+    LOG_I("");
+
+    return result;
+}
+
+/**
+ * Check the per-frame path of sign_detect (hand input conversion then native prediction) on a synthetic
+ * backprojection: same input as the OpenCV conversion, no heap allocation once warmed up, and latency of both.
+ */
+int benchmarkHotPath(const std::string &modelPath, const int nbRuns) {
+    LOG_I("=== Hot path benchmark with " << modelPath << " (" << nbRuns << " run(s)) ===");
+
+    const int inputSize = Default::HAND_INPUT_SIZE * Default::HAND_INPUT_SIZE;
+    std::vector<std::string> modelPathList = listModels(modelPath);
+    MLPInference inference;
+    bool predict = false;
+    for (const std::string &path : modelPathList) {
+        if (inference.load(path) == Code::SUCCESS && inference.getInputSize() == inputSize) {
+            LOG_I("Model: " << path);
+            predict = true;
+            break;
+        }
+    }
+    if (!predict) {
+        LOG_I("No model taking " << inputSize << " values, only the conversion is checked");
+    }
+
+    cv::Mat backproj(480, 640, CV_8UC1);
+    cv::randu(backproj, 0, 256);
+
+    // Hand rectangles of various sizes and positions, some of them partly outside of the frame
+    std::vector<cv::Rect> handRects;
+    cv::RNG rng(42);
+    for (int i = 0; i < 64; i++) {
+        int width = rng.uniform(Default::HAND_INPUT_SIZE, 400);
+        int height = rng.uniform(Default::HAND_INPUT_SIZE, 400);
+        handRects.push_back(cv::Rect(rng.uniform(0, backproj.cols - Default::HAND_INPUT_SIZE),
+                                     rng.uniform(0, backproj.rows - Default::HAND_INPUT_SIZE), width, height));
+    }
+
+    HandInput handInput(Default::HAND_INPUT_SIZE, (float) Default::HAND_INPUT_SCALE);
+    handInput.reserve(backproj.size());
+    std::vector<float> scores((size_t) std::max(1, predict ? inference.getOutputSize() : 0));
+
+    // Same input as the OpenCV conversion, up to float rounding
+    const double tolerance = 1e-4;
+    double maxDiff = 0;
+    for (const cv::Rect &handRect : handRects) {
+        cv::Mat expected;
+        cv::resize(backproj(HandInput::squareRoi(handRect, backproj.size())), expected,
+                   cv::Size(Default::HAND_INPUT_SIZE, Default::HAND_INPUT_SIZE), 0, 0, cv::INTER_AREA);
+        expected.reshape(0, 1).convertTo(expected, CV_32FC1, Default::HAND_INPUT_SCALE);
+        maxDiff = std::max(maxDiff, cv::norm(handInput.convert(backproj, handRect), expected, cv::NORM_INF));
+    }
+
+    Timer timer;
+    timer.start();
+    for (int run = 0; run < nbRuns; run++) {
+        for (const cv::Rect &handRect : handRects) {
+            cv::Mat result;
+            cv::resize(backproj(HandInput::squareRoi(handRect, backproj.size())), result,
+                       cv::Size(Default::HAND_INPUT_SIZE, Default::HAND_INPUT_SIZE), 0, 0, cv::INTER_AREA);
+            result.reshape(0, 1).convertTo(result, CV_32FC1, Default::HAND_INPUT_SCALE);
+        }
+    }
+    timer.stop();
+    double cvLatency = timer.getDurationMS() * 1000 / nbRuns / handRects.size();
+
+    // Every table is built once by the comparison above: the measured loop must not allocate
+    long allocations = AllocationCounter::getCount();
+    timer.start();
+    for (int run = 0; run < nbRuns; run++) {
+        for (const cv::Rect &handRect : handRects) {
+            const cv::Mat &row = handInput.convert(backproj, handRect);
+            if (predict) {
+                inference.predict(row.ptr<float>(), scores.data());
+            }
+        }
+    }
+    timer.stop();
+    allocations = AllocationCounter::getCount() - allocations;
+    double latency = timer.getDurationMS() * 1000 / nbRuns / handRects.size();
+
+    bool sameInput = maxDiff <= tolerance;
+    bool noAllocation = !AllocationCounter::isAvailable() || allocations == 0;
+
+    LOG_I("");
+    LOG_I("Frame: " << backproj.cols << " x " << backproj.rows << ", " << handRects.size() << " hand rectangles");
+    LOG_I(" - OpenCV conversion: " << cvLatency << " us/frame");
+    LOG_I(" - Hand input conversion" << (predict ? " + prediction" : "") << ": " << latency
+                                     << " us/frame");
+    LOG_I(" - Max difference with the OpenCV conversion: " << maxDiff << " "
+                                                           << (sameInput ? "ok" : "OUT OF TOLERANCE"));
+    if (AllocationCounter::isAvailable()) {
+        LOG_I(" - Heap allocations in " << nbRuns * handRects.size() << " frames: " << allocations << " "
+                                        << (noAllocation ? "ok" : "NOT ALLOCATION FREE"));
+    } else {
+        LOG_I(" - Heap allocations are not counted on this platform");
+    }
+    LOG_I("");
+
+    return sameInput && noAllocation ? Code::SUCCESS : Code::ERROR;
+}
+
+int main(int argc, const char **argv) {
+    try {
+        TCLAP::CmdLine cmd(
+                "!!! Help for benchmark program. !!!"
+                        "\nUsage example:"
+                        "\n./benchmark.exe --loading -i letters_data -j 8"
+                        "\n./benchmark.exe --predict -i letters_data -m generated_models/"
+                        "\n./benchmark.exe --inference -i letters_data -m generated_models/model_loris_32_yml.xml"
+                        "\n./benchmark.exe --hot-path -m generated_models/model_loris_32_yml.xml"
+                        "\nWritten by Loris Friedel",
+                ' ', "1.0");
+
+        TCLAP::ValueArg<std::string> dataDirArg("i", "data-dir",
+                                                "Specify a directory where .yml file are located. Default value is " +
+                                                Default::LETTERS_DATA_PATH,
+                                                false, Default::LETTERS_DATA_PATH, "DIRECTORY_PATH", cmd);
+
+        TCLAP::ValueArg<int> threadsArg("j", "threads",
+                                        "Number of threads for multi-threaded variants (0 means one per hardware thread). Default value is 0",
+                                        false, 0, "POSITIVE_INTEGER", cmd);
+
+        TCLAP::ValueArg<int> runsArg("r", "runs",
+                                     "Number of runs averaged for each measure. Default value is 3",
+                                     false, 3, "POSITIVE_INTEGER", cmd);
+
+        TCLAP::SwitchArg loadingArg("l", "loading",
+                                    "Benchmark data loading (serial vs multi-threaded .yml ingestion).",
+                                    cmd, false);
+
+        TCLAP::ValueArg<std::string> modelArg("m", "model",
+                                              "Model file, or directory of models, used by the prediction benchmark. Default value is " +
+                                              Default::GENERATED_MODEL_DIR,
+                                              false, Default::GENERATED_MODEL_DIR, "PATH", cmd);
+
+        TCLAP::SwitchArg predictArg("p", "predict",
+                                    "Benchmark prediction (row by row vs whole batch).",
+                                    cmd, false);
+
+        TCLAP::SwitchArg inferenceArg("n", "inference",
+                                      "Benchmark the native forward pass against OpenCV (output difference and latency).",
+                                      cmd, false);
+
+        TCLAP::SwitchArg hotPathArg("a", "hot-path",
+                                    "Check that the per-frame hand input conversion and prediction of sign_detect do not allocate.",
+                                    cmd, false);
+
+        TCLAP::ValueArg<double> toleranceArg("t", "tolerance",
+                                             "Largest output difference allowed between the native forward pass and OpenCV. Default value is 1e-4",
+                                             false, 1e-4, "POSITIVE_FLOAT", cmd);
+
+        //// Parse the argv array
+        cmd.parse(argc, argv);
+
+        //// Get the value parsed by each arg and handle them
+        std::string &dataDir = dataDirArg.getValue();
+        int nbThreads = threadsArg.getValue();
+        int nbRuns = std::max(1, runsArg.getValue());
+        bool runAll = !loadingArg.isSet() && !predictArg.isSet() && !inferenceArg.isSet()
+                      && !hotPathArg.isSet();
+
+        int result = Code::SUCCESS;
+        if (runAll || loadingArg.getValue()) {
+            if (benchmarkLoading(dataDir, nbThreads, nbRuns) != Code::SUCCESS) {
+                result = Code::ERROR;
+            }
+        }
+
+        if (runAll || predictArg.getValue()) {
+            if (benchmarkPrediction(dataDir, modelArg.getValue(), nbRuns) != Code::SUCCESS) {
+                result = Code::ERROR;
+            }
+        }
+
+        if (runAll || inferenceArg.getValue()) {
+            if (benchmarkInference(dataDir, modelArg.getValue(), nbRuns, toleranceArg.getValue()) != Code::SUCCESS) {
+                result = Code::ERROR;
+            }
+        }
+
+        if (runAll || hotPathArg.getValue()) {
+            if (benchmarkHotPath(modelArg.getValue(), nbRuns) != Code::SUCCESS) {
+                result = Code::ERROR;
+            }
+        }
+
+        return result;
+    } catch (TCLAP::ArgException &e) {  // catch any exceptions
+        LOG_E("error: " << e.error() << " for arg " << e.argId());
+    }
+
+    LOG_E("Program exited with errors");
+    return Code::ERROR;
+}
@@ -0,0 +1,170 @@
+//
+// @author Loris Friedel
+//
+
+#include <tclap/CmdLine.h>
+#include <cv.hpp>
+#include <fstream>
+#include <stdlib.h>
+#include "../inc/code.h"
+#include "../inc/log.h"
+#include "../inc/constant.h"
+#include "../inc/LabelMap.hpp"
+#include "../inc/CaptureLogFormat.hpp"
+#include "../inc/CaptureLogReader.hpp"
+#include "../inc/DataBinWriter.hpp"
+#include "../inc/Timer.hpp"
+
+int main(int argc, const char **argv) {
+    try {
+        TCLAP::CmdLine cmd(
+                "!!! Help for capture log compaction program. !!!"
+                        "\nThis program reads the capture log written by sign_detect.exe (-l option) and writes a packed"
+                        " binary data set, ready for learning.exe and multi_learning.exe."
+                        "\nTorn records at the end of a segment (interrupted capture) are skipped."
+                        "\nUsage example:"
+                        "\n./capture_compact.exe -i capture_log -o letters_data" + Default::DATA_BIN_EXT +
+                        " -m letters_images/"
+                        "\nWritten by Loris Friedel",
+                ' ', "1.0");
+
+        TCLAP::ValueArg<std::string> inputDirArg("i", "input-dir",
+                                                 "Directory of the capture log (segments " +
+                                                 std::string(CaptureLog::SEGMENT_PREFIX) + "*" +
+                                                 CaptureLog::SEGMENT_EXT + ").",
+                                                 true, "", "DIRECTORY_PATH", cmd);
+
+        TCLAP::ValueArg<std::string> outputArg("o", "output",
+                                               "Path of the packed data set to create.",
+                                               true, "", "PATH_TO_PACKED_FILE", cmd);
+
+        TCLAP::ValueArg<std::string> imageOutputArg("m", "image-output",
+                                                    "Also extract the stored cropped images (.png) in this directory (e.g. for img_convert.exe).",
+                                                    false, "", "DIRECTORY_PATH", cmd);
+
+        TCLAP::ValueArg<std::string> labelMapArg("e", "label-map",
+                                                 "Specify the path to a YML file that contains a mapping for label (string -> label (int)), stored in the label table."
+                                                         " By default each label is named after its letter.",
+                                                 false, "", "pathToYmlFile", cmd);
+
+        TCLAP::ValueArg<std::string> dtypeArg("d", "dtype",
+                                              "Storage of the data: float, uint8, bit (thresholded at 128) or auto"
+                                                      " (smallest one that keeps every value unchanged). Default value is auto",
+                                              false, "auto", "auto|float|uint8|bit", cmd);
+
+        //// Parse the argv array
+        cmd.parse(argc, argv);
+
+        //// Get the value parsed by each arg and handle them
+        std::string &inputDir = inputDirArg.getValue();
+        std::string &output = outputArg.getValue();
+
+        uint32_t dtype;
+        if (!DataBin::parseDtype(dtypeArg.getValue(), dtype)) {
+            LOG_E("ERROR: Unknown data storage " << dtypeArg.getValue());
+            return Code::ERROR;
+        }
+        std::string &imageOutput = imageOutputArg.getValue();
+
+        LabelMap labelMap;
+        bool hasLabelMap = false;
+        if (labelMapArg.isSet()) {
+            cv::FileStorage fs(labelMapArg.getValue(), cv::FileStorage::READ);
+            if (fs.isOpened()) {
+                fs[Default::KEY_MAP] >> labelMap;
+                hasLabelMap = true;
+            } else {
+                LOG_E("ERROR: Coulnd not read label map .yml file: " << labelMapArg.getValue());
+            }
+            fs.release();
+        }
+
+        if (!imageOutput.empty()) {
+            std::stringstream cmdMkdir;
+            cmdMkdir << "mkdir -p " << imageOutput;
+            system(cmdMkdir.str().c_str());
+        }
+
+        std::vector<std::string> segments = CaptureLogReader::listSegments(inputDir);
+        if (segments.empty()) {
+            LOG_E("ERROR: No capture segment in " << inputDir);
+            return Code::ERROR;
+        }
+
+        Timer timer;
+        timer.start();
+        LOG_I("Compacting " << segments.size() << " segment(s) from " << inputDir << "...");
+
+        cv::Mat data;
+        std::vector<int> responses;
+        int sampleSize = 0;
+        int nbOfSkipped = 0;
+        int nbOfTruncated = 0;
+        int nbOfImages = 0;
+
+        for (const std::string &segment : segments) {
+            CaptureLogReader reader(segment);
+            if (reader.foreachRecord([&](const CaptureLogReader::Record &record) {
+                // Same conversion as the .yml loading (letter -> label, data -> one float row)
+                if (sampleSize == 0) {
+                    sampleSize = (int) record.data.total() * record.data.channels();
+                    data.reserve(1024);
+                }
+                if ((int) (record.data.total() * record.data.channels()) != sampleSize) {
+                    nbOfSkipped++;
+                    return;
+                }
+
+                cv::Mat row;
+                record.data.reshape(1, 1).convertTo(row, CV_32FC1);
+                data.push_back(row);
+                responses.push_back(record.letter - 'a');
+                if (!hasLabelMap) {
+                    labelMap.put(record.letter - 'a', std::string(1, (char) record.letter));
+                }
+
+                if (!imageOutput.empty() && !record.encodedImage.empty()) {
+                    std::stringstream imagePath;
+                    imagePath << imageOutput << "/" << std::string(1, (char) record.letter) << "_fl300459_"
+                              << record.timestamp << ".png";
+                    std::ofstream image(imagePath.str(), std::ofstream::binary | std::ofstream::trunc);
+                    image.write(reinterpret_cast<const char *>(record.encodedImage.data()),
+                                record.encodedImage.size());
+                    nbOfImages++;
+                }
+            }) != Code::SUCCESS) {
+                continue;
+            }
+
+            if (reader.isTruncated()) {
+                LOG_E("WARNING: " << segment << " ends with a torn or corrupted record, kept "
+                                  << reader.getNbOfRecords() << " record(s) before it");
+                nbOfTruncated++;
+            }
+        }
+
+        if (data.rows == 0) {
+            LOG_E("ERROR: No valid record in " << inputDir);
+            return Code::ERROR;
+        }
+        if (nbOfSkipped > 0) {
+            LOG_E("WARNING: " << nbOfSkipped << " record(s) skipped (data size differs from " << sampleSize << ")");
+        }
+
+        cv::Mat matResponses((int) responses.size(), 1, CV_32SC1, responses.data());
+        if (DataBinWriter(output).write(data, matResponses, labelMap, 0, dtype) != Code::SUCCESS) {
+            return Code::ERROR;
+        }
+        timer.stop();
+
+        LOG_I("Compaction done! (" << data.rows << " samples of " << sampleSize << " values, " << nbOfImages
+                                   << " images extracted, " << nbOfTruncated << " truncated segment(s), "
+                                   << timer.getDurationS() << " s)");
+        return Code::SUCCESS;
+    } catch (TCLAP::ArgException &e) {  // catch any exceptions
+        LOG_E("error: " << e.error() << " for arg " << e.argId());
+    }
+
+    LOG_E("Program exited with errors");
+    return Code::ERROR;
+}
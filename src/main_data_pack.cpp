@@ -0,0 +1,96 @@
+//
+// @author Loris Friedel
+//
+
+#include <tclap/CmdLine.h>
+#include <cv.hpp>
+#include "../inc/code.h"
+#include "../inc/log.h"
+#include "../inc/constant.h"
+#include "../inc/Learning.hpp"
+#include "../inc/LabelMap.hpp"
+#include "../inc/DataBinReader.hpp"
+#include "../inc/DataBinWriter.hpp"
+#include "../inc/Timer.hpp"
+
+int main(int argc, const char **argv) {
+    try {
+        TCLAP::CmdLine cmd(
+                "!!! Help for data set packing program. !!!"
+                        "\nThis program converts a directory of .yml data files into a single packed binary data set,"
+                        " which learning.exe and multi_learning.exe load without parsing (memory-mapped)."
+                        "\nUsage example:"
+                        "\n./data_pack.exe -i letters_data -o letters_data" + Default::DATA_BIN_EXT +
+                        "\n./learning.exe -i letters_data" + Default::DATA_BIN_EXT + " -t letters_data" +
+                        Default::DATA_BIN_EXT +
+                        "\nWritten by Loris Friedel",
+                ' ', "1.0");
+
+        TCLAP::ValueArg<std::string> inputDirArg("i", "input-dir",
+                                                 "Directory where .yml data files are located.",
+                                                 true, Default::LETTERS_DATA_PATH, "DIRECTORY_PATH", cmd);
+
+        TCLAP::ValueArg<std::string> outputArg("o", "output",
+                                               "Path of the packed data set to create.",
+                                               true, "", "PATH_TO_PACKED_FILE", cmd);
+
+        TCLAP::ValueArg<std::string> labelMapArg("e", "label-map",
+                                                 "Specify the path to a YML file that contains a mapping for label (string -> label (int)), stored in the label table.",
+                                                 false, "", "pathToYmlFile", cmd);
+
+        TCLAP::ValueArg<std::string> dtypeArg("d", "dtype",
+                                              "Storage of the data: float, uint8, bit (thresholded at 128) or auto"
+                                                      " (smallest one that keeps every value unchanged). Default value is auto",
+                                              false, "auto", "auto|float|uint8|bit", cmd);
+
+        //// Parse the argv array
+        cmd.parse(argc, argv);
+
+        //// Get the value parsed by each arg and handle them
+        std::string &inputDir = inputDirArg.getValue();
+        std::string &output = outputArg.getValue();
+
+        uint32_t dtype;
+        if (!DataBin::parseDtype(dtypeArg.getValue(), dtype)) {
+            LOG_E("ERROR: Unknown data storage " << dtypeArg.getValue());
+            return Code::ERROR;
+        }
+
+        LabelMap labelMap;
+        if (labelMapArg.isSet()) {
+            cv::FileStorage fs(labelMapArg.getValue(), cv::FileStorage::READ);
+            if (fs.isOpened()) {
+                fs[Default::KEY_MAP] >> labelMap;
+            } else {
+                LOG_E("ERROR: Coulnd not read label map .yml file: " << labelMapArg.getValue());
+            }
+            fs.release();
+        }
+
+        cv::Mat data;
+        cv::Mat responses;
+        if (aggregateDataFrom(inputDir, data, responses, 0, false) != Code::SUCCESS) {
+            LOG_E("ERROR: Could not load data from " << inputDir);
+            return Code::ERROR;
+        }
+
+        Timer timer;
+        timer.start();
+        LOG_I("Packing " << data.rows << " samples of " << data.cols << " values into " << output << "...");
+        if (DataBinWriter(output).write(data, responses, labelMap, 0, dtype) != Code::SUCCESS) {
+            return Code::ERROR;
+        }
+        timer.stop();
+
+        DataBin::Header header;
+        DataBinReader::readHeader(output, header);
+        LOG_I("Packing done! (" << DataBin::dtypeName(header.dtype) << " storage, " << header.fileSize
+                                << " bytes, " << timer.getDurationS() << " s)");
+        return Code::SUCCESS;
+    } catch (TCLAP::ArgException &e) {  // catch any exceptions
+        LOG_E("error: " << e.error() << " for arg " << e.argId());
+    }
+
+    LOG_E("Program exited with errors");
+    return Code::ERROR;
+}
@@ -0,0 +1,212 @@
+//
+// @author Loris Friedel
+//
+
+#include <tclap/CmdLine.h>
+#include <cv.hpp>
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <stdlib.h>
+#include "../inc/code.h"
+#include "../inc/log.h"
+#include "../inc/constant.h"
+#include "../inc/DirectoryReader.hpp"
+#include "../inc/DataYmlWriter.hpp"
+#include "../inc/FeatureSpec.hpp"
+#include "../inc/BlockingQueue.hpp"
+#include "../inc/ParallelFor.hpp"
+#include "../inc/Timer.hpp"
+
+struct CompiledSample {
+    std::string outPath;
+    FeatureSpec::Kind kind;
+    std::vector<float> description;
+    cv::Mat pixels;
+    int letter;
+};
+
+/**
+ * Read the size of a PNG image from its header, without decoding it.
+ *
+ * @return false if the file is not a PNG image
+ */
+bool readPngSize(const std::string &filePath, int &width, int &height) {
+    unsigned char header[24];
+    std::ifstream in(filePath, std::ifstream::binary);
+    if (!in.read(reinterpret_cast<char *>(header), sizeof(header))
+        || header[0] != 0x89 || header[1] != 'P' || header[2] != 'N' || header[3] != 'G') {
+        return false;
+    }
+    width = (header[16] << 24) | (header[17] << 16) | (header[18] << 8) | header[19];
+    height = (header[20] << 24) | (header[21] << 16) | (header[22] << 8) | header[23];
+    return true;
+}
+
+/**
+ * Decode an image to grayscale, at a reduced resolution when every feature is small enough.
+ */
+cv::Mat decodeGray(const std::string &filePath, const int maxFeatureSize, const bool reducedDecode) {
+    int width, height;
+    if (reducedDecode && readPngSize(filePath, width, height)) {
+        int smallest = std::min(width, height);
+        if (smallest >= 8 * maxFeatureSize) {
+            return cv::imread(filePath, cv::IMREAD_REDUCED_GRAYSCALE_8);
+        } else if (smallest >= 4 * maxFeatureSize) {
+            return cv::imread(filePath, cv::IMREAD_REDUCED_GRAYSCALE_4);
+        } else if (smallest >= 2 * maxFeatureSize) {
+            return cv::imread(filePath, cv::IMREAD_REDUCED_GRAYSCALE_2);
+        }
+    }
+    return cv::imread(filePath, CV_LOAD_IMAGE_GRAYSCALE);
+}
+
+int main(int argc, const char **argv) {
+    try {
+        TCLAP::CmdLine cmd(
+                "!!! Help for data set compilation !!!"
+                        "\nThis program decodes every image of a directory once and computes all the configured features in one pass."
+                        "\nEach feature is written in its own directory <output>_<type>, the layout expected by multi_learning.exe."
+                        "\nUsage example:"
+                        "\n./dataset_compile.exe -i letters_images -o ../Documents/ml/loris -f HOG=hog:256:32:16:8 -f gray=resize:16"
+                        "\n -- This execution writes ../Documents/ml/loris_HOG and ../Documents/ml/loris_gray"
+                        "\nWritten by Loris Friedel",
+                ' ', "1.0");
+
+        TCLAP::ValueArg<std::string> inputDirArg("i", "input-dir",
+                                                 "Directory where .png images are located.",
+                                                 true, ".", "DIRECTORY_PATH", cmd);
+
+        TCLAP::ValueArg<std::string> outputArg("o", "output-prefix",
+                                               "Prefix of the output directories (one directory <prefix>_<type> per feature).",
+                                               true, ".", "PATH_PREFIX", cmd);
+
+        TCLAP::MultiArg<std::string> featureArg("f", "feature",
+                                                "Feature to compute: <type>=hog:<size>:<block>:<stride>:<cell> or <type>=resize:<size>."
+                                                        " Can be repeated. Default values are " + Default::FEATURE_HOG + ", " +
+                                                Default::FEATURE_HOG_SMALL + " and " + Default::FEATURE_GRAY,
+                                                false, "FEATURE", cmd);
+
+        TCLAP::ValueArg<int> threadsArg("j", "threads",
+                                        "Number of threads decoding images and computing features (0 means one per hardware thread). Default value is 0",
+                                        false, 0, "POSITIVE_INTEGER", cmd);
+
+        TCLAP::SwitchArg reducedDecodeArg("r", "reduced-decode",
+                                          "Decode images at 1/2, 1/4 or 1/8 of their resolution when it stays larger than every feature size.",
+                                          cmd, false);
+
+        //// Parse the argv array
+        cmd.parse(argc, argv);
+
+        //// Get the value parsed by each arg and handle them
+        std::string &input = inputDirArg.getValue();
+        std::string &output = outputArg.getValue();
+        int nbThreads = resolveThreadCount(threadsArg.getValue());
+        bool reducedDecode = reducedDecodeArg.getValue();
+
+        std::vector<std::string> featureStrings = featureArg.getValue();
+        if (featureStrings.empty()) {
+            featureStrings = {Default::FEATURE_HOG, Default::FEATURE_HOG_SMALL, Default::FEATURE_GRAY};
+        }
+
+        std::vector<FeatureSpec> features;
+        int maxFeatureSize = 0;
+        for (const std::string &featureString : featureStrings) {
+            FeatureSpec feature;
+            if (FeatureSpec::parse(featureString, feature) != Code::SUCCESS) {
+                return Code::ERROR;
+            }
+            maxFeatureSize = std::max(maxFeatureSize, feature.size);
+            features.push_back(feature);
+
+            std::stringstream cmdMkdir;
+            cmdMkdir << "mkdir -p " << output << "_" << feature.type;
+            system(cmdMkdir.str().c_str());
+        }
+
+        std::vector<std::pair<std::string, std::string>> fileList;
+        DirectoryReader dirReader(input);
+        dirReader.setExtensions({".png"});
+        dirReader.foreachFile([&](std::string filePath, std::string fileName) {
+            fileList.push_back({filePath, fileName});
+        });
+
+        Timer globalMonitor;
+        globalMonitor.start();
+        LOG_I("Compiling " << fileList.size() << " images into " << features.size() << " feature(s)...");
+        for (const FeatureSpec &feature : features) {
+            LOG_I(" - " << feature.toString() << " -> " << output << "_" << feature.type);
+        }
+
+        // Decode + compute on a worker pool, write on a dedicated thread
+        BlockingQueue<CompiledSample> writeQueue((size_t) nbThreads * features.size() * 4);
+        std::atomic<int> nbOfFailures(0);
+        std::atomic<int> nbOfWrites(0);
+
+        std::thread writer([&]() {
+            CompiledSample sample;
+            while (writeQueue.pop(sample)) {
+                DataYmlWriter dataWriter(sample.outPath);
+                bool written = sample.kind == FeatureSpec::HOG
+                               ? dataWriter.write(sample.description, sample.letter)
+                               : dataWriter.writeLetter(sample.pixels, sample.letter);
+                if (written) {
+                    nbOfWrites++;
+                } else {
+                    nbOfFailures++;
+                }
+            }
+        });
+
+        // One set of descriptors per worker, reused for every image
+        std::vector<std::vector<cv::HOGDescriptor>> descriptors((size_t) nbThreads);
+        for (std::vector<cv::HOGDescriptor> &workerDescriptors : descriptors) {
+            for (const FeatureSpec &feature : features) {
+                workerDescriptors.push_back(feature.kind == FeatureSpec::HOG
+                                            ? feature.createDescriptor() : cv::HOGDescriptor());
+            }
+        }
+
+        parallelFor(fileList.size(), nbThreads, [&](size_t i, int worker) {
+            const std::string &filePath = fileList[i].first;
+            std::string fileName = fileList[i].second;
+
+            // Decode once for all features
+            cv::Mat gray = decodeGray(filePath, maxFeatureSize, reducedDecode);
+            if (gray.empty()) {
+                LOG_E("ERROR: Could not read image " << filePath);
+                nbOfFailures++;
+                return;
+            }
+
+            fileName = fileName.substr(0, fileName.length() - 3); // remove extension (.png)
+            int letter, c;
+            for (c = 0; !(97 <= fileName[c] && fileName[c] <= 122); c++);
+            letter = static_cast<int>(fileName[c]);
+
+            cv::Mat resized;
+            for (size_t f = 0; f < features.size(); f++) {
+                CompiledSample sample;
+                sample.kind = features[f].kind;
+                sample.letter = letter;
+                sample.outPath = output + "_" + features[f].type + "/" + fileName + "yml";
+                features[f].compute(gray, descriptors[worker][f], resized, sample.description, sample.pixels);
+                writeQueue.push(std::move(sample));
+            }
+        });
+
+        writeQueue.close();
+        writer.join();
+        globalMonitor.stop();
+
+        LOG_I("Compilation done! (" << globalMonitor.getDurationS() << " s, " << nbOfWrites << " files written, "
+                                    << nbOfFailures << " failures)");
+
+        return nbOfFailures == 0 ? Code::SUCCESS : Code::ERROR;
+    } catch (TCLAP::ArgException &e) {  // catch any exceptions
+        LOG_E("error: " << e.error() << " for arg " << e.argId());
+    }
+
+    LOG_E("Program exited with errors");
+    return Code::ERROR;
+}
@@ -0,0 +1,285 @@
+//
+// @author Loris Friedel
+//
+
+#include <tclap/CmdLine.h>
+#include <cv.hpp>
+#include <glob.h>
+#include <algorithm>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include "../inc/code.h"
+#include "../inc/log.h"
+#include "../inc/constant.h"
+#include "../inc/Learning.hpp"
+#include "../inc/LabelMap.hpp"
+#include "../inc/MLPModel.hpp"
+#include "../inc/MLPInference.hpp"
+#include "../inc/ModelBundle.hpp"
+#include "../inc/ParallelFor.hpp"
+#include "../inc/Timer.hpp"
+
+struct Evaluation {
+    std::string path;
+    MLPInference inference;
+    LabelMap labelMap;
+    std::string topology;
+    bool loaded = false;
+    double accuracy = 0;
+    std::map<int, double> labelSuccess;
+    double latencyUS = 0;
+};
+
+/**
+ * @return paths matching any of the patterns, sorted and without duplicates
+ */
+std::vector<std::string> listModels(const std::vector<std::string> &patterns) {
+    std::set<std::string> paths;
+    for (const std::string &pattern : patterns) {
+        glob_t result;
+        if (glob(pattern.c_str(), 0, nullptr, &result) == 0) {
+            for (size_t i = 0; i < result.gl_pathc; i++) {
+                paths.insert(result.gl_pathv[i]);
+            }
+        }
+        globfree(&result);
+    }
+    return std::vector<std::string>(paths.begin(), paths.end());
+}
+
+/**
+ * Load a model (.xml, quantized .yml or bundle), bundles also give their label names.
+ */
+int loadModel(Evaluation &evaluation) {
+    if (ModelBundle::isBundleFile(evaluation.path)) {
+        ModelBundle bundle;
+        if (bundle.load(evaluation.path) != Code::SUCCESS || evaluation.inference.load(bundle) != Code::SUCCESS) {
+            return Code::ERROR;
+        }
+        if (!bundle.labelMap.empty()) {
+            evaluation.labelMap = bundle.labelMap;
+        }
+    } else if (evaluation.inference.load(evaluation.path) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+
+    MLPInference &inference = evaluation.inference;
+    std::stringstream topology;
+    topology << inference.getInputSize();
+    for (int l = 0; l < inference.getNbOfLayers(); l++) {
+        std::vector<float> weights, bias;
+        inference.getLayer(l, weights, bias);
+        topology << "_" << bias.size();
+    }
+    if (inference.isQuantized()) {
+        topology << "_" << inference.getOutputSize() << " (int8)";
+    }
+    evaluation.topology = topology.str();
+    return Code::SUCCESS;
+}
+
+/**
+ * Success rate of every label of the test set, and the total success rate.
+ */
+void evaluateModel(Evaluation &evaluation, const cv::Mat &testData, const cv::Mat &testResponses) {
+    cv::Mat labels, confidences, scores;
+    evaluation.inference.predictBatch(testData, labels, confidences, &scores);
+    std::pair<double, std::map<int, StatPredict *>> result =
+            MLPModel::collectStats(testResponses, labels, confidences, scores);
+
+    evaluation.accuracy = result.first;
+    for (auto &entry : result.second) {
+        const StatPredict &stat = *entry.second;
+        evaluation.labelSuccess[entry.first] = stat.stats.empty() ? 0 :
+                                               (double) stat.successAndFailure().first / (double) stat.stats.size();
+        delete entry.second;
+    }
+}
+
+/**
+ * @return single-sample prediction latency in microseconds
+ */
+double measureLatency(MLPInference &inference, const cv::Mat &data, const int nbRuns) {
+    Timer timer;
+    timer.start();
+    for (int run = 0; run < nbRuns; run++) {
+        for (int i = 0; i < data.rows; i++) {
+            inference.predict(data.ptr<float>(i));
+        }
+    }
+    timer.stop();
+    return timer.getDurationMS() * 1000 / nbRuns / data.rows;
+}
+
+void logTable(std::vector<Evaluation> &evaluations, LabelMap &labelMap) {
+    std::set<int> labels;
+    size_t pathWidth = 5, topologyWidth = 8;
+    for (const Evaluation &evaluation : evaluations) {
+        for (auto &entry : evaluation.labelSuccess) {
+            labels.insert(entry.first);
+        }
+        pathWidth = std::max(pathWidth, evaluation.path.size());
+        topologyWidth = std::max(topologyWidth, evaluation.topology.size());
+    }
+
+    std::stringstream header;
+    header << std::left << std::setw((int) pathWidth) << "Model" << " | " << std::setw((int) topologyWidth)
+           << "Topology" << " | Success | Latency |" << std::right;
+    for (int label : labels) {
+        header << std::setw(5) << labelMap.get(label);
+    }
+    LOG_I(header.str());
+    LOG_I(std::string(header.str().size(), '-'));
+
+    for (const Evaluation &evaluation : evaluations) {
+        std::stringstream line;
+        line << std::fixed << std::setprecision(1) << std::left << std::setw((int) pathWidth) << evaluation.path
+             << " | " << std::setw((int) topologyWidth) << evaluation.topology << " | " << std::right
+             << std::setw(6) << evaluation.accuracy * 100 << "% | " << std::setw(4) << evaluation.latencyUS
+             << " us |";
+        for (int label : labels) {
+            auto it = evaluation.labelSuccess.find(label);
+            if (it != evaluation.labelSuccess.end()) {
+                line << std::setw(5) << std::setprecision(0) << it->second * 100;
+            } else {
+                line << std::setw(5) << "-";
+            }
+        }
+        LOG_I(line.str());
+    }
+}
+
+/**
+ * Load the test data once, then load every model matching the patterns and evaluate them concurrently on it.
+ * The latency is measured afterwards, one model at a time, so that the models do not slow each other down.
+ */
+int evaluateModels(const std::vector<std::string> &patterns, const std::string &testDir, LabelMap &labelMap,
+                   const int nbThreads, const int nbRuns) {
+    std::vector<std::string> paths = listModels(patterns);
+    if (paths.empty()) {
+        std::stringstream list;
+        for (size_t i = 0; i < patterns.size(); i++) {
+            list << (i > 0 ? ", " : "") << patterns[i];
+        }
+        LOG_E("ERROR: No model matches " << list.str());
+        return Code::ERROR;
+    }
+
+    cv::Mat testData, testResponses;
+    if (aggregateDataFrom(testDir, testData, testResponses, nbThreads) != Code::SUCCESS || testData.rows == 0) {
+        LOG_E("ERROR: Could not load test data from " << testDir);
+        return Code::ERROR;
+    }
+    // Shared by every worker, never written
+    const cv::Mat &data = testData;
+    const cv::Mat &responses = testResponses;
+
+    std::vector<Evaluation> evaluations(paths.size());
+    Timer timer;
+    timer.start();
+    parallelFor(paths.size(), nbThreads, [&](size_t i, int worker) {
+        Evaluation &evaluation = evaluations[i];
+        evaluation.path = paths[i];
+        evaluation.labelMap = labelMap;
+        if (loadModel(evaluation) != Code::SUCCESS) {
+            LOG_E("ERROR: Could not load model " << evaluation.path);
+            return;
+        }
+        if (evaluation.inference.getInputSize() != data.cols) {
+            LOG_E("ERROR: Model " << evaluation.path << " input (" << evaluation.inference.getInputSize()
+                                  << ") does not match the test data size (" << data.cols << ")");
+            return;
+        }
+        evaluateModel(evaluation, data, responses);
+        evaluation.loaded = true;
+    });
+    timer.stop();
+
+    evaluations.erase(std::remove_if(evaluations.begin(), evaluations.end(), [](const Evaluation &evaluation) {
+        return !evaluation.loaded;
+    }), evaluations.end());
+    if (evaluations.empty()) {
+        return Code::ERROR;
+    }
+    LOG_I(evaluations.size() << "/" << paths.size() << " models evaluated on " << data.rows << " samples in "
+                             << timer.getDurationMS() << "ms (" << resolveThreadCount(nbThreads) << " threads)");
+
+    for (Evaluation &evaluation : evaluations) {
+        evaluation.latencyUS = measureLatency(evaluation.inference, data, nbRuns);
+    }
+
+    std::stable_sort(evaluations.begin(), evaluations.end(), [](const Evaluation &a, const Evaluation &b) {
+        return a.accuracy > b.accuracy;
+    });
+    LOG_I("");
+    logTable(evaluations, labelMap.empty() ? evaluations.front().labelMap : labelMap);
+    LOG_I("");
+
+    return evaluations.size() == paths.size() ? Code::SUCCESS : Code::ERROR;
+}
+
+int main(int argc, const char **argv) {
+    try {
+        TCLAP::CmdLine cmd(
+                "!!! Help for evaluate_models program. !!!"
+                        "\nEvaluate every model matching a pattern on the same test data, and print one table of their success rate per label and latency."
+                        "\nUsage example:"
+                        "\n./evaluate_models.exe -m 'generated_models/model_loris_*_yml.xml' -t letters_test"
+                        "\nWritten by Loris Friedel",
+                ' ', "1.0");
+
+        TCLAP::MultiArg<std::string> modelsArg("m", "models",
+                                               "Pattern of the models to evaluate (quote it so that the shell does not expand it)."
+                                                       " Can be repeated. Default values are generated_models/*.xml, generated_models/*" +
+                                               Default::QUANTIZED_MODEL_SUFFIX + " and generated_models/*" +
+                                               Default::MODEL_BUNDLE_EXT,
+                                               false, "PATTERN", cmd);
+
+        TCLAP::ValueArg<std::string> testDirArg("t", "test-dir",
+                                                "Test data (.yml directory or packed data set). Default value is " +
+                                                Default::LETTERS_DATA_PATH,
+                                                false, Default::LETTERS_DATA_PATH, "DIRECTORY_PATH", cmd);
+
+        TCLAP::ValueArg<std::string> labelMapArg("e", "label-map",
+                                                 "Specify the path to a YML file that contains a mapping for label (string -> label (int))",
+                                                 false, "", "pathToYmlFile", cmd);
+
+        TCLAP::ValueArg<int> threadsArg("j", "threads",
+                                        "Number of threads loading and evaluating the models (0: one per hardware thread). Default value is 0",
+                                        false, 0, "INTEGER", cmd);
+
+        TCLAP::ValueArg<int> runsArg("r", "runs",
+                                     "Number of runs averaged for the latency. Default value is 1",
+                                     false, 1, "POSITIVE_INTEGER", cmd);
+
+        //// Parse the argv array
+        cmd.parse(argc, argv);
+
+        //// Get the value parsed by each arg and handle them
+        LabelMap labelMap;
+        if (labelMapArg.isSet()) {
+            cv::FileStorage fs(labelMapArg.getValue(), cv::FileStorage::READ);
+            if (fs.isOpened()) {
+                fs[Default::KEY_MAP] >> labelMap;
+            } else {
+                LOG_E("ERROR: Could not read label map .yml file: " << labelMapArg.getValue());
+            }
+            fs.release();
+        }
+
+        std::vector<std::string> patterns = modelsArg.getValue();
+        if (patterns.empty()) {
+            patterns = {"generated_models/*.xml", "generated_models/*" + Default::QUANTIZED_MODEL_SUFFIX,
+                        "generated_models/*" + Default::MODEL_BUNDLE_EXT};
+        }
+
+        return evaluateModels(patterns, testDirArg.getValue(), labelMap, threadsArg.getValue(),
+                              std::max(1, runsArg.getValue()));
+    } catch (TCLAP::ArgException &e) {  // catch any exceptions
+        LOG_E("error: " << e.error() << " for arg " << e.argId());
+    }
+
+    LOG_E("Program exited with errors");
+    return Code::ERROR;
+}
@@ -6,6 +6,10 @@
 #include <cv.hpp>
 #include <dirent.h>
 #include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
 #include "../inc/code.h"
 #include "../inc/log.h"
 #include "../inc/constant.h"
@@ -14,7 +18,68 @@
 #include "../inc/DirectoryReader.hpp"
 #include "../inc/DataYmlWriter.hpp"
 #include "../inc/Timer.hpp"
+#include "../inc/BlockingQueue.hpp"
+#include "../inc/ParallelFor.hpp"
+#include "../inc/ConversionManifest.hpp"
 
+struct SourceImage {
+    std::string filePath;
+    std::string fileName;
+    ConversionManifest::Entry entry;
+};
+
+struct DecodedImage {
+    size_t index;
+    cv::Mat image;
+};
+
+struct ComputedData {
+    size_t index;
+    std::string outPath;
+    std::vector<float> description;
+    int letter;
+};
+
+/**
+ * Busy time of a pipeline stage, accumulated by all of its threads.
+ */
+struct StageStat {
+    std::atomic<long> count{0};
+    std::atomic<long> busyNS{0};
+
+    void add(double durationNS) {
+        count++;
+        busyNS += (long) durationNS;
+    }
+
+    void log(const std::string &name, int nbThreads) const {
+        double averageMS = count > 0 ? busyNS / 1e6 / count : 0;
+        double throughput = busyNS > 0 ? count * nbThreads / (busyNS / 1e9) : 0;
+        LOG_I(name << ": " << averageMS << " ms per image, " << throughput << " images/s ("
+                   << nbThreads << " thread(s))");
+    }
+};
+
+/**
+ * Occupancy of a queue, sampled each time an item is pushed.
+ */
+struct QueueStat {
+    std::atomic<long> samples{0};
+    std::atomic<long> total{0};
+    std::atomic<long> max{0};
+
+    void add(size_t occupancy) {
+        samples++;
+        total += (long) occupancy;
+        long previous = max;
+        while ((long) occupancy > previous && !max.compare_exchange_weak(previous, (long) occupancy));
+    }
+
+    void log(const std::string &name, size_t capacity) const {
+        double average = samples > 0 ? (double) total / samples : 0;
+        LOG_I(name << ": average " << average << " / " << capacity << ", max " << max);
+    }
+};
 
 int main(int argc, const char **argv) {
     try {
@@ -53,8 +118,16 @@ int main(int argc, const char **argv) {
                                          std::to_string(Default::HOG_CELL_SIZE),
                                          false, Default::HOG_CELL_SIZE, "POSITIVE_INTEGER", cmd);
 
+        TCLAP::ValueArg<int> threadsArg("j", "threads",
+                                        "Number of threads of the decode pool and of the HOG compute pool (0 means one per hardware thread). Default value is 0",
+                                        false, 0, "POSITIVE_INTEGER", cmd);
+
+        TCLAP::SwitchArg fullArg("a", "all",
+                                 "Ignore the manifest of the previous conversion and convert every image.",
+                                 cmd, false);
+
         TCLAP::SwitchArg verboseArg("v", "verbose",
-                                    "Log everything.",
+                                    "Log per-stage throughput and queue occupancy.",
                                     cmd, false);
 
         //// Parse the argv array
@@ -67,15 +140,11 @@ int main(int argc, const char **argv) {
         int blockSize = blockSizeArg.getValue();
         int blockStrideSize = blockStrideSizeArg.getValue();
         int cellSize = cellSizeArg.getValue();
+        int nbThreads = resolveThreadCount(threadsArg.getValue());
         bool verbose = verboseArg.getValue();
+        bool full = fullArg.getValue();
 
-        Timer globalMonitor, readGrayTimer,
-                resizeTimer, hogTimer, writeTimer;
-        double nbOfImage = 0;
-        double readGrayTotal = 0;
-        double resizeTotal = 0;
-        double hogTotal = 0;
-        double writeTotal = 0;
+        Timer globalMonitor;
 
         // Start timer
         globalMonitor.start();
@@ -84,89 +153,191 @@ int main(int argc, const char **argv) {
         cmdMkdir << "mkdir -p " << output;
         system(cmdMkdir.str().c_str());
 
-        LOG_I("Conversion in progress...");
+        // Sorted .png list, with the size and modification time used by the manifest
+        std::vector<SourceImage> sourceList;
         DirectoryReader dirReader(input);
-        dirReader.foreachFile([&](std::string filePath, std::string fileName) {
-            // Read image (.png) & convert to grayscale
-            if (verbose) {
-                nbOfImage++;
-                LOG_I("(" << fileName << ") Reading image & converting it to grayscale..");
-                readGrayTimer.start();
-            }
-            cv::Mat image = cv::imread(filePath, CV_LOAD_IMAGE_GRAYSCALE);
-            if (verbose) {
-                readGrayTimer.stop();
-                readGrayTotal += readGrayTimer.getDurationMS();
+        if (dirReader.setExtensions({".png"}).setWithStat(true).list() != Code::SUCCESS) {
+            LOG_E("ERROR: Could not list input directory " << input);
+            return Code::ERROR;
+        }
+        for (const DirectoryReader::Entry &file : dirReader.getFiles()) {
+            SourceImage source;
+            source.filePath = file.path;
+            source.fileName = file.name;
+            source.entry.output = file.name.substr(0, file.name.length() - 3) + "yml";
+            source.entry.size = file.size;
+            source.entry.mtimeSec = file.mtimeSec;
+            source.entry.mtimeNSec = file.mtimeNSec;
+            sourceList.push_back(source);
+        }
+
+        // Only convert images that are new or changed since the previous conversion
+        std::stringstream parameters;
+        parameters << "hog:" << imgSize << ":" << blockSize << ":" << blockStrideSize << ":" << cellSize;
+        ConversionManifest manifest(ConversionManifest::pathFor(output), parameters.str());
+        if (!full && manifest.load() != Code::SUCCESS) {
+            LOG_E("Ignoring manifest " << manifest.getFilePath() << ", every image will be converted");
+        }
+
+        std::vector<SourceImage> fileList;
+        std::unordered_set<std::string> sourceNames;
+        for (const SourceImage &source : sourceList) {
+            sourceNames.insert(source.fileName);
+            if (!manifest.isUpToDate(source.fileName, source.entry)
+                || access((output + "/" + source.entry.output).c_str(), F_OK) != 0) {
+                manifest.remove(source.fileName);
+                fileList.push_back(source);
             }
+        }
 
-            // Resize
-            if (verbose) {
-                LOG_I("Resizing image (" << imgSize << "x" << imgSize << ")..");
-                resizeTimer.start();
+        // Delete outputs whose source is gone
+        std::vector<std::string> removedSources;
+        for (const auto &sourceEntry : manifest.getEntries()) {
+            if (sourceNames.count(sourceEntry.first) == 0) {
+                removedSources.push_back(sourceEntry.first);
             }
-            cv::resize(image, image, cv::Size(imgSize, imgSize));
-            if (verbose) {
-                resizeTimer.stop();
-                resizeTotal += resizeTimer.getDurationMS();
+        }
+        for (const std::string &source : removedSources) {
+            std::string outPath = output + "/" + manifest.getEntries().at(source).output;
+            if (std::remove(outPath.c_str()) != 0) {
+                LOG_E("ERROR: Could not delete " << outPath);
             }
+            manifest.remove(source);
+        }
 
-            // Convert to HOG
-            if (verbose) {
-                LOG_I("Compute HOG " << "(block:" << blockSize
-                                     << ", block stride:" << blockStrideSize
-                                     << ", cell:" << cellSize
-                                     << ") ..");
-                hogTimer.start();
-            }
+        LOG_I("Conversion in progress (" << fileList.size() << " new or changed images out of " << sourceList.size()
+                                         << ", " << removedSources.size() << " removed, "
+                                         << nbThreads << " threads per stage)...");
 
-            std::vector<float> description;
-            cv::HOGDescriptor descriptor(cv::Size(imgSize, imgSize),
-                                         cv::Size(blockSize, blockSize),
-                                         cv::Size(blockStrideSize, blockStrideSize),
-                                         cv::Size(cellSize, cellSize),
-                                         9);
-            descriptor.compute(image, description);
-            if (verbose) {
-                hogTimer.stop();
-                hogTotal += hogTimer.getDurationMS();
-            }
+        // Pipeline: decode pool -> compute pool -> writer, joined by bounded queues
+        const size_t queueCapacity = (size_t) nbThreads * 4;
+        BlockingQueue<DecodedImage> decodedQueue(queueCapacity);
+        BlockingQueue<ComputedData> computedQueue(queueCapacity);
+        StageStat decodeStat, computeStat, writeStat;
+        QueueStat decodedQueueStat, computedQueueStat;
+        std::atomic<int> nbOfFailures(0);
 
-            // Create new path for data
-            std::stringstream outPath;
-            fileName = fileName.substr(0, fileName.length() - 3); // remove extension (.png)
-            outPath << output << "/" << fileName << "yml"; // create final path for .yml files
+        std::atomic<size_t> nextFile(0);
+        std::atomic<int> runningDecoders(nbThreads);
+        std::vector<std::thread> decoders;
+        for (int t = 0; t < nbThreads; t++) {
+            decoders.push_back(std::thread([&]() {
+                Timer timer;
+                for (size_t i = nextFile++; i < fileList.size(); i = nextFile++) {
+                    // Read image (.png) & convert to grayscale
+                    timer.start();
+                    DecodedImage decoded;
+                    decoded.index = i;
+                    decoded.image = cv::imread(fileList[i].filePath, CV_LOAD_IMAGE_GRAYSCALE);
+                    timer.stop();
+                    decodeStat.add(timer.getDurationNS());
 
-            // Write HOG
-            if (verbose) {
-                LOG_I("(" << outPath.str() << ") Write image..");
-                writeTimer.start();
-            }
+                    if (decoded.image.empty()) {
+                        LOG_E("ERROR: Could not read image " << fileList[i].filePath);
+                        nbOfFailures++;
+                        continue;
+                    }
+                    decodedQueue.push(decoded);
+                    decodedQueueStat.add(decodedQueue.size());
+                }
+                // Last decoder done: no more images for the compute pool
+                if (--runningDecoders == 0) {
+                    decodedQueue.close();
+                }
+            }));
+        }
 
-            int letter, i;
-            for (i = 0; !(97 <= fileName[i] && fileName[i] <= 122); i++);
-            letter = static_cast<int>(fileName[i]);
+        std::atomic<int> runningComputers(nbThreads);
+        std::vector<std::thread> computers;
+        for (int t = 0; t < nbThreads; t++) {
+            computers.push_back(std::thread([&]() {
+                // One descriptor per thread, reused for every image
+                cv::HOGDescriptor descriptor(cv::Size(imgSize, imgSize),
+                                             cv::Size(blockSize, blockSize),
+                                             cv::Size(blockStrideSize, blockStrideSize),
+                                             cv::Size(cellSize, cellSize),
+                                             9);
+                Timer timer;
+                DecodedImage decoded;
+                cv::Mat resized;
+                while (decodedQueue.pop(decoded)) {
+                    timer.start();
+                    cv::resize(decoded.image, resized, cv::Size(imgSize, imgSize));
 
-            DataYmlWriter writer(outPath.str());
-            writer.write(description, letter);
-            if (verbose) {
-                writeTimer.stop();
-                writeTotal += writeTimer.getDurationMS();
+                    ComputedData computed;
+                    computed.index = decoded.index;
+                    descriptor.compute(resized, computed.description);
+
+                    // Create new path for data
+                    const SourceImage &source = fileList[decoded.index];
+                    std::string fileName = source.fileName;
+                    fileName = fileName.substr(0, fileName.length() - 3); // remove extension (.png)
+                    computed.outPath = output + "/" + source.entry.output; // create final path for .yml files
+
+                    int i;
+                    for (i = 0; !(97 <= fileName[i] && fileName[i] <= 122); i++);
+                    computed.letter = static_cast<int>(fileName[i]);
+                    timer.stop();
+                    computeStat.add(timer.getDurationNS());
+
+                    computedQueue.push(std::move(computed));
+                    computedQueueStat.add(computedQueue.size());
+                }
+                // Last compute thread done: no more data for the writer
+                if (--runningComputers == 0) {
+                    computedQueue.close();
+                }
+            }));
+        }
+
+        std::thread writer([&]() {
+            Timer timer;
+            ComputedData computed;
+            while (computedQueue.pop(computed)) {
+                timer.start();
+                DataYmlWriter dataWriter(computed.outPath);
+                if (dataWriter.write(computed.description, computed.letter)) {
+                    // Only the writer touches the manifest while the pipeline runs
+                    const SourceImage &source = fileList[computed.index];
+                    manifest.set(source.fileName, source.entry);
+                } else {
+                    nbOfFailures++;
+                }
+                timer.stop();
+                writeStat.add(timer.getDurationNS());
             }
         });
 
+        for (std::thread &t : decoders) {
+            t.join();
+        }
+        for (std::thread &t : computers) {
+            t.join();
+        }
+        writer.join();
+
+        // Failed images are not recorded: they will be converted again by the next run
+        manifest.save();
+
         // End timer
         globalMonitor.stop();
 
-        LOG_I("Conversion done! (" << globalMonitor.getDurationS() << " s)");
+        LOG_I("Conversion done! (" << globalMonitor.getDurationS() << " s, "
+                                   << writeStat.count << " images converted, "
+                                   << nbOfFailures << " failures)");
 
         if (verbose) {
-            LOG_I("Average for each image processing: "
-                          << (readGrayTotal + resizeTotal + hogTotal + writeTotal) / (nbOfImage) << " ms");
-            LOG_I("Average time for each action:");
-            LOG_I(" - Read and convert image to grayscale: " << (readGrayTotal / nbOfImage) << " ms");
-            LOG_I(" - Resize image: " << (resizeTotal / nbOfImage) << " ms");
-            LOG_I(" - Compute HOG: " << (hogTotal / nbOfImage) << " ms");
-            LOG_I(" - Write data on disk: " << (writeTotal / nbOfImage) << " ms");
+            double wallS = globalMonitor.getDurationS();
+            LOG_I("Overall throughput: " << writeStat.count / wallS << " images/s");
+            LOG_I("Per stage (average time per image, throughput of the stage alone):");
+            decodeStat.log(" - Read and convert image to grayscale", nbThreads);
+            computeStat.log(" - Resize image and compute HOG " + std::string("(block:") + std::to_string(blockSize)
+                            + ", block stride:" + std::to_string(blockStrideSize)
+                            + ", cell:" + std::to_string(cellSize) + ")", nbThreads);
+            writeStat.log(" - Write data on disk", 1);
+            LOG_I("Queue occupancy (a full queue means the next stage is the bottleneck):");
+            decodedQueueStat.log(" - Decoded images", queueCapacity);
+            computedQueueStat.log(" - Computed HOG", queueCapacity);
         }
 
         return Code::SUCCESS;
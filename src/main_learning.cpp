@@ -13,6 +13,7 @@
 #include "../inc/time.h"
 #include "../inc/Learning.hpp"
 #include "../inc/LabelMap.hpp"
+#include "../inc/FeatureSpec.hpp"
 
 int main(int argc, const char **argv) {
     try {
@@ -21,6 +22,8 @@ int main(int argc, const char **argv) {
                         "\nUsage examples:"
                         "\n./learning.exe -o model_v1.xml -l 4 -n 32 -i images/data/learn -t images/data/test"
                         "\n -- This execution will generate a model named model_v1.xml in the current directory, with 4 layer of 32 neurons using data 'images/data/learn' to learn and '/images/data/test' to test the model"
+                        "\n./learning.exe -o model_v1.mlpb -i images/data/learn -t images/data/test"
+                        "\n -- Same, with the model saved as a model bundle (weights, feature and label map in one binary file)"
                         "\n./learning.exe --test-only -m model_v1.xml -t images/data/test"
                         "\n -- This execution will test the model named model_v1.xml over the data set located in the '/images/data/test' directory"
                         "\nWritten by Loris Friedel",
@@ -64,6 +67,11 @@ int main(int argc, const char **argv) {
                                    "Skip the model test.",
                                    cmd, false);
 
+        TCLAP::SwitchArg cacheArg("c", "cache",
+                                  "Load the training data through a packed cache written next to the data directory (DIR" +
+                                  Default::DATA_CACHE_EXT + "), rebuilt when the directory files change.",
+                                  cmd, false);
+
         TCLAP::SwitchArg testOnlyArg("y", "test-only",
                                      "If this argument is present, the program will only test the model specified by the '--model-to-test' arg. If '--model-to-test' is not specified, the program exit.",
                                      cmd, false);
@@ -72,10 +80,48 @@ int main(int argc, const char **argv) {
                                                 "Specify the path to a JSON file where to write label distribution of training data (create it if not exists).",
                                                 false, "", "pathToJsonFile", cmd);
 
+        TCLAP::ValueArg<int> batchSizeArg("b", "batch-size",
+                                          "Train by mini-batches of this size streamed from the data directory, instead of loading the whole data set in memory. Default value is " +
+                                          std::to_string(Default::BATCH_SIZE) + " (no streaming)",
+                                          false, Default::BATCH_SIZE, "POSITIVE_INTEGER", cmd);
+
+        TCLAP::ValueArg<int> prefetchArg("f", "prefetch",
+                                         "Number of mini-batches read ahead when streaming. Default value is " +
+                                         std::to_string(Default::PREFETCH_BATCHES),
+                                         false, Default::PREFETCH_BATCHES, "POSITIVE_INTEGER", cmd);
+
+        TCLAP::ValueArg<int> epochsArg("x", "epochs",
+                                       "Number of passes over the data set when streaming, or when training with --optimizer. Default value is " +
+                                       std::to_string(Default::NB_OF_EPOCHS),
+                                       false, Default::NB_OF_EPOCHS, "POSITIVE_INTEGER", cmd);
+
+        TCLAP::ValueArg<std::string> optimizerArg("a", "optimizer",
+                                                  "Train with the native multi-threaded mini-batch trainer and this optimizer (sgd, momentum or adam) instead of the OpenCV one. The exported model is the same kind of model. Default value is none (OpenCV training)",
+                                                  false, "", "OPTIMIZER", cmd);
+
+        TCLAP::ValueArg<double> learningRateArg("r", "learning-rate",
+                                                "Learning rate of the --optimizer. Default value is " +
+                                                std::to_string(Default::TRAINER_LEARNING_RATE),
+                                                false, Default::TRAINER_LEARNING_RATE, "POSITIVE_FLOAT", cmd);
+
+        TCLAP::ValueArg<int> miniBatchArg("u", "mini-batch",
+                                          "Number of samples per weights update of the --optimizer. Default value is " +
+                                          std::to_string(Default::TRAINER_BATCH_SIZE),
+                                          false, Default::TRAINER_BATCH_SIZE, "POSITIVE_INTEGER", cmd);
+
         TCLAP::ValueArg<std::string> labelMapArg("e", "label-map",
                                                     "Specify the path to a YML file that contains a mapping for label (string -> label (int))",
                                                     false, "", "pathToYmlFile", cmd);
 
+        TCLAP::ValueArg<std::string> featureArg("k", "feature",
+                                                "Feature of the training data, stored with the model when it is exported as a model bundle (--output ending with " +
+                                                Default::MODEL_BUNDLE_EXT + "). Default: none, the bundle then only records its input size",
+                                                false, "", "FEATURE_SPEC", cmd);
+
+        TCLAP::ValueArg<double> featureScaleArg("g", "feature-scale",
+                                                "Factor sign_detect applies to the feature values before the model, stored with --feature. Default value is 1/255,"
+                                                        " the scaling of the backprojections saved by sign_detect (same as model_convert)",
+                                                false, Default::HAND_INPUT_SCALE, "POSITIVE_FLOAT", cmd);
 
         //// Parse the argv array
         cmd.parse(argc, argv);
@@ -128,8 +174,35 @@ int main(int argc, const char **argv) {
             }
 
             model.setLabelMap(labelMap);
+            if (featureScaleArg.getValue() <= 0) {
+                LOG_E("ERROR: The feature scale must be positive");
+                return Code::ERROR;
+            }
+            FeatureSpec feature;
+            if (featureArg.isSet() && FeatureSpec::parse(featureArg.getValue(), feature) != Code::SUCCESS) {
+                return Code::ERROR;
+            }
+            model.setFeature(featureArg.isSet() ? feature.toString() : "", featureScaleArg.getValue());
+
+            if (optimizerArg.isSet()) {
+                MLPTrainer::Params params;
+                if (MLPTrainer::parseOptimizer(optimizerArg.getValue(), params.optimizer) != Code::SUCCESS) {
+                    LOG_E("ERROR: Unknown optimizer " << optimizerArg.getValue() << " (sgd, momentum or adam)");
+                    return Code::ERROR;
+                }
+                params.learningRate = learningRateArg.getValue();
+                params.batchSize = std::max(1, miniBatchArg.getValue());
+                params.nbOfEpochs = std::max(1, epochsArg.getValue());
+                model.setOptimizer(params);
+            }
+
+            int batchSize = batchSizeArg.getValue();
+            int trainCode = batchSize > 0
+                            ? trainMLPModelStreaming(dataDir, testDir, model, noTest,
+                                                     batchSize, prefetchArg.getValue(), epochsArg.getValue())
+                            : trainMLPModel(dataDir, testDir, model, noTest, cacheArg.getValue());
 
-            if (trainMLPModel(dataDir, testDir, model, noTest) == Code::SUCCESS) {
+            if (trainCode == Code::SUCCESS) {
                 model.exportTrainDataDistribution(jsonDistribPath);
                 return model.exportModelTo(modelOutPath);
             } else {
@@ -0,0 +1,164 @@
+//
+// @author Loris Friedel
+//
+
+#include <tclap/CmdLine.h>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "../inc/code.h"
+#include "../inc/log.h"
+#include "../inc/constant.h"
+#include "../inc/MLPInference.hpp"
+
+/**
+ * Write values as the body of a C++ array, 8 per line, with enough digits to read back the same floats.
+ */
+void writeArray(std::ostream &out, const std::string &name, const std::vector<float> &values,
+                const std::string &sizeExpr) {
+    out << "    alignas(64) constexpr float " << name << "[" << sizeExpr << "] = {";
+    for (size_t i = 0; i < values.size(); i++) {
+        out << (i % 8 == 0 ? "\n            " : " ") << values[i] << "f" << (i + 1 < values.size() ? "," : "");
+    }
+    out << "\n    };\n\n";
+}
+
+/**
+ * @return the characters of a C++ string literal (without the quotes) holding the given text
+ */
+std::string escapeLiteral(const std::string &text) {
+    std::stringstream escaped;
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped << '\\' << c;
+        } else if (c < 0x20 || c == 0x7f) {
+            // Octal escape: always 3 digits, so a following digit is not read as part of it
+            escaped << '\\' << std::oct << std::setw(3) << std::setfill('0') << (int) c << std::dec;
+        } else {
+            escaped << c;
+        }
+    }
+    return escaped.str();
+}
+
+/**
+ * Generate a header holding the folded weights of the model as constexpr arrays, and a predict function
+ * calling EmbeddedMLP::layer with the layer sizes of the model.
+ */
+int generateHeader(const std::string &modelPath, const std::string &headerPath, const std::string &nameSpace,
+                   const std::string &includePath) {
+    MLPInference model;
+    if (model.load(modelPath) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    if (model.getNbOfLayers() == 0) {
+        LOG_E("ERROR: Only float models can be compiled: " << modelPath);
+        return Code::ERROR;
+    }
+
+    // Input size, then output size of each layer
+    std::vector<int> sizes = {model.getInputSize()};
+    std::vector<std::vector<float>> weights((size_t) model.getNbOfLayers());
+    std::vector<std::vector<float>> bias((size_t) model.getNbOfLayers());
+    for (int l = 0; l < model.getNbOfLayers(); l++) {
+        model.getLayer(l, weights[l], bias[l]);
+        sizes.push_back((int) bias[l].size());
+    }
+
+    // Header names have no escape sequences
+    if (includePath.find_first_of("\"\n") != std::string::npos) {
+        LOG_E("ERROR: Invalid include path " << includePath);
+        return Code::ERROR;
+    }
+
+    std::ofstream out(headerPath);
+    if (!out.is_open()) {
+        LOG_E("ERROR: Could not write " << headerPath);
+        return Code::ERROR;
+    }
+    out << std::scientific << std::setprecision(8);
+
+    const std::string source = escapeLiteral(modelPath);
+    out << "//\n// Generated by model_codegen.exe from \"" << source << "\", do not edit.\n//\n\n";
+    out << "#pragma once\n\n#include <utility>\n#include \"" << includePath << "\"\n\n";
+    out << "namespace " << nameSpace << " {\n";
+    out << "    const char *const SOURCE = \"" << source << "\";\n";
+    out << "    constexpr int INPUT_SIZE = " << sizes.front() << ";\n";
+    out << "    constexpr int OUTPUT_SIZE = " << sizes.back() << ";\n\n";
+    for (int l = 0; l < model.getNbOfLayers(); l++) {
+        writeArray(out, "WEIGHTS_" + std::to_string(l), weights[l],
+                   std::to_string(sizes[l]) + " * " + std::to_string(sizes[l + 1]));
+        writeArray(out, "BIAS_" + std::to_string(l), bias[l], std::to_string(sizes[l + 1]));
+    }
+    writeArray(out, "OUTPUT_SCALE", model.getOutputScale(), "2 * OUTPUT_SIZE");
+
+    out << "    /**\n"
+        << "     * Same as MLPInference::predict.\n"
+        << "     */\n"
+        << "    inline std::pair<int, float> predict(const float *input, float *scores = nullptr) {\n";
+    std::string previous = "input";
+    for (int l = 0; l < model.getNbOfLayers(); l++) {
+        std::string current = "layer" + std::to_string(l);
+        out << "        alignas(64) float " << current << "[" << sizes[l + 1] << "];\n";
+        out << "        EmbeddedMLP::layer<" << sizes[l] << ", " << sizes[l + 1] << ">(" << previous << ", WEIGHTS_"
+            << l << ", BIAS_" << l << ", " << current << ");\n";
+        previous = current;
+    }
+    out << "        return EmbeddedMLP::output<OUTPUT_SIZE>(" << previous << ", OUTPUT_SCALE, scores);\n";
+    out << "    }\n";
+    out << "}\n";
+
+    out.close();
+    if (out.fail()) {
+        LOG_E("ERROR: Could not write " << headerPath);
+        return Code::ERROR;
+    }
+
+    std::stringstream topology;
+    for (size_t i = 0; i < sizes.size(); i++) {
+        topology << (i > 0 ? "_" : "") << sizes[i];
+    }
+    LOG_I("Model " << modelPath << " (" << topology.str() << ") compiled to " << headerPath);
+    return Code::SUCCESS;
+}
+
+int main(int argc, const char **argv) {
+    try {
+        TCLAP::CmdLine cmd(
+                "!!! Help for model_codegen program. !!!"
+                        "\nGenerate a C++ header embedding a trained model (used by the EMBED_MODEL build option)."
+                        "\nUsage example:"
+                        "\n./model_codegen.exe -m generated_models/model.xml -o EmbeddedModel.hpp"
+                        "\nWritten by Loris Friedel",
+                ' ', "1.0");
+
+        TCLAP::ValueArg<std::string> modelArg("m", "model",
+                                              "Model to compile (.xml saved by learning.exe). Default value is " +
+                                              Default::MODEL_PATH,
+                                              false, Default::MODEL_PATH, "FILE_PATH", cmd);
+
+        TCLAP::ValueArg<std::string> outputArg("o", "output",
+                                               "Path of the generated header. Default value is EmbeddedModel.hpp",
+                                               false, "EmbeddedModel.hpp", "FILE_PATH", cmd);
+
+        TCLAP::ValueArg<std::string> namespaceArg("n", "namespace",
+                                                  "Namespace of the generated code. Default value is EmbeddedModel",
+                                                  false, "EmbeddedModel", "NAME", cmd);
+
+        TCLAP::ValueArg<std::string> includeArg("c", "include",
+                                                "Path of inc/EmbeddedMLP.hpp as included by the generated header. Default value is EmbeddedMLP.hpp",
+                                                false, "EmbeddedMLP.hpp", "FILE_PATH", cmd);
+
+        //// Parse the argv array
+        cmd.parse(argc, argv);
+
+        //// Get the value parsed by each arg and handle them
+        return generateHeader(modelArg.getValue(), outputArg.getValue(), namespaceArg.getValue(),
+                              includeArg.getValue());
+    } catch (TCLAP::ArgException &e) {  // catch any exceptions
+        LOG_E("error: " << e.error() << " for arg " << e.argId());
+    }
+
+    LOG_E("Program exited with errors");
+    return Code::ERROR;
+}
@@ -0,0 +1,162 @@
+//
+// @author Loris Friedel
+//
+
+#include <tclap/CmdLine.h>
+#include <cv.hpp>
+#include "../inc/code.h"
+#include "../inc/log.h"
+#include "../inc/constant.h"
+#include "../inc/FeatureSpec.hpp"
+#include "../inc/LabelMap.hpp"
+#include "../inc/MLPInference.hpp"
+#include "../inc/ModelBundle.hpp"
+#include "../inc/Timer.hpp"
+
+/**
+ * @return time to load the model with the native forward pass, in milliseconds
+ */
+double measureLoading(const std::string &modelPath, MLPInference &inference) {
+    Timer timer;
+    timer.start();
+    int result = inference.load(modelPath);
+    timer.stop();
+    return result == Code::SUCCESS ? timer.getDurationMS() : -1;
+}
+
+/**
+ * Convert an OpenCV model into a model bundle with the given metadata, then load both and check that they
+ * give the same outputs.
+ */
+int convertModel(const std::string &modelPath, const std::string &outputPath, const FeatureSpec &feature,
+                 const double featureScale, const LabelMap &labelMap) {
+    ModelBundle bundle;
+    {
+        cv::FileStorage fs(modelPath, cv::FileStorage::READ);
+        if (!fs.isOpened()) {
+            LOG_E("ERROR: Could not read the classifier : " << modelPath);
+            return Code::ERROR;
+        }
+        cv::FileNode root = fs["opencv_ml_ann_mlp"];
+        if (root.empty()) {
+            root = fs.getFirstTopLevelNode();
+        }
+        if (bundle.readNetwork(root) != Code::SUCCESS) {
+            LOG_E("ERROR: Not an OpenCV ANN_MLP model : " << modelPath);
+            return Code::ERROR;
+        }
+    }
+    bundle.feature = feature.toString();
+    bundle.featureScale = featureScale;
+    bundle.labelMap = labelMap;
+
+    if (bundle.save(outputPath) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+
+    MLPInference xmlInference, bundleInference;
+    double xmlMS = measureLoading(modelPath, xmlInference);
+    double bundleMS = measureLoading(outputPath, bundleInference);
+    if (xmlMS < 0 || bundleMS < 0) {
+        LOG_E("ERROR: Could not load back " << (bundleMS < 0 ? outputPath : modelPath));
+        return Code::ERROR;
+    }
+
+    cv::Mat samples(64, bundle.getInputSize(), CV_32FC1);
+    cv::randu(samples, 0, 1 / featureScale);
+    cv::Mat xmlLabels, xmlConfidences, xmlScores, labels, confidences, scores;
+    xmlInference.predictBatch(samples, xmlLabels, xmlConfidences, &xmlScores);
+    bundleInference.predictBatch(samples, labels, confidences, &scores);
+    double maxDiff = cv::norm(scores, xmlScores, cv::NORM_INF);
+
+    std::stringstream topology;
+    for (size_t i = 0; i < bundle.layerSizes.size(); i++) {
+        topology << (i > 0 ? "_" : "") << bundle.layerSizes[i];
+    }
+    LOG_I("Model " << modelPath << " (" << topology.str() << ") converted to " << outputPath);
+    LOG_I(" - Feature: " << bundle.feature << ", scaled by " << bundle.featureScale);
+    LOG_I(" - Labels: " << (bundle.labelMap.empty() ? "none" : "from the label map"));
+    LOG_I(" - Loading: " << xmlMS << " ms (OpenCV model) / " << bundleMS << " ms (bundle)");
+    LOG_I(" - Max output difference: " << maxDiff);
+
+    return maxDiff == 0 ? Code::SUCCESS : Code::ERROR;
+}
+
+int main(int argc, const char **argv) {
+    try {
+        TCLAP::CmdLine cmd(
+                "!!! Help for model_convert program. !!!"
+                        "\nConvert a model saved by OpenCV (.xml) into a model bundle (" + Default::MODEL_BUNDLE_EXT +
+                        "): one binary file with the weights, the feature and the label map, loaded without parsing."
+                        "\nUsage example:"
+                        "\n./model_convert.exe -m generated_models/model.xml -e label_map.yml"
+                        "\nWritten by Loris Friedel",
+                ' ', "1.0");
+
+        TCLAP::ValueArg<std::string> modelArg("m", "model",
+                                              "Model to convert (.xml saved by learning.exe). Default value is " +
+                                              Default::MODEL_PATH,
+                                              false, Default::MODEL_PATH, "FILE_PATH", cmd);
+
+        TCLAP::ValueArg<std::string> outputArg("o", "output",
+                                               "Path of the model bundle. Default value is the model path with a " +
+                                               Default::MODEL_BUNDLE_EXT + " extension",
+                                               false, "", "FILE_PATH", cmd);
+
+        TCLAP::ValueArg<std::string> featureArg("k", "feature",
+                                                "Feature the model takes as input. Default value is " +
+                                                Default::FEATURE_BACKPROJ,
+                                                false, Default::FEATURE_BACKPROJ, "FEATURE_SPEC", cmd);
+
+        TCLAP::ValueArg<double> featureScaleArg("s", "feature-scale",
+                                                "Factor applied to the feature values before the model. Default value is 1/255,"
+                                                        " the scaling sign_detect applies for models without metadata",
+                                                false, Default::HAND_INPUT_SCALE, "POSITIVE_FLOAT", cmd);
+
+        TCLAP::ValueArg<std::string> labelMapArg("e", "label-map",
+                                                 "Specify the path to a YML file that contains a mapping for label (string -> label (int))",
+                                                 false, "", "pathToYmlFile", cmd);
+
+        //// Parse the argv array
+        cmd.parse(argc, argv);
+
+        //// Get the value parsed by each arg and handle them
+        LabelMap labelMap;
+        if (labelMapArg.isSet()) {
+            cv::FileStorage fs(labelMapArg.getValue(), cv::FileStorage::READ);
+            if (fs.isOpened()) {
+                fs[Default::KEY_MAP] >> labelMap;
+            } else {
+                LOG_E("ERROR: Could not read label map .yml file: " << labelMapArg.getValue());
+                return Code::ERROR;
+            }
+            fs.release();
+        }
+
+        FeatureSpec feature;
+        if (FeatureSpec::parse(featureArg.getValue(), feature) != Code::SUCCESS) {
+            return Code::ERROR;
+        }
+        if (featureScaleArg.getValue() <= 0) {
+            LOG_E("ERROR: The feature scale must be positive");
+            return Code::ERROR;
+        }
+
+        std::string &modelPath = modelArg.getValue();
+        std::string outputPath = outputArg.getValue();
+        if (outputPath.empty()) {
+            std::string base = modelPath;
+            if (base.size() > 4 && base.compare(base.size() - 4, 4, ".xml") == 0) {
+                base = base.substr(0, base.size() - 4);
+            }
+            outputPath = base + Default::MODEL_BUNDLE_EXT;
+        }
+
+        return convertModel(modelPath, outputPath, feature, featureScaleArg.getValue(), labelMap);
+    } catch (TCLAP::ArgException &e) {  // catch any exceptions
+        LOG_E("error: " << e.error() << " for arg " << e.argId());
+    }
+
+    LOG_E("Program exited with errors");
+    return Code::ERROR;
+}
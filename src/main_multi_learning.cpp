@@ -2,14 +2,501 @@
 
 #include <tclap/CmdLine.h>
 #include <cv.hpp>
-#include <regex>
-#include <random>
+#include <chrono>
+#include <iomanip>
+#include <set>
+#include <sstream>
 #include <thread>
 #include "../inc/code.h"
 #include "../inc/log.h"
 #include "../inc/MLPModel.hpp"
 #include "../inc/MultiConfig.hpp"
 #include "../inc/Learning.hpp"
+#include "../inc/DataBatchStream.hpp"
+#include "../inc/DatasetRegistry.hpp"
+#include "../inc/Hash.hpp"
+#include "../inc/JobScheduler.hpp"
+#include "../inc/JobSpool.hpp"
+#include "../inc/Timer.hpp"
+#include "../inc/TrainingManifest.hpp"
+#include "../inc/ParallelFor.hpp"
+
+struct Dataset {
+    std::string name;
+    std::string type;
+    std::string dir;
+    uint64_t fingerprint = 0; // of the data files (see fingerprintData)
+    std::vector<std::string> topologies; // not trained yet
+
+    int nbOfSamples = 0;
+    int sampleSize = 0;
+    size_t bytes = 0; // estimated, 0 when streaming
+    size_t trainingBytes = 0; // estimated, per running job, 0 when streaming
+    double cost = 0; // estimated, all topologies together
+};
+
+/**
+ * Count the samples of the data set, without loading it.
+ */
+int prepareDataset(Dataset &dataset, const MultiConfig &config) {
+    DataBatchStream stream(dataset.dir, 1);
+    if (stream.open() != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    dataset.nbOfSamples = stream.getNbOfSamples();
+    dataset.sampleSize = stream.getSampleSize();
+    if (config.batchSize <= 0) {
+        dataset.bytes = DatasetRegistry::estimateBytes(dataset.nbOfSamples, dataset.sampleSize);
+        dataset.trainingBytes = DatasetRegistry::estimateTrainingBytes(dataset.nbOfSamples, dataset.sampleSize,
+                                                                       !config.optimizer.empty());
+    }
+    return Code::SUCCESS;
+}
+
+/**
+ * @return estimated training cost of the topology on the data set (the output layer has one neuron per sample
+ * value, see MLPModel::learnFrom)
+ */
+double estimateCost(const Dataset &dataset, const std::string &topology) {
+    const int nbOfOutputs = dataset.sampleSize;
+    return (double) MLPModel(topology).estimateNbOfWeights(dataset.sampleSize, nbOfOutputs) * dataset.nbOfSamples;
+}
+
+std::string modelPathFor(const Dataset &dataset, const std::string &topology, const MultiConfig &config) {
+    std::stringstream modelPath;
+    modelPath << config.modelDir << "/model_" << dataset.name << "_" << topology << "_" << dataset.type << ".xml";
+    return modelPath.str();
+}
+
+/**
+ * @return hash of everything the model trained by the job depends on
+ */
+uint64_t jobHash(const Dataset &dataset, const std::string &topology, const MultiConfig &config) {
+    const bool native = !config.optimizer.empty();
+    Hash hash;
+    hash.add(dataset.dir).add(dataset.fingerprint).add(dataset.name).add(dataset.type).add(topology)
+            .add(modelPathFor(dataset, topology, config));
+    hash.add(config.batchSize > 0 ? config.batchSize : 0).add(config.batchSize > 0 || native ? config.epochs : 0);
+    if (native) {
+        hash.add(config.optimizer).add(config.learningRate).add(config.miniBatch);
+    }
+    return hash.get();
+}
+
+/**
+ * Train the model with the native trainer if an optimizer is given, with the OpenCV training otherwise.
+ *
+ * @return success code (error if the optimizer is unknown)
+ */
+int setOptimizer(MLPModel &model, const std::string &optimizer, const double learningRate, const int miniBatch,
+                 const int epochs) {
+    if (optimizer.empty()) {
+        return Code::SUCCESS;
+    }
+    MLPTrainer::Params params;
+    if (MLPTrainer::parseOptimizer(optimizer, params.optimizer) != Code::SUCCESS) {
+        LOG_E("ERROR: Unknown optimizer " << optimizer << " (sgd, momentum or adam)");
+        return Code::ERROR;
+    }
+    params.learningRate = learningRate;
+    params.batchSize = std::max(1, miniBatch);
+    params.nbOfEpochs = std::max(1, epochs);
+    model.setOptimizer(params);
+    return Code::SUCCESS;
+}
+
+/**
+ * Train one topology on one data set, export the model and record it in the manifest.
+ */
+void trainAndExport(const Dataset &dataset, const std::string &topology, const MultiConfig &config,
+                    DatasetRegistry &registry, TrainingManifest &manifest, const int threadBudget) {
+    Timer timer;
+    timer.start();
+    MLPModel model(topology);
+    LOGP_I(&model, "Start training " << topology << " on " << dataset.name << " data");
+
+    if (setOptimizer(model, config.optimizer, config.learningRate, config.miniBatch, config.epochs) != Code::SUCCESS) {
+        return;
+    }
+
+    int learningCode;
+    if (config.batchSize > 0) {
+        // Streaming: every model reads its own mini-batches, nothing is loaded up front
+        DataBatchStream stream(dataset.dir, config.batchSize, config.prefetch, threadBudget);
+        learningCode = stream.open() == Code::SUCCESS ? model.learnFrom(stream, config.epochs) : Code::ERROR;
+    } else {
+        std::shared_ptr<const DatasetRegistry::Dataset> data = registry.acquire(dataset.dir);
+        learningCode = data ? model.learnFrom(data->data, data->responses) : Code::ERROR;
+    }
+
+    if (learningCode != Code::SUCCESS) {
+        LOGP_E(&model, "ERROR: training " << topology << " on " << dataset.name << " data of type " << dataset.type
+                                          << " failed.");
+        return;
+    }
+
+    std::string modelPath = modelPathFor(dataset, topology, config);
+    if (model.exportModelTo(modelPath) != Code::SUCCESS) {
+        LOGP_E(&model, "ERROR: exporting " << modelPath << " failed.");
+        return;
+    }
+    timer.stop();
+    manifest.record(jobHash(dataset, topology, config), modelPath, timer.getDurationS());
+}
+
+/**
+ * Train every topology on the given data sets: one job per model, run by a pool sized to the hardware.
+ * The jobs of a data set run together, largest data sets and models first: a data set is loaded by its first
+ * job and evicted after its last one.
+ */
+void trainWave(const std::vector<const Dataset *> &wave, const MultiConfig &config, DatasetRegistry &registry,
+               TrainingManifest &manifest) {
+    JobScheduler scheduler(config.threads);
+    for (size_t group = 0; group < wave.size(); group++) {
+        const Dataset &dataset = *wave[group];
+        if (config.batchSize <= 0) {
+            registry.expect(dataset.dir, (int) dataset.topologies.size());
+        }
+        for (const std::string &topology : dataset.topologies) {
+            scheduler.submit(estimateCost(dataset, topology), [&dataset, topology, &config, &registry, &manifest,
+                    &scheduler](int worker) {
+                trainAndExport(dataset, topology, config, registry, manifest, scheduler.getThreadBudget());
+                if (config.batchSize <= 0) {
+                    registry.release(dataset.dir);
+                }
+            }, (int) group);
+        }
+    }
+
+    // Process wide: set once so that the workers together stay within the thread count
+    const int threadBudget = scheduler.getThreadBudget();
+    cv::setNumThreads(threadBudget);
+    LOG_I("Training " << wave.size() << " data set(s) with " << scheduler.getNbOfWorkers() << " workers, "
+                      << threadBudget << " OpenCV thread(s) each");
+
+    Timer timer;
+    timer.start();
+    scheduler.run();
+    timer.stop();
+    LOG_I("Done training " << wave.size() << " data set(s) (" << timer.getDurationS() << " s, "
+                           << scheduler.getNbOfSteals() << " jobs stolen)");
+}
+
+/**
+ * List the data sets of every type with the topologies still to train on them (the models recorded by a previous
+ * run are skipped), largest estimated cost first.
+ */
+int collectDatasets(const MultiConfig &config, const TrainingManifest &manifest, std::vector<Dataset> &datasets) {
+    int code = Code::SUCCESS;
+    int nbOfSkippedJobs = 0;
+    for (const std::string &type : config.types) {
+        for (const std::string &name : config.names) {
+            Dataset dataset;
+            dataset.name = name;
+            dataset.type = type;
+            dataset.dir = config.dataDir + "/" + name + "_" + type;
+            if (fingerprintData(dataset.dir, dataset.fingerprint) != Code::SUCCESS) {
+                LOG_E("ERROR: Could not list training data \"" << dataset.dir << "\"");
+                code = Code::ERROR;
+                continue;
+            }
+            for (const std::string &topology : config.topologies) {
+                if (manifest.isDone(jobHash(dataset, topology, config))) {
+                    nbOfSkippedJobs++;
+                } else {
+                    dataset.topologies.push_back(topology);
+                }
+            }
+            if (dataset.topologies.empty()) {
+                continue;
+            }
+            if (prepareDataset(dataset, config) != Code::SUCCESS) {
+                LOG_E("ERROR: Could not load training data \"" << dataset.dir << "\"");
+                code = Code::ERROR;
+                continue;
+            }
+            for (const std::string &topology : dataset.topologies) {
+                dataset.cost += estimateCost(dataset, topology);
+            }
+            datasets.push_back(dataset);
+        }
+    }
+    std::stable_sort(datasets.begin(), datasets.end(), [](const Dataset &a, const Dataset &b) {
+        return a.cost > b.cost;
+    });
+    if (nbOfSkippedJobs > 0) {
+        LOG_I("Skipping " << nbOfSkippedJobs << " models already trained (" << manifest.size() << " recorded in "
+                          << config.modelDir << "/" << Default::TRAINING_MANIFEST_NAME << ")");
+    }
+    return code;
+}
+
+/**
+ * Train every topology on every data set of every type, except the models recorded by a previous run.
+ * Data sets are taken largest first and split into waves whose estimated memory (the data sets, plus the training
+ * copy of each worker) fits in the budget: only the data sets of the running wave are resident. A data set that
+ * does not fit on its own is not trained.
+ */
+int trainAll(const MultiConfig &config) {
+    TrainingManifest manifest(config.modelDir + "/" + Default::TRAINING_MANIFEST_NAME);
+    if (manifest.load() != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    TrainingManifest::removePartialOutputs(config.modelDir, Default::SPOOL_LEASE_MS);
+
+    std::vector<Dataset> datasets;
+    int code = collectDatasets(config, manifest, datasets);
+
+    DatasetRegistry registry((size_t) std::max(0, config.maxMemoryMB) * 1024 * 1024, config.threads, config.cache);
+    const size_t nbOfThreads = (size_t) resolveThreadCount(config.threads);
+    // Resident data sets, plus the copy each worker of the wave allocates for the job it trains
+    auto estimateWave = [nbOfThreads](size_t bytes, size_t nbOfJobs, size_t trainingBytes) {
+        return bytes + std::min(nbOfThreads, nbOfJobs) * trainingBytes;
+    };
+
+    std::vector<const Dataset *> wave;
+    size_t waveBytes = 0, waveJobs = 0, waveTrainingBytes = 0;
+    for (const Dataset &dataset : datasets) {
+        if (!registry.fits(estimateWave(dataset.bytes, dataset.topologies.size(), dataset.trainingBytes))) {
+            LOG_E("ERROR: Training on " << dataset.dir << " needs about "
+                                        << estimateWave(dataset.bytes, dataset.topologies.size(),
+                                                        dataset.trainingBytes) / (1024 * 1024)
+                                        << " MB, more than maxMemoryMB: stream it (batchSize) or raise the budget");
+            code = Code::ERROR;
+            continue;
+        }
+        const size_t nextJobs = waveJobs + dataset.topologies.size();
+        const size_t nextTrainingBytes = std::max(waveTrainingBytes, dataset.trainingBytes);
+        if (!wave.empty() && !registry.fits(estimateWave(waveBytes + dataset.bytes, nextJobs, nextTrainingBytes))) {
+            trainWave(wave, config, registry, manifest);
+            wave.clear();
+            waveBytes = waveJobs = waveTrainingBytes = 0;
+        }
+        wave.push_back(&dataset);
+        waveBytes += dataset.bytes;
+        waveJobs += dataset.topologies.size();
+        waveTrainingBytes = std::max(waveTrainingBytes, dataset.trainingBytes);
+    }
+    if (!wave.empty()) {
+        trainWave(wave, config, registry, manifest);
+    }
+
+    if (config.batchSize <= 0) {
+        LOG_I("Peak memory of the resident data sets: " << registry.getPeakBytes() / (1024 * 1024) << " MB"
+                                                        << (config.maxMemoryMB > 0 ? " (budget: " +
+                                                            std::to_string(config.maxMemoryMB) + " MB)" : ""));
+    }
+    return code;
+}
+
+/**
+ * Train the job claimed from the spool and export its model.
+ * An in memory data set is loaded through a float cache next to it, written by the first worker loading it: the
+ * next ones map it, and share its pages when they run on the same host. The data set stays mapped for the next
+ * job: consecutive jobs on the same data set do not load it again.
+ */
+JobSpool::Result trainSpoolJob(const JobSpool::Job &job, const int nbThreads, std::string &loadedSource,
+                               cv::Mat &data, cv::Mat &responses) {
+    JobSpool::Result result;
+    result.id = job.id;
+    result.modelPath = job.modelPath;
+    result.worker = JobSpool::workerId();
+
+    Timer timer;
+    timer.start();
+    MLPModel model(job.topology);
+    LOGP_I(&model, "Start training " << job.topology << " on " << job.name << " data of type " << job.type
+                                     << " (job " << job.id << ")");
+
+    if (setOptimizer(model, job.optimizer, job.learningRate, job.miniBatch, job.epochs) != Code::SUCCESS) {
+        return result;
+    }
+
+    int learningCode;
+    if (job.batchSize > 0) {
+        DataBatchStream stream(job.source, job.batchSize, job.prefetch, nbThreads);
+        learningCode = stream.open() == Code::SUCCESS ? model.learnFrom(stream, job.epochs) : Code::ERROR;
+    } else {
+        if (loadedSource != job.source) {
+            loadedSource.clear();
+            if (aggregateDataFrom(job.source, data, responses, nbThreads, true, CV_32F) != Code::SUCCESS) {
+                LOG_E("ERROR: Could not load training data \"" << job.source << "\"");
+                return result;
+            }
+            loadedSource = job.source;
+        }
+        learningCode = model.learnFrom(data, responses);
+    }
+
+    if (learningCode != Code::SUCCESS || model.exportModelTo(job.modelPath) != Code::SUCCESS) {
+        LOGP_E(&model, "ERROR: job " << job.id << " (" << job.topology << " on " << job.name << " data of type "
+                                     << job.type << ") failed.");
+        return result;
+    }
+    timer.stop();
+    result.trainSeconds = timer.getDurationS();
+    result.success = true;
+    return result;
+}
+
+/**
+ * Worker: claim, train and publish the jobs of the spool until it is closed and none is queued or claimed.
+ */
+int runWorker(const std::string &spoolDir, const int leaseMS, const int nbThreads) {
+    JobSpool spool(spoolDir);
+    if (spool.create() != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    // One job at a time: the process threads all go to OpenCV
+    cv::setNumThreads(resolveThreadCount(nbThreads));
+    LOG_I("Worker " << JobSpool::workerId() << " polling " << spoolDir);
+
+    std::string loadedSource;
+    cv::Mat data, responses;
+    int nbOfJobs = 0, nbOfFailures = 0;
+    while (true) {
+        JobSpool::Job job;
+        if (spool.claim(job)) {
+            JobSpool::Result result;
+            {
+                JobSpool::Lease lease(job, leaseMS);
+                result = trainSpoolJob(job, nbThreads, loadedSource, data, responses);
+                if (!lease.isHeld()) {
+                    LOG_E("WARNING: Job " << job.id << " was queued again while running, publishing it anyway");
+                }
+            }
+            spool.publish(job, result);
+            nbOfJobs++;
+            nbOfFailures += result.success ? 0 : 1;
+            continue;
+        }
+
+        if (spool.requeueExpired(leaseMS) > 0) {
+            continue;
+        }
+        // Closed first: a job submitted after the listings would otherwise be missed
+        if (spool.isClosed() && spool.list(JobSpool::QUEUED).empty() && spool.list(JobSpool::CLAIMED).empty()) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(Default::SPOOL_POLL_MS));
+    }
+
+    LOG_I("Worker " << JobSpool::workerId() << " done: " << nbOfJobs << " jobs, " << nbOfFailures << " failed");
+    return nbOfFailures == 0 ? Code::SUCCESS : Code::ERROR;
+}
+
+/**
+ * Coordinator: queue every job of the configuration in the spool and close it, then wait for the workers, queue
+ * again the jobs of dead workers and record the finished models in the manifest.
+ * A job whose file disappears from the spool, or whose result can not be read, counts as failed after a few polls.
+ */
+int runCoordinator(const MultiConfig &config, const std::string &spoolDir, const int leaseMS) {
+    TrainingManifest manifest(config.modelDir + "/" + Default::TRAINING_MANIFEST_NAME);
+    if (manifest.load() != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    TrainingManifest::removePartialOutputs(config.modelDir, leaseMS);
+
+    JobSpool spool(spoolDir);
+    if (spool.create() != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+
+    std::vector<Dataset> datasets;
+    int code = collectDatasets(config, manifest, datasets);
+    if (spool.setClosed(false) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+
+    // Nothing is loaded here: the workers pack the in memory data sets when they first need them
+    std::map<std::string, uint64_t> jobHashes;
+    for (const Dataset &dataset : datasets) {
+        for (const std::string &topology : dataset.topologies) {
+            uint64_t hash = jobHash(dataset, topology, config);
+            std::stringstream id;
+            id << std::hex << std::setw(16) << std::setfill('0') << hash;
+
+            JobSpool::Job job;
+            job.id = id.str();
+            job.name = dataset.name;
+            job.type = dataset.type;
+            job.topology = topology;
+            job.source = dataset.dir;
+            job.modelPath = modelPathFor(dataset, topology, config);
+            job.batchSize = config.batchSize;
+            job.prefetch = config.prefetch;
+            job.epochs = config.epochs;
+            job.optimizer = config.optimizer;
+            job.learningRate = config.learningRate;
+            job.miniBatch = config.miniBatch;
+            if (spool.submit(job) != Code::SUCCESS) {
+                code = Code::ERROR;
+                continue;
+            }
+            jobHashes[job.id] = hash;
+        }
+    }
+    if (spool.setClosed(true) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    LOG_I(jobHashes.size() << " jobs queued in " << spoolDir << ", start workers with: multi_learning.exe -w -s "
+                           << spoolDir);
+
+    std::set<std::string> finished;
+    std::map<std::string, int> misses;
+    int nbOfFailures = 0;
+    while (finished.size() < jobHashes.size()) {
+        spool.requeueExpired(leaseMS);
+
+        // Pending listed first: a job finishing in between is then seen done rather than missing
+        std::set<std::string> seen;
+        for (const std::string &state : {JobSpool::QUEUED, JobSpool::CLAIMED}) {
+            for (const std::string &id : spool.list(state)) {
+                seen.insert(id);
+            }
+        }
+        for (const std::string &state : {JobSpool::DONE, JobSpool::FAILED}) {
+            for (const std::string &id : spool.list(state)) {
+                JobSpool::Result result;
+                if (jobHashes.count(id) == 0 || finished.count(id) > 0
+                    || spool.readResult(id, result) != Code::SUCCESS) {
+                    continue;
+                }
+                seen.insert(id);
+                finished.insert(id);
+                if (result.success && manifest.record(jobHashes[id], result.modelPath, result.trainSeconds)
+                                      == Code::SUCCESS) {
+                    LOG_I("[" << finished.size() << "/" << jobHashes.size() << "] " << result.modelPath
+                              << " trained by " << result.worker << " (" << result.trainSeconds << " s)");
+                } else {
+                    LOG_E("[" << finished.size() << "/" << jobHashes.size() << "] ERROR: job " << id
+                              << " failed on " << result.worker);
+                    nbOfFailures++;
+                }
+            }
+        }
+
+        // Neither pending nor readable: the job file was removed, or its result is corrupted
+        for (const auto &job : jobHashes) {
+            const std::string &id = job.first;
+            if (finished.count(id) > 0 || seen.count(id) > 0) {
+                misses.erase(id);
+            } else if (++misses[id] >= Default::SPOOL_MAX_MISSES) {
+                finished.insert(id);
+                LOG_E("[" << finished.size() << "/" << jobHashes.size() << "] ERROR: job " << id
+                          << " is no longer in the spool or its result can not be read");
+                nbOfFailures++;
+            }
+        }
+
+        if (finished.size() < jobHashes.size()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(Default::SPOOL_POLL_MS));
+        }
+    }
+
+    LOG_I("All jobs finished, " << nbOfFailures << " failed");
+    return nbOfFailures == 0 ? code : Code::ERROR;
+}
 
 int main(int argc, const char **argv) {
     try {
@@ -23,108 +510,49 @@ int main(int argc, const char **argv) {
                                                    false, "./multi_learning_config_example.yml",
                                                    "PATH_TO_JSON_CONFIG_FILE", cmd);
 
+        TCLAP::ValueArg<std::string> spoolArg("s", "spool",
+                                              "Spool directory shared by several processes (possibly on other hosts): without --worker, queue the jobs of the configuration in it and wait for the workers",
+                                              false, "", "DIRECTORY_PATH", cmd);
+
+        TCLAP::SwitchArg workerArg("w", "worker",
+                                   "Train the jobs queued in the spool directory (the configuration file is not read)",
+                                   cmd, false);
+
+        TCLAP::ValueArg<int> leaseArg("l", "lease",
+                                      "Seconds after which the job of a worker that stopped renewing its claim is queued again. Default value is " +
+                                      std::to_string(Default::SPOOL_LEASE_MS / 1000),
+                                      false, Default::SPOOL_LEASE_MS / 1000, "POSITIVE_INTEGER", cmd);
+
+        TCLAP::ValueArg<int> threadsArg("j", "threads",
+                                        "Worker: number of OpenCV threads (0: one per hardware thread). Default value is 0",
+                                        false, 0, "INTEGER", cmd);
+
         //// Parse the argv array
         cmd.parse(argc, argv);
 
         //// Get the value parsed by each arg and handle them
+        const int leaseMS = std::max(1, leaseArg.getValue()) * 1000;
+        if (workerArg.getValue()) {
+            if (!spoolArg.isSet()) {
+                LOG_E("ERROR: --worker needs a spool directory (--spool)");
+                return Code::ERROR;
+            }
+            return runWorker(spoolArg.getValue(), leaseMS, threadsArg.getValue());
+        }
+
         std::string &configPath = configFileArg.getValue();
         MultiConfig config(configPath);
 
         // TODO Add log redirection
 
-        // For each data type
-        std::vector<std::thread> learningThreads;
-
-        for (std::string type : config.types) {
-            using namespace std;
-            using namespace cv;
-
-            map<string, pair<Mat *, Mat *> *> datasetMap;
-
-            // For each dataset
-            for (string name : config.names) {
-                LOG_I("Start thread for " << name << " data");
-                learningThreads.push_back(std::thread(
-                        [name, type, &datasetMap, &config]() {
-                            // ON ANOTHER THREAD
-                            using namespace std;
-                            using namespace cv;
-
-                            Mat *data = new Mat();
-                            Mat *responses = new Mat();
-
-                            stringstream trainDir;
-                            trainDir << config.dataDir << "/" << name << "_" << type;
-
-                            // Load data just in time
-                            int loadDataCode = aggregateDataFrom(trainDir.str(), *data, *responses);
-                            if (loadDataCode != Code::SUCCESS) {
-                                LOG_E("ERROR: Could not load training data \"" << trainDir.str() << "\"");
-                                delete data;
-                                delete responses;
-                            } else {
-                                datasetMap[name] = new pair<Mat *, Mat *>(data, responses);
-
-                                vector<thread> topoThreads;
-                                // For each topology, train a model
-                                for (string topology : config.topologies) {
-                                    // ON ANOTHER THREAD
-                                    topoThreads.push_back(
-                                            thread([topology, name, &data, &responses, &config, &type]() {
-                                                MLPModel *model = new MLPModel(topology);
-                                                LOGP_I(model, "Start thread for training " << topology << " on " << name
-                                                                                           << " data");
-
-                                                int learningCode = model->learnFrom(*data, *responses);
-                                                if (learningCode == Code::SUCCESS) {
-
-                                                    std::stringstream modelDir;
-                                                    modelDir << config.modelDir << "/model_" << name << "_" << topology
-                                                             << "_"
-                                                             << type
-                                                             << ".xml";
-
-                                                    int exportCode = model->exportModelTo(modelDir.str());
-                                                    if (exportCode != Code::SUCCESS) {
-                                                        LOGP_E(model,
-                                                               "ERROR: exporting " << modelDir.str() << " failed.");
-                                                    }
-                                                } else {
-                                                    LOGP_E(model, "ERROR: training " << topology << " on " << name
-                                                                                     << " data of type "
-                                                                                     << type
-                                                                                     << " failed.");
-                                                }
-                                            }));
-                                    // END: ON ANOTHER THREAD
-                                }
-
-                                for (std::thread &t : topoThreads) {
-                                    t.join();
-                                };
-                            }
-                            // END: ON ANOTHER THREAD
-                        }
-                ));
-            }
-
-            for (std::thread &t : learningThreads) {
-                t.join();
-            };
-
-            // Delete everything
-            for (auto &entry : datasetMap) {
-                delete entry.second->first; // Delete input data
-                delete entry.second->second; // Delete responses
-                delete entry.second; // Delete pair
-            }
+        if (spoolArg.isSet()) {
+            return runCoordinator(config, spoolArg.getValue(), leaseMS);
         }
-
-        return Code::SUCCESS;
+        return trainAll(config);
     } catch (TCLAP::ArgException &e) {  // catch any exceptions
         LOG_E("error: " << e.error() << " for arg " << e.argId());
     }
 
     LOG_E("Program exited with errors");
     return Code::ERROR;
-}
\ No newline at end of file
+}
@@ -0,0 +1,199 @@
+//
+// @author Loris Friedel
+//
+
+#include <tclap/CmdLine.h>
+#include <cv.hpp>
+#include "../inc/code.h"
+#include "../inc/log.h"
+#include "../inc/constant.h"
+#include "../inc/Learning.hpp"
+#include "../inc/LabelMap.hpp"
+#include "../inc/MLPModel.hpp"
+#include "../inc/MLPInference.hpp"
+#include "../inc/Timer.hpp"
+
+/**
+ * @return single-sample prediction latency in microseconds
+ */
+double measureLatency(MLPInference &inference, const cv::Mat &data, const int nbRuns) {
+    Timer timer;
+    timer.start();
+    for (int run = 0; run < nbRuns; run++) {
+        for (int i = 0; i < data.rows; i++) {
+            inference.predict(data.ptr<float>(i));
+        }
+    }
+    timer.stop();
+    return timer.getDurationMS() * 1000 / nbRuns / data.rows;
+}
+
+double successRate(const StatPredict *stat) {
+    if (stat == nullptr || stat->stats.empty()) {
+        return 0;
+    }
+    return (double) stat->successAndFailure().first / (double) stat->stats.size();
+}
+
+/**
+ * Quantize the model with the calibration data, save it, load it back, then compare it with the float model
+ * on the test data: success rate per label, labels agreement, weights size and latency.
+ */
+int quantizeModel(const std::string &modelPath, const std::string &calibrationDir, const std::string &testDir,
+                  const std::string &outputPath, LabelMap &labelMap, const int nbRuns) {
+    MLPModel model;
+    model.setLabelMap(labelMap);
+    MLPInference floatInference;
+    if (model.learnFrom(modelPath) != Code::SUCCESS || floatInference.load(modelPath) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+
+    cv::Mat calibrationData, calibrationResponses;
+    if (aggregateDataFrom(calibrationDir, calibrationData, calibrationResponses) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    if (calibrationData.cols != model.getInputSize()) {
+        LOG_E("ERROR: Calibration data size (" << calibrationData.cols << ") does not match the model input ("
+                                               << model.getInputSize() << ")");
+        return Code::ERROR;
+    }
+
+    MLPInference quantized;
+    if (quantized.load(modelPath) != Code::SUCCESS || quantized.quantize(calibrationData) != Code::SUCCESS
+        || quantized.saveQuantized(outputPath) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    LOG_I("Quantized model saved to " << outputPath << " (calibrated on " << calibrationData.rows << " samples)");
+
+    // Evaluate what sign_detect will load
+    MLPInference reloaded;
+    if (reloaded.load(outputPath) != Code::SUCCESS || !reloaded.isQuantized()) {
+        LOG_E("ERROR: Could not load back the quantized model " << outputPath);
+        return Code::ERROR;
+    }
+
+    cv::Mat testData, testResponses;
+    if (testDir == calibrationDir) {
+        testData = calibrationData;
+        testResponses = calibrationResponses;
+    } else if (aggregateDataFrom(testDir, testData, testResponses) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    if (testData.cols != model.getInputSize()) {
+        LOG_E("ERROR: Test data size (" << testData.cols << ") does not match the model input ("
+                                        << model.getInputSize() << ")");
+        return Code::ERROR;
+    }
+
+    std::pair<double, std::map<int, StatPredict *>> floatResult = model.testOn(testData, testResponses);
+
+    cv::Mat labels, confidences, scores;
+    reloaded.predictBatch(testData, labels, confidences, &scores);
+    std::pair<double, std::map<int, StatPredict *>> int8Result =
+            MLPModel::collectStats(testResponses, labels, confidences, scores);
+
+    cv::Mat floatLabels, floatConfidences;
+    floatInference.predictBatch(testData, floatLabels, floatConfidences);
+    int nbOfSameLabels = 0;
+    for (int i = 0; i < testData.rows; i++) {
+        nbOfSameLabels += labels.at<int>(i) == floatLabels.at<int>(i) ? 1 : 0;
+    }
+
+    LOG_I("");
+    LOG_I("Model " << modelPath << " " << model.getTopologyStr() << ", " << testData.rows << " test samples");
+    LOG_I("Label: float / int8 success rate (delta)");
+    for (auto it = floatResult.second.begin(); it != floatResult.second.end(); ++it) {
+        double floatRate = successRate(it->second);
+        double int8Rate = successRate(int8Result.second[it->first]);
+        LOG_I(" - " << model.convertLabel(it->first) << ": " << floatRate * 100 << "% / " << int8Rate * 100
+                    << "% (" << (int8Rate - floatRate) * 100 << ")");
+    }
+    LOG_I("Total: " << floatResult.first * 100 << "% / " << int8Result.first * 100 << "% ("
+                    << (int8Result.first - floatResult.first) * 100 << ")");
+    LOG_I("Same labels as the float model: " << nbOfSameLabels << "/" << testData.rows);
+    LOG_I("Weights: " << floatInference.getWeightsSize() << " bytes / " << reloaded.getWeightsSize() << " bytes");
+    LOG_I("Latency (" << MLPInference::isaName(reloaded.getIsa()) << "): "
+                      << measureLatency(floatInference, testData, nbRuns) << " us / "
+                      << measureLatency(reloaded, testData, nbRuns) << " us per sample");
+    LOG_I("");
+
+    for (auto &entry : floatResult.second) {
+        delete entry.second;
+    }
+    for (auto &entry : int8Result.second) {
+        delete entry.second;
+    }
+    return Code::SUCCESS;
+}
+
+int main(int argc, const char **argv) {
+    try {
+        TCLAP::CmdLine cmd(
+                "!!! Help for quantize_model program. !!!"
+                        "\nQuantize a model to 8 bits integers and report the accuracy change per label."
+                        "\nUsage example:"
+                        "\n./quantize_model.exe -m generated_models/model_loris_32_yml.xml -i letters_data -t letters_test"
+                        "\nWritten by Loris Friedel",
+                ' ', "1.0");
+
+        TCLAP::ValueArg<std::string> modelArg("m", "model",
+                                              "Model to quantize (.xml saved by learning.exe)",
+                                              true, "", "FILE_PATH", cmd);
+
+        TCLAP::ValueArg<std::string> calibrationDirArg("i", "calibration-dir",
+                                                       "Data used to calibrate the quantization (.yml directory or packed data set). Default value is " +
+                                                       Default::LETTERS_DATA_PATH,
+                                                       false, Default::LETTERS_DATA_PATH, "DIRECTORY_PATH", cmd);
+
+        TCLAP::ValueArg<std::string> testDirArg("t", "test-dir",
+                                                "Data used to compare the quantized model with the original one. Default value is the calibration data",
+                                                false, "", "DIRECTORY_PATH", cmd);
+
+        TCLAP::ValueArg<std::string> outputArg("o", "output",
+                                               "Path of the quantized model. Default value is the model path with an '" + Default::QUANTIZED_MODEL_SUFFIX + "' suffix",
+                                               false, "", "FILE_PATH", cmd);
+
+        TCLAP::ValueArg<std::string> labelMapArg("e", "label-map",
+                                                 "Specify the path to a YML file that contains a mapping for label (string -> label (int))",
+                                                 false, "", "pathToYmlFile", cmd);
+
+        TCLAP::ValueArg<int> runsArg("r", "runs",
+                                     "Number of runs averaged for the latency. Default value is 3",
+                                     false, 3, "POSITIVE_INTEGER", cmd);
+
+        //// Parse the argv array
+        cmd.parse(argc, argv);
+
+        //// Get the value parsed by each arg and handle them
+        LabelMap labelMap;
+        if (labelMapArg.isSet()) {
+            cv::FileStorage fs(labelMapArg.getValue(), cv::FileStorage::READ);
+            if (fs.isOpened()) {
+                fs[Default::KEY_MAP] >> labelMap;
+            } else {
+                LOG_E("ERROR: Could not read label map .yml file: " << labelMapArg.getValue());
+            }
+            fs.release();
+        }
+
+        std::string &modelPath = modelArg.getValue();
+        std::string &calibrationDir = calibrationDirArg.getValue();
+        std::string testDir = testDirArg.isSet() ? testDirArg.getValue() : calibrationDir;
+        std::string outputPath = outputArg.getValue();
+        if (outputPath.empty()) {
+            std::string base = modelPath;
+            if (base.size() > 4 && base.compare(base.size() - 4, 4, ".xml") == 0) {
+                base = base.substr(0, base.size() - 4);
+            }
+            outputPath = base + Default::QUANTIZED_MODEL_SUFFIX;
+        }
+
+        return quantizeModel(modelPath, calibrationDir, testDir, outputPath, labelMap,
+                             std::max(1, runsArg.getValue()));
+    } catch (TCLAP::ArgException &e) {  // catch any exceptions
+        LOG_E("error: " << e.error() << " for arg " << e.argId());
+    }
+
+    LOG_E("Program exited with errors");
+    return Code::ERROR;
+}
@@ -10,23 +10,63 @@
 #include "../inc/ObjectDetector.hpp"
 #include "../inc/CamshiftRunner.hpp"
 #include "../inc/KeyInputHandler.hpp"
-#include "../inc/DataYmlWriter.hpp"
+#include "../inc/AsyncSampleWriter.hpp"
 #include "../inc/colors.h"
 #include "../inc/constant.h"
 #include "../inc/HandTracker.hpp"
 #include "../inc/MLPModel.hpp"
+#include "../inc/MLPInference.hpp"
+#include "../inc/HandInput.hpp"
+#include "../inc/PredictionCache.hpp"
+#include "../inc/ModelReloader.hpp"
+#include "../inc/ModelBundle.hpp"
+#include "../inc/FeatureSpec.hpp"
 #include "../inc/time.h"
+#ifdef EMBEDDED_MODEL
+#include "EmbeddedModel.hpp"
+
+static_assert(EmbeddedModel::INPUT_SIZE == Default::HAND_INPUT_SIZE * Default::HAND_INPUT_SIZE,
+              "The embedded model must take the hand input of sign_detect");
+#endif
+
+/**
+ * Model used for the per-frame prediction: native forward pass (float or quantized model), OpenCV otherwise.
+ * Model bundles give the size and scaling of the hand input and the label names, defaults are used otherwise.
+ */
+struct HandModel {
+    MLPInference fast;
+    MLPModel fallback;
+    std::vector<float> scores;
+    int inputSize = Default::HAND_INPUT_SIZE;
+    double inputScale = Default::HAND_INPUT_SCALE;
+    LabelMap labelMap;
+
+    /**
+     * @return the loaded model, nullptr if the file can't be loaded
+     */
+    static std::shared_ptr<HandModel> load(const std::string &modelPath);
+
+    std::pair<int, float> predict(cv::Mat &input);
+
+    std::string labelName(int label);
+
+private:
+    /**
+     * Take the hand input configuration and the label names from the metadata of the bundle.
+     */
+    int configure(const ModelBundle &bundle);
+};
 
 int runCamshiftTrackHand(VideoStreamReader &vsr, const cv::CascadeClassifier &cascade,
                          const std::string modelPath, const std::string imageOutPath,
-                         const std::string backprojOutPath);
+                         const std::string backprojOutPath, const int burstSize,
+                         AsyncSampleWriter &sampleWriter, const int cacheSize, const int reloadMS);
 
 void saveImages(const int key, const cv::Mat &img,
                 const CamshiftTracker &cTracker, const cv::Rect hRect,
                 const std::string imageOutPath,
-                const std::string backprojOutPath);
-
-cv::Mat convertToHandInput(const cv::Mat &input, const cv::Rect roi);
+                const std::string backprojOutPath,
+                AsyncSampleWriter &sampleWriter);
 
 cv::Mat cropResizeFlatten(const cv::Mat &input, const cv::Rect &roi);
 
@@ -41,7 +81,8 @@ int main(int argc, const char **argv) {
                         "\n=> Press '*' to toggle backprojection display."
                         "\n=> Press '!' to force the tracker to recalibrate using object detection."
                         "\n=> Press ':' to toggle save image mode."
-                        "\n=> Press any letter to save image and backproj data when save image mode is enabled."
+                        "\n=> Press any letter to save image and backproj data when save image mode is enabled"
+                        " (the next --burst frames are saved)."
                         "\nWritten by Loris Friedel",
                 ' ', "1.0");
 
@@ -65,6 +106,35 @@ int main(int argc, const char **argv) {
                                                             Default::LETTERS_DATA_PATH,
                                                             false, Default::LETTERS_DATA_PATH, "DIRECTORY_PATH", cmd);
 
+        TCLAP::ValueArg<std::string> captureLogArg("l", "capture-log",
+                                                   "Append saved samples (backproj data and cropped image) to a capture log in this directory"
+                                                           " instead of writing one .png and one .yml file per sample. Use capture_compact.exe"
+                                                           " to turn the log into a packed data set.",
+                                                   false, "", "DIRECTORY_PATH", cmd);
+
+        TCLAP::ValueArg<int> burstArg("n", "burst",
+                                      "Number of consecutive frames saved for one key press in save image mode. Default value is " +
+                                      std::to_string(Default::SAVE_BURST_SIZE),
+                                      false, Default::SAVE_BURST_SIZE, "POSITIVE_INTEGER", cmd);
+
+        TCLAP::ValueArg<int> saveQueueArg("q", "save-queue",
+                                          "Number of frames waiting to be written before new saves are dropped. Default value is " +
+                                          std::to_string(Default::SAVE_QUEUE_SIZE),
+                                          false, Default::SAVE_QUEUE_SIZE, "POSITIVE_INTEGER", cmd);
+
+        TCLAP::ValueArg<int> reloadArg("r", "reload",
+                                       "Check the model file every given milliseconds and load it again when it changes,"
+                                               " without stopping the tracking (the current model is kept if the new one"
+                                               " can't be loaded). 0 disables the reload. Default value is " +
+                                       std::to_string(Default::MODEL_RELOAD_MS),
+                                       false, Default::MODEL_RELOAD_MS, "MILLISECONDS", cmd);
+
+        TCLAP::ValueArg<int> cacheArg("c", "cache",
+                                      "Number of predictions cached by hand pattern (backprojection thresholded to one bit"
+                                              " per pixel), so that a still hand is not predicted again. 0 disables the cache."
+                                              " Default value is 0",
+                                      false, 0, "POSITIVE_INTEGER", cmd);
+
         // TODO : mode HOG for prediction
 
         //// Parse the argv array
@@ -74,6 +144,8 @@ int main(int argc, const char **argv) {
         std::string &modelPath = modelArg.getValue();
         std::string &imageOutputPath = imageOutputArg.getValue();
         std::string &backprojOutputPath = imageBackprojOutputArg.getValue();
+        int burstSize = std::max(1, burstArg.getValue());
+        int saveQueueSize = std::max(1, saveQueueArg.getValue());
 
         // Load pre-trained cascade data
         std::string cascadeName = Default::CASCADE_PATH;
@@ -103,7 +175,19 @@ int main(int argc, const char **argv) {
         // If image capture has successfully started, start detecting objects regarding mode
         LOG_I("Video capturing has been started ...");
 
-        return runCamshiftTrackHand(vsr, cascade, modelPath, imageOutputPath, backprojOutputPath);
+        // Saves are written in the background so that the tracking never waits for the disk
+        AsyncSampleWriter sampleWriter((size_t) saveQueueSize, captureLogArg.getValue());
+        sampleWriter.start();
+
+        int result = runCamshiftTrackHand(vsr, cascade, modelPath, imageOutputPath, backprojOutputPath,
+                                          burstSize, sampleWriter, std::max(0, cacheArg.getValue()),
+                                          std::max(0, reloadArg.getValue()));
+
+        sampleWriter.stop();
+        if (sampleWriter.getNbOfSubmitted() > 0) {
+            sampleWriter.logStats();
+        }
+        return result;
 
     } catch (TCLAP::ArgException &e) {  // catch any exceptions
         LOG_E("error: " << e.error() << " for arg " << e.argId());
@@ -120,7 +204,8 @@ int main(int argc, const char **argv) {
 int
 runCamshiftTrackHand(VideoStreamReader &vsr, const cv::CascadeClassifier &cascade,
                      const std::string modelPath, const std::string imageOutPath,
-                     const std::string backprojOutPath) {
+                     const std::string backprojOutPath, const int burstSize,
+                     AsyncSampleWriter &sampleWriter, const int cacheSize, const int reloadMS) {
     ObjectDetector faceDetector(cascade);
     CamshiftRunner cRunner(vsr, faceDetector);
 
@@ -134,18 +219,37 @@ runCamshiftTrackHand(VideoStreamReader &vsr, const cv::CascadeClassifier &cascad
     // Create hand tracker
     HandTracker hTracker;
 
-    // Load model
-    MLPModel mlpHand;
-    // TODO label map
-    mlpHand.learnFrom(modelPath);
+    // Load model, then watch its file: a new model is swapped in between two frames
+    std::shared_ptr<HandModel> handModel;
+    ModelReloader<HandModel> modelReloader(modelPath, HandModel::load, reloadMS);
+#ifdef EMBEDDED_MODEL
+    LOG_I("Using the model compiled into the program (" << EmbeddedModel::SOURCE << "), " << modelPath
+                                                        << " is not loaded");
+#else
+    handModel = HandModel::load(modelPath);
+    if (!handModel) {
+        LOG_E("ERROR: Could not load " << modelPath << (reloadMS > 0 ? ", waiting for it to change" : ""));
+    }
+    if (reloadMS > 0) {
+        modelReloader.start();
+    }
+#endif
 
     // Variables for hand tracking
     cv::RotatedRect handTracked;
     bool handFound;
 
+    // Per-frame prediction workspace: no allocation once the first frames are processed (OpenCV fallback aside)
+    HandInput handInput(handModel ? handModel->inputSize : Default::HAND_INPUT_SIZE,
+                        (float) (handModel ? handModel->inputScale : Default::HAND_INPUT_SCALE));
+    std::unique_ptr<PredictionCache> predictionCache(cacheSize > 0 ? new PredictionCache((size_t) cacheSize)
+                                                                   : nullptr);
+
     // Control variables
     bool backprojDisplay = false;
     bool saveImgEnable = false;
+    int burstKey = 0;
+    int burstRemaining = 0;
 
     const std::function<void(CamshiftTracker &, const cv::Mat &, const cv::RotatedRect &, const bool)>
             trackFaceCallback([&](CamshiftTracker &cTracker, const cv::Mat &img,
@@ -181,30 +285,68 @@ runCamshiftTrackHand(VideoStreamReader &vsr, const cv::CascadeClassifier &cascad
                 break;
             case ':':
                 saveImgEnable = !saveImgEnable;
+                burstRemaining = 0;
                 LOG_I("Save image mode " << (saveImgEnable ? "enabled" : "disabled"));
                 break;
             default:
                 if (saveImgEnable && ('a' <= key && key <= 'z')) {
-                    saveImages(key, img, cTracker, handTracked.boundingRect(),
-                               imageOutPath, backprojOutPath);
+                    LOG_I("Saving " << burstSize << " image(s) for key \'" << (char) key << "\' ...");
+                    burstKey = key;
+                    burstRemaining = burstSize;
                 }
                 break;
         }
 
+        // Save the current frame while a burst is running (before any drawing on the image)
+        if (burstRemaining > 0) {
+            saveImages(burstKey, img, cTracker, handTracked.boundingRect(),
+                       imageOutPath, backprojOutPath, sampleWriter);
+            if (--burstRemaining == 0) {
+                sampleWriter.logStats();
+            }
+        }
+
         // Drawings and display
         if (backprojDisplay) {
             cv::cvtColor(cTracker.getBackproj(), img, cv::COLOR_GRAY2BGR);
         }
 
+        if (modelReloader.update(handModel)) {
+            handInput = HandInput(handModel->inputSize, (float) handModel->inputScale);
+            if (predictionCache) {
+                predictionCache->clear();
+            }
+        }
+
+#ifdef EMBEDDED_MODEL
         if (handFound) {
+#else
+        if (handFound && handModel) {
+#endif
             // Prediction
-            cv::Mat smallBackproj = convertToHandInput(cTracker.getBackproj(), handTracked.boundingRect());
-
-            std::pair<int, float> mlpPrediction = mlpHand.predict(smallBackproj);
+            handInput.reserve(cTracker.getBackproj().size());
+            cv::Mat smallBackproj = handInput.convert(cTracker.getBackproj(), handTracked.boundingRect());
+
+            auto predictHand = [&]() {
+#ifdef EMBEDDED_MODEL
+                return EmbeddedModel::predict(smallBackproj.ptr<float>());
+#else
+                return handModel->predict(smallBackproj);
+#endif
+            };
+            std::pair<int, float> mlpPrediction =
+                    predictionCache ? predictionCache->predict(smallBackproj.ptr<float>(), (int) smallBackproj.total(),
+                                                               predictHand)
+                                    : predictHand();
 
             if (mlpPrediction.second > 0.5) {
                 std::stringstream textPrediction;
-                textPrediction << "Letter: " << ((char) (mlpPrediction.first + 'a'))
+#ifdef EMBEDDED_MODEL
+                std::string letter(1, (char) (mlpPrediction.first + 'a'));
+#else
+                std::string letter = handModel->labelName(mlpPrediction.first);
+#endif
+                textPrediction << "Letter: " << letter
                                 << " - Proba: " << mlpPrediction.second * 100 << "%";
                 cv::putText(img, textPrediction.str(), cvPoint(32, 32), cv::QT_FONT_NORMAL, 0.8, Color::WHITE);
             }
@@ -220,31 +362,79 @@ runCamshiftTrackHand(VideoStreamReader &vsr, const cv::CascadeClassifier &cascad
         cv::imshow("CamShift", img);
     });
 
-    return cRunner.runTracking(&trackFaceCallback);
+    int result = cRunner.runTracking(&trackFaceCallback);
+    modelReloader.stop();
+    if (predictionCache) {
+        predictionCache->logStats();
+    }
+    return result;
 }
 
 
-cv::Mat convertToHandInput(const cv::Mat &input, const cv::Rect roi) {
-    int largest = roi.height > roi.width ? roi.height : roi.width;
-    cv::Rect roiTmp = cv::Rect(roi.x, roi.y, largest, largest);
-    cv::Rect imgRect(0, 0, input.cols, input.rows);
-    cv::Rect roiFinal = roiTmp & imgRect;
+std::shared_ptr<HandModel> HandModel::load(const std::string &modelPath) {
+    std::shared_ptr<HandModel> handModel = std::make_shared<HandModel>();
+    if (ModelBundle::isBundleFile(modelPath)) {
+        ModelBundle bundle;
+        if (bundle.load(modelPath) != Code::SUCCESS || handModel->configure(bundle) != Code::SUCCESS) {
+            return nullptr;
+        }
+        if (handModel->fast.load(bundle) == Code::SUCCESS) {
+            handModel->scores.resize((size_t) handModel->fast.getOutputSize());
+            LOG_I("Native inference enabled (" << MLPInference::isaName(handModel->fast.getIsa()) << ", bundle)");
+        } else if (handModel->fallback.learnFrom(bundle) != Code::SUCCESS) {
+            return nullptr;
+        }
+        return handModel;
+    }
 
-    if (roiFinal.width > roiFinal.height) {
-        roiFinal.width = roiFinal.height;
-    } else if (roiFinal.width < roiFinal.height) {
-        roiFinal.height = roiFinal.width;
+    if (handModel->fast.load(modelPath) == Code::SUCCESS) {
+        handModel->scores.resize((size_t) handModel->fast.getOutputSize());
+        LOG_I("Native inference enabled (" << MLPInference::isaName(handModel->fast.getIsa())
+                                           << (handModel->fast.isQuantized() ? ", int8" : "") << ")");
+    } else if (handModel->fallback.learnFrom(modelPath) != Code::SUCCESS) {
+        return nullptr;
     }
+    return handModel;
+}
 
-    cv::Mat result = cropResizeFlatten(input, roiFinal); // crop + resize + flatten
-    result.convertTo(result, CV_32FC1, 1.0 / 255.0);
+std::pair<int, float> HandModel::predict(cv::Mat &input) {
+    return fast.isLoaded() ? fast.predict(input.ptr<float>(), scores.data()) : fallback.predict(input);
+}
 
-    return result;
+std::string HandModel::labelName(int label) {
+    return labelMap.has(label) ? labelMap.get(label) : std::string(1, (char) (label + 'a'));
+}
+
+int HandModel::configure(const ModelBundle &bundle) {
+    labelMap = bundle.labelMap;
+    if (bundle.feature.empty()) {
+        if (bundle.getInputSize() != inputSize * inputSize) {
+            return Code::ERROR;
+        }
+        inputScale = bundle.featureScale > 0 ? bundle.featureScale : inputScale;
+        return Code::SUCCESS;
+    }
+
+    FeatureSpec feature;
+    if (FeatureSpec::parse(bundle.feature, feature) != Code::SUCCESS) {
+        return Code::ERROR;
+    }
+    if (feature.kind != FeatureSpec::RESIZE || feature.size * feature.size != bundle.getInputSize()
+        || bundle.featureScale <= 0) {
+        LOG_E("ERROR: The hand input is a resized backprojection, the model takes " << bundle.feature);
+        return Code::ERROR;
+    }
+    inputSize = feature.size;
+    inputScale = bundle.featureScale;
+    LOG_I("Hand input from the model bundle: " << inputSize << "x" << inputSize << ", scaled by " << inputScale);
+    return Code::SUCCESS;
 }
 
 cv::Mat cropResizeFlatten(const cv::Mat &input, const cv::Rect &roi) {
     cv::Mat result;
-    cv::resize(input(roi), result, cv::Size(16, 16)); // crop + resize
+    // crop + resize (area average, as the live prediction input, see HandInput)
+    cv::resize(input(roi), result, cv::Size(Default::HAND_INPUT_SIZE, Default::HAND_INPUT_SIZE), 0, 0,
+               cv::INTER_AREA);
     result = result.reshape(0, 1); // flatten
     return result;
 }
@@ -252,9 +442,8 @@ cv::Mat cropResizeFlatten(const cv::Mat &input, const cv::Rect &roi) {
 void saveImages(const int key, const cv::Mat &img,
                 const CamshiftTracker &cTracker, const cv::Rect hRect,
                 const std::string imageOutPath,
-                const std::string backprojOutPath) {
-    LOG_I("Saving image for key \'" << (char) key << "\' ...");
-
+                const std::string backprojOutPath,
+                AsyncSampleWriter &sampleWriter) {
     // Get the largest value between height and width (maximizing probabilities to keep the whole hand)
     // Then create the final safe roi to use
     int largest = hRect.height > hRect.width ? hRect.height : hRect.width;
@@ -262,25 +451,30 @@ void saveImages(const int key, const cv::Mat &img,
     cv::Rect imgRect(0, 0, img.cols, img.rows);
     cv::Rect roiFinal = roi & imgRect; // safe part
 
-    // Crop image
-    cv::Mat imgCropped = img(roiFinal);
+    AsyncSampleWriter::Sample sample;
+    sample.letter = key;
+
+    // Crop image (copied: the frame buffer is reused by the next capture)
+    sample.image = img(roiFinal).clone();
 
     // Create save path
+    sample.timestamp = get_timestamp();
     std::stringstream fileName;
-    fileName << std::string(1, key) << "_fl300459_" << std::to_string(get_timestamp());
+    fileName << std::string(1, key) << "_fl300459_" << std::to_string(sample.timestamp);
 
-    // Save cropped image
+    // Cropped image path
     std::stringstream imageFilePath;
     imageFilePath << imageOutPath << fileName.str() << ".png";
-    cv::imwrite(imageFilePath.str(), imgCropped);
+    sample.imagePath = imageFilePath.str();
 
     // Crop, resize and flatten backproj
-    cv::Mat smallBackproj = cropResizeFlatten(cTracker.getBackproj(), roiFinal); // crop
+    sample.data = cropResizeFlatten(cTracker.getBackproj(), roiFinal); // crop
 
-    // Save small backproj to yml file
+    // Small backproj path (.yml)
     std::stringstream dataFilePath;
     dataFilePath << backprojOutPath << fileName.str() << ".yml";
+    sample.dataPath = dataFilePath.str();
 
-    DataYmlWriter writer(dataFilePath.str());
-    writer.writeLetter(smallBackproj, key);
+    // Written by the background writer, dropped if it can not keep up
+    sampleWriter.submit(std::move(sample));
 }